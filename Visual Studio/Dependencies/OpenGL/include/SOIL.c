@@ -1049,7 +1049,7 @@ unsigned int
 	/*	does the user want me to scale the colors into the NTSC safe RGB range?	*/
 	if( flags & SOIL_FLAG_NTSC_SAFE_RGB )
 	{
-		scale_image_RGB_to_NTSC_safe( img, width, height, channels );
+		scale_image_RGB_to_NTSC_safe_fast( img, width, height, channels );
 	}
 	/*	does the user want me to convert from straight to pre-multiplied alpha?
 		(and do we even _have_ alpha?)	*/
@@ -1109,7 +1109,7 @@ unsigned int
 		{
 			/*	yep, resize	*/
 			unsigned char *resampled = (unsigned char*)malloc( channels*new_width*new_height );
-			up_scale_image(
+			up_scale_image_fast(
 					img, width, height, channels,
 					resampled, new_width, new_height );
 			/*	OJO	this is for debug only!	*/
@@ -1145,7 +1145,7 @@ unsigned int
 		new_height = height / reduce_block_y;
 		resampled = (unsigned char*)malloc( channels*new_width*new_height );
 		/*	perform the actual reduction	*/
-		mipmap_image(	img, width, height, channels,
+		mipmap_image_fast(	img, width, height, channels,
 						resampled, reduce_block_x, reduce_block_y );
 		/*	nuke the old guy, then point it at the new guy	*/
 		SOIL_free_image_data( img );
@@ -1265,7 +1265,7 @@ unsigned int
 			while( ((1<<MIPlevel) <= width) || ((1<<MIPlevel) <= height) )
 			{
 				/*	do this MIPmap level	*/
-				mipmap_image(
+				mipmap_image_fast(
 						img, width, height, channels,
 						resampled,
 						(1 << MIPlevel), (1 << MIPlevel) );
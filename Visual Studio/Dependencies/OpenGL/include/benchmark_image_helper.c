@@ -0,0 +1,173 @@
+/*
+	Benchmark for the image_helper resamplers
+
+	times the original single threaded functions against the
+	*_fast versions (and checks they are bit for bit the same),
+	then times the sRGB box filter and the Lanczos resize.
+
+	build:	cc -O2 -fopenmp benchmark_image_helper.c image_helper.c -lm
+	run:	benchmark [width height channels runs]
+*/
+
+#include "image_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*	wall clock seconds (clock() would add up every thread's time)	*/
+static double now( void )
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void report( const char *name, double old_time, double new_time, int same )
+{
+	if( old_time > 0.0 )
+	{
+		printf( "%-28s %9.2f ms -> %9.2f ms  (%5.2fx)  %s\n", name,
+			old_time * 1000.0, new_time * 1000.0, old_time / new_time,
+			same ? "identical" : "DIFFERENT" );
+	} else
+	{
+		printf( "%-28s %9s    -> %9.2f ms\n", name, "", new_time * 1000.0 );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	int width = 4096, height = 4096, channels = 4, runs = 5;
+	int i, r, same;
+	size_t size;
+	unsigned char *image, *a, *b;
+	double t, old_time, new_time;
+
+	if( argc == 5 )
+	{
+		width = atoi( argv[1] );
+		height = atoi( argv[2] );
+		channels = atoi( argv[3] );
+		runs = atoi( argv[4] );
+	}
+	if( (width < 2) || (height < 2) || (channels < 1) || (channels > 4) || (runs < 1) )
+	{
+		printf( "usage: %s [width height channels runs]\n", argv[0] );
+		return 1;
+	}
+#ifdef _OPENMP
+	printf( "%dx%d, %d channels, %d runs, %d threads\n", width, height, channels, runs, omp_get_max_threads() );
+#else
+	printf( "%dx%d, %d channels, %d runs, no OpenMP\n", width, height, channels, runs );
+#endif
+	size = (size_t)width * height * channels;
+	image = (unsigned char*)malloc( size );
+	a = (unsigned char*)malloc( size * 4 );
+	b = (unsigned char*)malloc( size * 4 );
+	if( !image || !a || !b )
+	{
+		printf( "out of memory\n" );
+		return 1;
+	}
+	srand( 1 );
+	for( i = 0; i < (int)size; ++i )
+	{
+		/*	gradients plus noise, something like a real picture	*/
+		image[i] = (unsigned char)(((i / channels) % width + (i / channels / width) + (rand() & 31)) & 255);
+	}
+
+	/*	2x upscale of the top left quarter	*/
+	old_time = new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		up_scale_image( image, width / 2, height / 2, channels, a, width, height );
+		old_time += now() - t;
+		t = now();
+		up_scale_image_fast( image, width / 2, height / 2, channels, b, width, height );
+		new_time += now() - t;
+	}
+	same = memcmp( a, b, size ) == 0;
+	report( "up_scale_image", old_time / runs, new_time / runs, same );
+
+	/*	one MIPmap level, then a much bigger block	*/
+	old_time = new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		mipmap_image( image, width, height, channels, a, 2, 2 );
+		old_time += now() - t;
+		t = now();
+		mipmap_image_fast( image, width, height, channels, b, 2, 2 );
+		new_time += now() - t;
+	}
+	same = memcmp( a, b, size / 4 ) == 0;
+	report( "mipmap_image 2x2", old_time / runs, new_time / runs, same );
+
+	old_time = new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		mipmap_image( image, width, height, channels, a, 16, 16 );
+		old_time += now() - t;
+		t = now();
+		mipmap_image_fast( image, width, height, channels, b, 16, 16 );
+		new_time += now() - t;
+	}
+	same = memcmp( a, b, size / 256 ) == 0;
+	report( "mipmap_image 16x16", old_time / runs, new_time / runs, same );
+
+	old_time = new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		memcpy( a, image, size );
+		memcpy( b, image, size );
+		t = now();
+		scale_image_RGB_to_NTSC_safe( a, width, height, channels );
+		old_time += now() - t;
+		t = now();
+		scale_image_RGB_to_NTSC_safe_fast( b, width, height, channels );
+		new_time += now() - t;
+	}
+	same = memcmp( a, b, size ) == 0;
+	report( "scale_image_RGB_to_NTSC_safe", old_time / runs, new_time / runs, same );
+
+	/*	the new filters, against the box filter they replace	*/
+	old_time = new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		mipmap_image_sRGB( image, width, height, channels, b, 2, 2 );
+		new_time += now() - t;
+	}
+	report( "mipmap_image_sRGB 2x2", 0.0, new_time / runs, 1 );
+
+	new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		resize_image_Lanczos( image, width, height, channels, b, width / 2, height / 2, 1 );
+		new_time += now() - t;
+	}
+	report( "resize_image_Lanczos 1/2", 0.0, new_time / runs, 1 );
+
+	new_time = 0.0;
+	for( r = 0; r < runs; ++r )
+	{
+		t = now();
+		resize_image_Lanczos( image, width / 2, height / 2, channels, b, width, height, 1 );
+		new_time += now() - t;
+	}
+	report( "resize_image_Lanczos 2x", 0.0, new_time / runs, 1 );
+
+	free( image );
+	free( a );
+	free( b );
+	return 0;
+}
@@ -13,6 +13,23 @@
 #include <string.h>
 #include <stdio.h>
 
+/*	SSE2 versions of the per block math.  All the sums are
+	integers below 2^24 (exact in a float) and every dot product
+	is evaluated in the same order as the scalar code, so the
+	output is bit identical either way.	*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define DXT_USE_SSE2	1
+#else
+#define DXT_USE_SSE2	0
+#endif
+
+/*	rows of blocks are compressed in parallel when built with
+	OpenMP (/openmp or -fopenmp), each block is independent	*/
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -104,11 +121,8 @@ unsigned char* convert_image_to_DXT1(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
+	int block_row, blocks_wide, blocks_high;
+	int chan_step = 1;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -124,12 +138,19 @@ unsigned char* convert_image_to_DXT1(
 	}
 	/*	get the RAM for the compressed image
 		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
+	blocks_wide = (width+3) >> 2;
+	blocks_high = (height+3) >> 2;
+	*out_size = blocks_wide * blocks_high * 8;
 	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	/*	go through each row of blocks (each thread gets its own rows)	*/
+	#pragma omp parallel for schedule(dynamic, 4)
+	for( block_row = 0; block_row < blocks_high; ++block_row )
 	{
-		for( i = 0; i < width; i += 4 )
+		int i, j = block_row * 4, x, y;
+		unsigned char ublock[16*3];
+		/*	every block has a fixed place in the output	*/
+		unsigned char *cblock = compressed + block_row * blocks_wide * 8;
+		for( i = 0; i < width; i += 4, cblock += 8 )
 		{
 			/*	copy this block into a new one	*/
 			int idx = 0;
@@ -166,14 +187,8 @@ unsigned char* convert_image_to_DXT1(
 					ublock[idx++] = ublock[2];
 				}
 			}
-			/*	compress the block	*/
-			++block_count;
+			/*	compress the block straight into the main block	*/
 			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
 		}
 	}
 	return compressed;
@@ -185,11 +200,9 @@ unsigned char* convert_image_to_DXT5(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
+	int block_row, blocks_wide, blocks_high;
+	int chan_step = 1;
+	int has_alpha;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -207,12 +220,19 @@ unsigned char* convert_image_to_DXT5(
 	has_alpha = 1 - (channels & 1);
 	/*	get the RAM for the compressed image
 		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
+	blocks_wide = (width+3) >> 2;
+	blocks_high = (height+3) >> 2;
+	*out_size = blocks_wide * blocks_high * 16;
 	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	/*	go through each row of blocks (each thread gets its own rows)	*/
+	#pragma omp parallel for schedule(dynamic, 4)
+	for( block_row = 0; block_row < blocks_high; ++block_row )
 	{
-		for( i = 0; i < width; i += 4 )
+		int i, j = block_row * 4, x, y;
+		unsigned char ublock[16*4];
+		/*	every block has a fixed place in the output	*/
+		unsigned char *cblock = compressed + block_row * blocks_wide * 16;
+		for( i = 0; i < width; i += 4, cblock += 16 )
 		{
 			/*	local variables, and my block counter	*/
 			int idx = 0;
@@ -254,21 +274,9 @@ unsigned char* convert_image_to_DXT5(
 					ublock[idx++] = ublock[3];
 				}
 			}
-			/*	now compress the alpha block	*/
+			/*	now compress the alpha block, then the color block	*/
 			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
+			compress_DDS_color_block( 4, ublock, cblock + 8 );
 		}
 	}
 	return compressed;
@@ -296,6 +304,31 @@ void rgb_888_from_565( unsigned int c, int *r, int *g, int *b )
 	*b = convert_bit_range( (c >> 00) & 31, 5, 8 );
 }
 
+#if DXT_USE_SSE2
+/*	pull the R, G and B of a 16 pixel block apart,
+	so 4 pixels can go through the math at once	*/
+static void block_to_planar(
+		const unsigned char *const uncompressed,
+		int channels,
+		float r[16], float g[16], float b[16] )
+{
+	int i;
+	for( i = 0; i < 16; ++i )
+	{
+		r[i] = uncompressed[i*channels+0];
+		g[i] = uncompressed[i*channels+1];
+		b[i] = uncompressed[i*channels+2];
+	}
+}
+
+static int hsum_epi32( __m128i v )
+{
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_cvtsi128_si32( v );
+}
+#endif
+
 void compute_color_line_STDEV(
 		const unsigned char *const uncompressed,
 		int channels,
@@ -308,6 +341,35 @@ void compute_color_line_STDEV(
 	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
 	/*	calculate all data needed for the covariance matrix
 		( to compare with _rygdxt code)	*/
+	#if DXT_USE_SSE2
+	{
+		/*	16 bit lanes, pmaddwd does the products and pairwise sums	*/
+		short r[16], g[16], b[16];
+		__m128i ones = _mm_set1_epi16( 1 );
+		__m128i r0, r1, g0, g1, b0, b1;
+		for( i = 0; i < 16; ++i )
+		{
+			r[i] = uncompressed[i*channels+0];
+			g[i] = uncompressed[i*channels+1];
+			b[i] = uncompressed[i*channels+2];
+		}
+		r0 = _mm_loadu_si128( (const __m128i *)r );
+		r1 = _mm_loadu_si128( (const __m128i *)(r + 8) );
+		g0 = _mm_loadu_si128( (const __m128i *)g );
+		g1 = _mm_loadu_si128( (const __m128i *)(g + 8) );
+		b0 = _mm_loadu_si128( (const __m128i *)b );
+		b1 = _mm_loadu_si128( (const __m128i *)(b + 8) );
+		sum_r = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( r0, ones ), _mm_madd_epi16( r1, ones ) ) );
+		sum_g = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( g0, ones ), _mm_madd_epi16( g1, ones ) ) );
+		sum_b = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( b0, ones ), _mm_madd_epi16( b1, ones ) ) );
+		sum_rr = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( r0, r0 ), _mm_madd_epi16( r1, r1 ) ) );
+		sum_gg = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( g0, g0 ), _mm_madd_epi16( g1, g1 ) ) );
+		sum_bb = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( b0, b0 ), _mm_madd_epi16( b1, b1 ) ) );
+		sum_rg = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( r0, g0 ), _mm_madd_epi16( r1, g1 ) ) );
+		sum_rb = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( r0, b0 ), _mm_madd_epi16( r1, b1 ) ) );
+		sum_gb = (float)hsum_epi32( _mm_add_epi32( _mm_madd_epi16( g0, b0 ), _mm_madd_epi16( g1, b1 ) ) );
+	}
+	#else
 	for( i = 0; i < 16*channels; i += channels )
 	{
 		sum_r += uncompressed[i+0];
@@ -320,6 +382,7 @@ void compute_color_line_STDEV(
 		sum_rb += uncompressed[i+0] * uncompressed[i+2];
 		sum_gb += uncompressed[i+1] * uncompressed[i+2];
 	}
+	#endif
 	/*	convert the sums to averages	*/
 	sum_r *= inv_16;
 	sum_g *= inv_16;
@@ -431,6 +494,35 @@ void LSE_master_colors_max_min(
 	vec_len2 = 1.0f / ( 0.00001f +
 			sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
 	/*	finding the max and min vector values	*/
+	#if DXT_USE_SSE2
+	{
+		float r[16], g[16], b[16];
+		__m128 x = _mm_set1_ps( sum_x2[0] );
+		__m128 y = _mm_set1_ps( sum_x2[1] );
+		__m128 z = _mm_set1_ps( sum_x2[2] );
+		__m128 vmin, vmax;
+		block_to_planar( uncompressed, channels, r, g, b );
+		vmin = vmax = _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x, _mm_loadu_ps( r ) ),
+				_mm_mul_ps( y, _mm_loadu_ps( g ) ) ),
+				_mm_mul_ps( z, _mm_loadu_ps( b ) ) );
+		for( i = 4; i < 16; i += 4 )
+		{
+			__m128 d = _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x, _mm_loadu_ps( r + i ) ),
+				_mm_mul_ps( y, _mm_loadu_ps( g + i ) ) ),
+				_mm_mul_ps( z, _mm_loadu_ps( b + i ) ) );
+			vmin = _mm_min_ps( vmin, d );
+			vmax = _mm_max_ps( vmax, d );
+		}
+		vmin = _mm_min_ps( vmin, _mm_movehl_ps( vmin, vmin ) );
+		vmin = _mm_min_ss( vmin, _mm_shuffle_ps( vmin, vmin, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+		vmax = _mm_max_ps( vmax, _mm_movehl_ps( vmax, vmax ) );
+		vmax = _mm_max_ss( vmax, _mm_shuffle_ps( vmax, vmax, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+		dot_min = _mm_cvtss_f32( vmin );
+		dot_max = _mm_cvtss_f32( vmax );
+	}
+	#else
 	dot_max =
 			(
 				sum_x2[0] * uncompressed[0] +
@@ -454,6 +546,7 @@ void LSE_master_colors_max_min(
 			dot_max = dot;
 		}
 	}
+	#endif
 	/*	and the offset (from the average location)	*/
 	dot = sum_x2[0]*sum_x[0] + sum_x2[1]*sum_x[1] + sum_x2[2]*sum_x[2];
 	dot_min -= dot;
@@ -548,6 +641,43 @@ void
 	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
 	/*	store the rest of the bits	*/
 	next_bit = 8*4;
+	#if DXT_USE_SSE2
+	{
+		float r[16], g[16], b[16];
+		int values[16];
+		__m128 x = _mm_set1_ps( color_line[0] );
+		__m128 y = _mm_set1_ps( color_line[1] );
+		__m128 z = _mm_set1_ps( color_line[2] );
+		__m128 offset = _mm_set1_ps( dot_offset );
+		__m128 three = _mm_set1_ps( 3.0f );
+		__m128 half = _mm_set1_ps( 0.5f );
+		block_to_planar( uncompressed, channels, r, g, b );
+		for( i = 0; i < 16; i += 4 )
+		{
+			/*	same expression as below, 4 pixels at a time	*/
+			__m128 dot_product = _mm_sub_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( x, _mm_loadu_ps( r + i ) ),
+				_mm_mul_ps( y, _mm_loadu_ps( g + i ) ) ),
+				_mm_mul_ps( z, _mm_loadu_ps( b + i ) ) ),
+				offset );
+			_mm_storeu_si128( (__m128i *)(values + i),
+				_mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( dot_product, three ), half ) ) );
+		}
+		for( i = 0; i < 16; ++i )
+		{
+			int next_value = values[i];
+			if( next_value > 3 )
+			{
+				next_value = 3;
+			} else if( next_value < 0 )
+			{
+				next_value = 0;
+			}
+			compressed[next_bit >> 3] |= swizzle4[ next_value ] << (next_bit & 7);
+			next_bit += 2;
+		}
+	}
+	#else
 	for( i = 0; i < 16; ++i )
 	{
 		/*	find the dot product of this color, to place it on the line
@@ -571,6 +701,7 @@ void
 		compressed[next_bit >> 3] |= swizzle4[ next_value ] << (next_bit & 7);
 		next_bit += 2;
 	}
+	#endif
 	/*	done compressing to DXT1	*/
 }
 
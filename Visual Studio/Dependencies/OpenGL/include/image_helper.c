@@ -8,8 +8,22 @@
 
 #include "image_helper.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+/*	the *_fast, sRGB and Lanczos functions split rows across
+	threads with OpenMP (/openmp or -fopenmp), and use SSE2
+	for 4 channel images where the compiler allows it	*/
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define IMAGE_HELPER_SSE2	1
+#else
+#define IMAGE_HELPER_SSE2	0
+#endif
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -188,6 +202,561 @@ int
 	return 1;
 }
 
+/********* Threaded / SIMD versions *********/
+
+/*	pixel in, 4 floats out (4 channel images only)	*/
+#if IMAGE_HELPER_SSE2
+static __m128 load_pixel_ps( const unsigned char *p )
+{
+	int bits;
+	__m128i zero = _mm_setzero_si128();
+	memcpy( &bits, p, 4 );
+	return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bits ), zero ), zero ) );
+}
+
+static void store_pixel_ps( unsigned char *p, __m128 v )
+{
+	/*	truncates, just like the (unsigned char) cast	*/
+	__m128i i = _mm_cvttps_epi32( v );
+	int bits;
+	i = _mm_packs_epi32( i, i );
+	i = _mm_packus_epi16( i, i );
+	bits = _mm_cvtsi128_si32( i );
+	memcpy( p, &bits, 4 );
+}
+#endif
+
+int
+	up_scale_image_fast
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height
+	)
+{
+	float dx, dy;
+	int y;
+
+	/* error(s) check	*/
+	if ( 	(width < 1) || (height < 1) ||
+			(resampled_width < 2) || (resampled_height < 2) ||
+			(channels < 1) ||
+			(NULL == orig) || (NULL == resampled) )
+	{
+		/*	signify badness	*/
+		return 0;
+	}
+	dx = (width - 1.0f) / (resampled_width - 1.0f);
+	dy = (height - 1.0f) / (resampled_height - 1.0f);
+	#pragma omp parallel for schedule(static)
+	for ( y = 0; y < resampled_height; ++y )
+	{
+		/* find the base y index and fractional offset from that	*/
+		float sampley = y * dy;
+		int inty = (int)sampley;
+		int x, c;
+		if( inty > height - 2 ) { inty = height - 2; }
+		sampley -= inty;
+		for ( x = 0; x < resampled_width; ++x )
+		{
+			float samplex = x * dx;
+			int intx = (int)samplex;
+			int base_index;
+			if( intx > width - 2 ) { intx = width - 2; }
+			samplex -= intx;
+			base_index = (inty * width + intx) * channels;
+			#if IMAGE_HELPER_SSE2
+			if( channels == 4 )
+			{
+				/*	all 4 channels at once, each term in the same order as below	*/
+				__m128 sx0 = _mm_set1_ps( 1.0f-samplex ), sx1 = _mm_set1_ps( samplex );
+				__m128 sy0 = _mm_set1_ps( 1.0f-sampley ), sy1 = _mm_set1_ps( sampley );
+				__m128 value = _mm_set1_ps( 0.5f );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_pixel_ps( orig + base_index ), sx0 ), sy0 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_pixel_ps( orig + base_index + 4 ), sx1 ), sy0 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_pixel_ps( orig + base_index + width*4 ), sx0 ), sy1 ) );
+				value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( load_pixel_ps( orig + base_index + width*4 + 4 ), sx1 ), sy1 ) );
+				store_pixel_ps( resampled + (y*resampled_width + x)*4, value );
+				continue;
+			}
+			#endif
+			for ( c = 0; c < channels; ++c )
+			{
+				float value = 0.5f;
+				value += orig[base_index]
+							*(1.0f-samplex)*(1.0f-sampley);
+				value += orig[base_index+channels]
+							*(samplex)*(1.0f-sampley);
+				value += orig[base_index+width*channels]
+							*(1.0f-samplex)*(sampley);
+				value += orig[base_index+width*channels+channels]
+							*(samplex)*(sampley);
+				++base_index;
+				resampled[y*resampled_width*channels+x*channels+c] =
+						(unsigned char)(value);
+			}
+		}
+	}
+	/*	done	*/
+	return 1;
+}
+
+int
+	mipmap_image_fast
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+	int mip_width, mip_height;
+	int j;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) ||
+		(resampled == NULL) ||
+		(block_size_x < 1) || (block_size_y < 1) )
+	{
+		/*	nothing to do	*/
+		return 0;
+	}
+	mip_width = width / block_size_x;
+	mip_height = height / block_size_y;
+	if( mip_width < 1 )
+	{
+		mip_width = 1;
+	}
+	if( mip_height < 1 )
+	{
+		mip_height = 1;
+	}
+	#pragma omp parallel for schedule(dynamic, 4)
+	for( j = 0; j < mip_height; ++j )
+	{
+		int i, c;
+		for( i = 0; i < mip_width; ++i )
+		{
+			#if IMAGE_HELPER_SSE2
+			if( (channels == 4) &&
+				(block_size_x * (i+1) <= width) &&
+				(block_size_y * (j+1) <= height) )
+			{
+				/*	a whole block: sum all 4 channels together, 4 pixels per load	*/
+				const int block_area = block_size_x*block_size_y;
+				__m128i zero = _mm_setzero_si128();
+				__m128i sum = _mm_set1_epi32( block_area >> 1 );
+				int sums[4];
+				int u, v;
+				for( v = 0; v < block_size_y; ++v )
+				{
+					const unsigned char *row = orig + ((j*block_size_y + v)*width + i*block_size_x)*4;
+					for( u = 0; u + 4 <= block_size_x; u += 4 )
+					{
+						__m128i p = _mm_loadu_si128( (const __m128i *)(row + u*4) );
+						__m128i lo = _mm_unpacklo_epi8( p, zero );
+						__m128i hi = _mm_unpackhi_epi8( p, zero );
+						/*	pixels 0+1 and 2+3 in 16 bits, then widen and add	*/
+						__m128i pair = _mm_add_epi16( lo, hi );
+						sum = _mm_add_epi32( sum, _mm_unpacklo_epi16( pair, zero ) );
+						sum = _mm_add_epi32( sum, _mm_unpackhi_epi16( pair, zero ) );
+					}
+					for( ; u < block_size_x; ++u )
+					{
+						int bits;
+						memcpy( &bits, row + u*4, 4 );
+						sum = _mm_add_epi32( sum, _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bits ), zero ), zero ) );
+					}
+				}
+				_mm_storeu_si128( (__m128i *)sums, sum );
+				for( c = 0; c < 4; ++c )
+				{
+					resampled[(j*mip_width + i)*4 + c] = sums[c] / block_area;
+				}
+				continue;
+			}
+			#endif
+			for( c = 0; c < channels; ++c )
+			{
+				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+				int sum_value;
+				int u,v;
+				int u_block = block_size_x;
+				int v_block = block_size_y;
+				int block_area;
+				/*	(same edge handling as mipmap_image, quirks included)	*/
+				if( block_size_x * (i+1) > width )
+				{
+					u_block = width - i*block_size_y;
+				}
+				if( block_size_y * (j+1) > height )
+				{
+					v_block = height - j*block_size_y;
+				}
+				block_area = u_block*v_block;
+				sum_value = block_area >> 1;
+				for( v = 0; v < v_block; ++v )
+				for( u = 0; u < u_block; ++u )
+				{
+					sum_value += orig[index + v*width*channels + u*channels];
+				}
+				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
+			}
+		}
+	}
+	return 1;
+}
+
+int
+	scale_image_RGB_to_NTSC_safe_fast
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+	const float scale_lo = 16.0f - 0.499f;
+	const float scale_hi = 235.0f + 0.499f;
+	int i, y;
+	int nc = channels;
+	unsigned char scale_LUT[256];
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) )
+	{
+		/*	nothing to do	*/
+		return 0;
+	}
+	for( i = 0; i < 256; ++i )
+	{
+		scale_LUT[i] = (unsigned char)((scale_hi - scale_lo) * i / 255.0f + scale_lo);
+	}
+	nc -= 1 - (channels & 1);
+	/*	a table lookup per byte, so threads are the only speed up	*/
+	#pragma omp parallel for schedule(static)
+	for( y = 0; y < height; ++y )
+	{
+		unsigned char *p = orig + y*width*channels;
+		unsigned char *end = p + width*channels;
+		int j;
+		for( ; p < end; p += channels )
+		{
+			for( j = 0; j < nc; ++j )
+			{
+				p[j] = scale_LUT[p[j]];
+			}
+		}
+	}
+	return 1;
+}
+
+/*	sRGB <-> linear tables, built once (identical values if two threads race)	*/
+#define LINEAR_TO_SRGB_SIZE	16384
+static float sRGB_to_linear_LUT[256];
+static unsigned char linear_to_sRGB_LUT[LINEAR_TO_SRGB_SIZE];
+static volatile int sRGB_LUTs_ready = 0;
+
+static void build_sRGB_LUTs( void )
+{
+	int i;
+	if( sRGB_LUTs_ready )
+	{
+		return;
+	}
+	for( i = 0; i < 256; ++i )
+	{
+		float c = i / 255.0f;
+		sRGB_to_linear_LUT[i] = (c <= 0.04045f) ? c / 12.92f : (float)pow( (c + 0.055f) / 1.055f, 2.4f );
+	}
+	for( i = 0; i < LINEAR_TO_SRGB_SIZE; ++i )
+	{
+		float l = (i + 0.5f) / LINEAR_TO_SRGB_SIZE;
+		float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * (float)pow( l, 1.0f / 2.4f ) - 0.055f;
+		linear_to_sRGB_LUT[i] = (unsigned char)(c * 255.0f + 0.5f);
+	}
+	sRGB_LUTs_ready = 1;
+}
+
+static unsigned char linear_to_sRGB( float l )
+{
+	int i = (int)(l * LINEAR_TO_SRGB_SIZE);
+	if( i < 0 ) { i = 0; } else if( i >= LINEAR_TO_SRGB_SIZE ) { i = LINEAR_TO_SRGB_SIZE - 1; }
+	return linear_to_sRGB_LUT[i];
+}
+
+static unsigned char unit_to_byte( float v )
+{
+	if( v <= 0.0f ) { return 0; }
+	if( v >= 1.0f ) { return 255; }
+	return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+int
+	mipmap_image_sRGB
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+	int mip_width, mip_height;
+	int j;
+	/*	channels 2 and 4 carry alpha, which is already linear	*/
+	int color_channels = channels - (1 - (channels & 1));
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) || (orig == NULL) ||
+		(resampled == NULL) ||
+		(block_size_x < 1) || (block_size_y < 1) )
+	{
+		return 0;
+	}
+	build_sRGB_LUTs();
+	mip_width = width / block_size_x;
+	mip_height = height / block_size_y;
+	if( mip_width < 1 )
+	{
+		mip_width = 1;
+	}
+	if( mip_height < 1 )
+	{
+		mip_height = 1;
+	}
+	#pragma omp parallel for schedule(dynamic, 4)
+	for( j = 0; j < mip_height; ++j )
+	{
+		int i, c, u, v;
+		int y0 = j*block_size_y, y1 = y0 + block_size_y;
+		if( y1 > height ) { y1 = height; }
+		for( i = 0; i < mip_width; ++i )
+		{
+			int x0 = i*block_size_x, x1 = x0 + block_size_x;
+			float inv_area;
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			if( x1 > width ) { x1 = width; }
+			inv_area = 1.0f / ((x1 - x0) * (y1 - y0));
+			#if IMAGE_HELPER_SSE2
+			if( channels == 4 )
+			{
+				__m128 acc = _mm_setzero_ps();
+				for( v = y0; v < y1; ++v )
+				{
+					const unsigned char *p = orig + (v*width + x0)*4;
+					for( u = x0; u < x1; ++u, p += 4 )
+					{
+						acc = _mm_add_ps( acc, _mm_set_ps( p[3] * (1.0f / 255.0f),
+								sRGB_to_linear_LUT[p[2]], sRGB_to_linear_LUT[p[1]], sRGB_to_linear_LUT[p[0]] ) );
+					}
+				}
+				_mm_storeu_ps( sum, _mm_mul_ps( acc, _mm_set1_ps( inv_area ) ) );
+			} else
+			#endif
+			{
+				for( v = y0; v < y1; ++v )
+				{
+					const unsigned char *p = orig + (v*width + x0)*channels;
+					for( u = x0; u < x1; ++u, p += channels )
+					{
+						for( c = 0; c < channels; ++c )
+						{
+							sum[c] += (c < color_channels) ? sRGB_to_linear_LUT[p[c]] : p[c] * (1.0f / 255.0f);
+						}
+					}
+				}
+				for( c = 0; c < channels; ++c )
+				{
+					sum[c] *= inv_area;
+				}
+			}
+			for( c = 0; c < channels; ++c )
+			{
+				resampled[(j*mip_width + i)*channels + c] =
+					(c < color_channels) ? linear_to_sRGB( sum[c] ) : unit_to_byte( sum[c] );
+			}
+		}
+	}
+	return 1;
+}
+
+/*	one output sample's taps into the source: first index, count, then weights	*/
+typedef struct
+{
+	int first;
+	int count;
+	float *weights;
+} Lanczos_taps;
+
+#define LANCZOS_LOBES	3
+
+static float Lanczos_kernel( float x )
+{
+	const float pi = 3.14159265358979f;
+	if( x < 0.0f ) { x = -x; }
+	if( x < 1e-6f ) { return 1.0f; }
+	if( x >= LANCZOS_LOBES ) { return 0.0f; }
+	return (float)(LANCZOS_LOBES * sin( pi * x ) * sin( pi * x / LANCZOS_LOBES ) / (pi * pi * x * x));
+}
+
+/*	weights for resampling in_size samples to out_size, edges clamped	*/
+static Lanczos_taps *Lanczos_weights( int in_size, int out_size, float **storage )
+{
+	float ratio = (float)in_size / out_size;
+	/*	when shrinking, stretch the kernel so it also filters out what can't be shown	*/
+	float scale = (ratio > 1.0f) ? ratio : 1.0f;
+	float support = LANCZOS_LOBES * scale;
+	int max_taps = (int)ceil( support ) * 2 + 1;
+	Lanczos_taps *taps = (Lanczos_taps*)malloc( out_size * sizeof( Lanczos_taps ) );
+	float *w = (float*)malloc( out_size * max_taps * sizeof( float ) );
+	int o, k;
+	*storage = w;
+	if( (taps == NULL) || (w == NULL) )
+	{
+		free( taps );
+		free( w );
+		*storage = NULL;
+		return NULL;
+	}
+	for( o = 0; o < out_size; ++o )
+	{
+		float center = (o + 0.5f) * ratio - 0.5f;
+		int first = (int)ceil( center - support );
+		int last = (int)floor( center + support );
+		float total = 0.0f;
+		if( last - first + 1 > max_taps ) { last = first + max_taps - 1; }
+		taps[o].first = first;
+		taps[o].count = last - first + 1;
+		taps[o].weights = w + o * max_taps;
+		for( k = 0; k < taps[o].count; ++k )
+		{
+			taps[o].weights[k] = Lanczos_kernel( (first + k - center) / scale );
+			total += taps[o].weights[k];
+		}
+		for( k = 0; k < taps[o].count; ++k )
+		{
+			taps[o].weights[k] /= total;
+		}
+	}
+	return taps;
+}
+
+int
+	resize_image_Lanczos
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		int sRGB
+	)
+{
+	Lanczos_taps *h_taps, *v_taps;
+	float *h_storage, *v_storage, *tmp;
+	int color_channels = channels - (1 - (channels & 1));
+	int row_floats = resampled_width * channels;
+	int y;
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(resampled_width < 1) || (resampled_height < 1) ||
+		(NULL == orig) || (NULL == resampled) )
+	{
+		return 0;
+	}
+	if( !sRGB )
+	{
+		color_channels = 0;
+	}
+	build_sRGB_LUTs();
+	h_taps = Lanczos_weights( width, resampled_width, &h_storage );
+	v_taps = Lanczos_weights( height, resampled_height, &v_storage );
+	/*	horizontally filtered rows, full height, in [0,1] (linear if sRGB)	*/
+	tmp = (float*)malloc( (size_t)height * row_floats * sizeof( float ) );
+	if( (h_taps == NULL) || (v_taps == NULL) || (tmp == NULL) )
+	{
+		free( h_taps ); free( h_storage );
+		free( v_taps ); free( v_storage );
+		free( tmp );
+		return 0;
+	}
+	/*	pass 1: across each row	*/
+	#pragma omp parallel for schedule(static)
+	for( y = 0; y < height; ++y )
+	{
+		const unsigned char *src = orig + y*width*channels;
+		float *dst = tmp + y*row_floats;
+		int x, k, c;
+		for( x = 0; x < resampled_width; ++x )
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for( k = 0; k < h_taps[x].count; ++k )
+			{
+				int sx = h_taps[x].first + k;
+				float w = h_taps[x].weights[k];
+				if( sx < 0 ) { sx = 0; } else if( sx >= width ) { sx = width - 1; }
+				for( c = 0; c < channels; ++c )
+				{
+					float value = (c < color_channels) ? sRGB_to_linear_LUT[src[sx*channels+c]] : src[sx*channels+c] * (1.0f / 255.0f);
+					sum[c] += w * value;
+				}
+			}
+			for( c = 0; c < channels; ++c )
+			{
+				dst[x*channels+c] = sum[c];
+			}
+		}
+	}
+	/*	pass 2: down each column, a whole output row at a time (contiguous, so SIMD friendly)	*/
+	#pragma omp parallel for schedule(static)
+	for( y = 0; y < resampled_height; ++y )
+	{
+		unsigned char *out = resampled + y*row_floats;
+		float *acc = (float*)malloc( row_floats * sizeof( float ) );
+		int x, k;
+		if( acc == NULL )
+		{
+			continue;
+		}
+		for( x = 0; x < row_floats; ++x )
+		{
+			acc[x] = 0.0f;
+		}
+		for( k = 0; k < v_taps[y].count; ++k )
+		{
+			int sy = v_taps[y].first + k;
+			float w = v_taps[y].weights[k];
+			const float *row;
+			if( sy < 0 ) { sy = 0; } else if( sy >= height ) { sy = height - 1; }
+			row = tmp + sy*row_floats;
+			x = 0;
+			#if IMAGE_HELPER_SSE2
+			{
+				__m128 vw = _mm_set1_ps( w );
+				for( ; x + 4 <= row_floats; x += 4 )
+				{
+					_mm_storeu_ps( acc + x, _mm_add_ps( _mm_loadu_ps( acc + x ), _mm_mul_ps( vw, _mm_loadu_ps( row + x ) ) ) );
+				}
+			}
+			#endif
+			for( ; x < row_floats; ++x )
+			{
+				acc[x] += w * row[x];
+			}
+		}
+		for( x = 0; x < row_floats; ++x )
+		{
+			/*	Lanczos rings a little past [0,1], clamp on the way out	*/
+			out[x] = ((x % channels) < color_channels) ? linear_to_sRGB( acc[x] ) : unit_to_byte( acc[x] );
+		}
+		free( acc );
+	}
+	free( tmp );
+	free( h_taps ); free( h_storage );
+	free( v_taps ); free( v_storage );
+	return 1;
+}
+
 unsigned char clamp_byte( int x ) { return ( (x) < 0 ? (0) : ( (x) > 255 ? 255 : (x) ) ); }
 
 /*
@@ -57,6 +57,71 @@ int
 		int width, int height, int channels
 	);
 
+/**
+	Same results as up_scale_image, mipmap_image and
+	scale_image_RGB_to_NTSC_safe (bit for bit), but rows are
+	split across threads (when built with OpenMP) and the
+	common 4 channel case uses SSE2.
+**/
+int
+	up_scale_image_fast
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height
+	);
+
+int
+	mipmap_image_fast
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	);
+
+int
+	scale_image_RGB_to_NTSC_safe_fast
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	);
+
+/**
+	Gamma correct box filter: like mipmap_image, but the
+	colors are averaged in linear light (sRGB decoded first,
+	then encoded again), so detail doesn't darken as it
+	shrinks.  Alpha (channels 2 and 4) is averaged as is.
+	Library only: SOIL's own mipmaps use mipmap_image_fast,
+	and nothing in Fractal calls this.
+**/
+int
+	mipmap_image_sRGB
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	);
+
+/**
+	Resizes an image (up or down, any size) with a 3 lobe
+	Lanczos filter, separably, threaded and SSE2 where it
+	can be.  With sRGB != 0 the colors are filtered in
+	linear light.  Library only, like mipmap_image_sRGB.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	resize_image_Lanczos
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		int sRGB
+	);
+
 /**
 	This function takes the RGB components of the image
 	and converts them into YCoCg.  3 components will be
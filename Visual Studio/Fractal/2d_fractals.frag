@@ -7,11 +7,12 @@ precision mediump float;
  * 2D Fractal Shader Fragment Shader
  */
 
+#include "common.glsl"
+
 uniform int fractal; // Fractal type, 0 == Mandelbrot, 1 == OrbitTrap, 2 == Ducks
 
 uniform int maxIterations;// 50            // {"label":"Iterations", "min":1, "max":400, "step":1, "group_label":"2D parameters"}
-#define antialiasing 0.5
-uniform bool antialiasingOn;
+uniform float antialiasing;// 0.5            // sample spacing when antialiasingOn, 0.5 == 2x2 per pixel
 
 uniform float scale;                // {"label":"Scale",        "min":-10,  "max":10,   "step":0.1,     "default":2,    "group":"Fractal", "group_label":"Fractal parameters"}
 uniform float power;                // {"label":"Power",        "min":-20,  "max":20,   "step":0.001,     "default":2,    "group":"Fractal"}
@@ -34,8 +35,6 @@ uniform int   colorIterations;      // {"label":"Colour iterations", "default":
 uniform vec3  color1;               // {"label":"Colour 1",  "default":[1.0, 1.0, 1.0], "group":"Colour", "control":"color"}
 uniform vec3  color2;               // {"label":"Colour 2",  "default":[0, 0.53, 0.8], "group":"Colour", "control":"color"}
 uniform vec3  color3;               // {"label":"Inside/background colour",  "default":[0.0, 0.0, 0.0], "group":"Colour", "control":"color"}
-uniform bool  transparent;          // {"label":"Transparent background", "default":false, "group":"Colour"}
-uniform float gamma;                // {"label":"Gamma correction", "default":1, "min":0.1, "max":2, "step":0.01, "group":"Colour"}
 
 uniform bool  orbitTrap;            // {"label":"Orbit trap", "default":false, "group":"Image", "group_label":"Map images into fractal space"}
 uniform vec2  orbitTrapOffset;      // {"label":["Orbit offset x", "Orbit trap y"], "min":-3, "max":3, "default":[0, 0], "step":0.001, "group":"Image"}
@@ -48,11 +47,23 @@ uniform sampler2D texture;          // {"label":"Mapping image URL", "default":"
 
 uniform float rotation;             // {"label":"Rotation",         "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera", "group_label":"Camera parameters"}
 uniform vec3  cameraPosition;       // {"label":["Camera x", "Camera y", "Camera z"],   "default":[-0.5, 0, 2.5], "min":0, "max": 200, "step":0.0000001, "control":"camera", "group":"Camera"}
-uniform vec2  size;                 // {"default":[400, 300]}
-uniform vec2  outputSize;           // {"default":[800, 600]}
+
+// Mode specialisation: the loader #defines these to constants so each program only
+// contains the branches for one mode. Without the defines they fall back to the uniforms.
+#ifndef FRACTAL
+#define FRACTAL fractal
+#endif
+#ifndef COLOR_MODE
+#define COLOR_MODE colorMode
+#endif
+#ifndef BAILOUT_STYLE
+#define BAILOUT_STYLE bailoutStyle
+#endif
+#ifndef JULIA_MODE
+#define JULIA_MODE juliaMode
+#endif
 
 
-float aspectRatio = outputSize.x / outputSize.y;
 mat2  rotationMatrix;
 mat2  orbitRotation;
 mat2  orbitSpin;
@@ -190,16 +201,16 @@ float logPower = log(abs(power));
 bool bailoutLimit(vec2 z) {
     bool bailing = false;
     
-    if (bailoutStyle == 3 && (pow(z.x, 2.0) - pow(z.y, 2.0)) >= _bailout) {
+    if (BAILOUT_STYLE == 3 && (pow(z.x, 2.0) - pow(z.y, 2.0)) >= _bailout) {
         bailing = true;
         
-    } else if (bailoutStyle == 4 && (z.y * z.y - z.y * z.x) >= bailout) {
+    } else if (BAILOUT_STYLE == 4 && (z.y * z.y - z.y * z.x) >= bailout) {
         bailing = true;
         
-    } else if (bailoutStyle == 2 && (pow(z.y, 2.0) - pow(z.x, 2.0)) >= _bailout) {
+    } else if (BAILOUT_STYLE == 2 && (pow(z.y, 2.0) - pow(z.x, 2.0)) >= _bailout) {
         bailing = true;
         
-    } else if (bailoutStyle == 1 && (abs(z.x) > bailout || abs(z.y) > _bailout)) {
+    } else if (BAILOUT_STYLE == 1 && (abs(z.x) > bailout || abs(z.y) > _bailout)) {
         bailing = true;
         
     } else if (dot(z, z) >= _bailout) {
@@ -220,16 +231,16 @@ vec4 colorMapping(float n, vec2 z) {
         c2 = rgb2hsv(c2);
     }
     
-    if (colorMode == 3) {
+    if (COLOR_MODE == 3) {
         color = atan(z.y, z.x) > 0.0 ? c1 : c2;
         
-    } else if (colorMode == 4) {
+    } else if (COLOR_MODE == 4) {
         color = mod(n, 2.0) == 0.0 ? c1 : c2;
         
-    } else if (colorMode == 5) {
+    } else if (COLOR_MODE == 5) {
         color = (abs(z.x) < bailout / 2.0 || abs(z.y) < bailout / 2.0) ? c1 : c2;
         
-    } else if (colorMode == 6) {
+    } else if (COLOR_MODE == 6) {
         float v = 0.5 * sin(floor(colorScale) * complexArg(z)) + 0.5;
         color = mix(c1, c2, v);
          
@@ -238,12 +249,12 @@ vec4 colorMapping(float n, vec2 z) {
         float v0 = v;
         float vp, v1;
         
-        if (colorMode != 2) {
+        if (COLOR_MODE != 2) {
             // Smooth colouring
             vp = abs((log2Bailout - log(log(abs(length(z))))) / logPower);
             v1 = abs(1.0 - (n + 1.0) / float(maxIterations));
             
-            if (colorMode == 1) {
+            if (COLOR_MODE == 1) {
                 if (n == 0.0) {
                     v = v - (v - v1) * vp;
                 } else {
@@ -254,7 +265,7 @@ vec4 colorMapping(float n, vec2 z) {
             }
         }
         
-        if (colorMode == 2 && n == 0.0) v = 1.0;
+        if (COLOR_MODE == 2 && n == 0.0) v = 1.0;
         
         v = pow(v, colorScale);
         v *= colorCycle;
@@ -285,7 +296,7 @@ vec4 colorMapping(float n, vec2 z) {
 vec4 Mandelbrot(vec2 z) {
     vec4  color = vec4(color3, 1.0);
     float n = 0.0;
-    vec2  c = juliaMode ? offset : z;
+    vec2  c = bool(JULIA_MODE) ? offset : z;
     
     for (int i = 0; i < int(maxIterations); i++) {
         n += 1.0;
@@ -320,7 +331,7 @@ vec4 orbitMapping(vec4 c, vec2 w)
 vec4 OrbitTrap(vec2 z) {
     vec4  color = vec4(color3, 0.0);
     float n = 0.0;
-    vec2  c = juliaMode ? offset : z;
+    vec2  c = bool(JULIA_MODE) ? offset : z;
     
     for (int i = 0; i < int(maxIterations); i++) {
         n += 1.0;
@@ -346,7 +357,7 @@ vec4 OrbitTrap(vec2 z) {
 vec4 Ducks(vec2 z) {
     vec4  color = vec4(color3, 1.0);
     float n = 0.0;
-    vec2  c = juliaMode ? offset : z;
+    vec2  c = bool(JULIA_MODE) ? offset : z;
     float d = 0.0;
     float v;
     
@@ -388,9 +399,9 @@ vec4 render(vec2 pixel) {
     vec2  z = ((pixel - (size * 0.5)) / size) * vec2(aspectRatio, 1.0) * cameraPosition.z + cameraPosition.xy;
     z *= rotationMatrix;
     
-    if (fractal == 0) {
+    if (FRACTAL == 0) {
         return Mandelbrot(z);
-    } else if (fractal == 1) {
+    } else if (FRACTAL == 1) {
         return OrbitTrap(z);
     } else {
         return Ducks(z);
@@ -408,7 +419,7 @@ void main()
     float rs = sin(radians(rotation));
     rotationMatrix = mat2(rc, rs, -rs, rc);
     
-    if (fractal == 1) {
+    if (FRACTAL == 1) {
         float otrc = cos(radians(orbitTrapRotation));
         float otrs = sin(radians(orbitTrapRotation));
         orbitRotation = mat2(otrc, otrs, -otrs, otrc);
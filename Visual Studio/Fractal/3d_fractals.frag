@@ -6,11 +6,19 @@ precision highp float;
  * 3D fractal shader (HIGHLY EXPERIMENTAL)
  */
 
-#define HALFPI 1.570796
+#include "common.glsl"
+#include "3d_shading.glsl"
+
 #define MIN_EPSILON 6e-7
 #define MIN_NORM 1.5e-7
 uniform int type; // Type of fractal, currently [MengerSponge, SphereSponge, Mandelbulb, Mandelbox, OctahedralIFS, DodecahedronIFS]
 
+// The loader #defines TYPE to compile one program per fractal, so dE() below
+// collapses to a single call. Without it we fall back to the uniform.
+#ifndef TYPE
+#define TYPE type
+#endif
+
 uniform int maxIterations;// 8             // {"label":"Iterations", "min":1, "max":30, "step":1, "group_label":"Fractal parameters"}
 uniform int  stepLimit;// 60                // {"label":"Max steps", "min":10, "max":300, "step":1}
 
@@ -19,7 +27,6 @@ uniform int aoIterations;// 4              // {"label":"AO iterations", "min":0,
 #define minRange 6e-5
 #define bailout 4.0
 uniform float antialiasing;// 0.5            // {"label":"Anti-aliasing", "control":"bool", "default":false, "group_label":"Render quality"}
-uniform bool antialiasingOn;
 
 uniform float scale;                // {"label":"Scale",        "min":-10,  "max":10,   "step":0.01,     "default":2,    "group":"Fractal", "group_label":"Fractal parameters"}
 uniform float power;                // {"label":"Power",        "min":-20,  "max":20,   "step":0.1,     "default":8,    "group":"Fractal"}
@@ -29,66 +36,69 @@ uniform float boundingRadius;       // {"label":"Bounding radius", "min":0.1, "m
 uniform vec3  offset;               // {"label":["Offset x","Offset y","Offset z"],  "min":-3,   "max":3,    "step":0.01,    "default":[0,0,0],  "group":"Fractal", "group_label":"Offsets"}
 uniform vec3  shift;                // {"label":["Shift x","Shift y","Shift z"],  "min":-3,   "max":3,    "step":0.01,    "default":[0,0,0],  "group":"Fractal"}
 
-uniform float cameraRoll;           // {"label":"Roll",         "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera", "group_label":"Camera parameters"}
-uniform float cameraPitch;          // {"label":"Pitch",        "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera"}
-uniform float cameraYaw;            // {"label":"Yaw",          "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera"}
-uniform float cameraFocalLength;    // {"label":"Focal length", "min":0.1,  "max":3,    "step":0.01,    "default":0.9,  "group":"Camera"}
-uniform vec3  cameraPosition;       // {"label":["Camera x", "Camera y", "Camera z"],   "default":[0.0, 0.0, -2.5], "control":"camera", "group":"Camera", "group_label":"Position"}
-
 uniform int   colorIterations;      // {"label":"Colour iterations", "default": 4, "min":0, "max": 30, "step":1, "group":"Colour", "group_label":"Base colour"}
-uniform vec3  color1;               // {"label":"Colour 1",  "default":[1.0, 1.0, 1.0], "group":"Colour", "control":"color"}
-uniform float color1Intensity;      // {"label":"Colour 1 intensity", "default":0.45, "min":0, "max":3, "step":0.01, "group":"Colour"}
-uniform vec3  color2;               // {"label":"Colour 2",  "default":[0, 0.53, 0.8], "group":"Colour", "control":"color"}
-uniform float color2Intensity;      // {"label":"Colour 2 intensity", "default":0.3, "min":0, "max":3, "step":0.01, "group":"Colour"}
-uniform vec3  color3;               // {"label":"Colour 3",  "default":[1.0, 0.53, 0.0], "group":"Colour", "control":"color"}
-uniform float color3Intensity;      // {"label":"Colour 3 intensity", "default":0, "min":0, "max":3, "step":0.01, "group":"Colour"}
-uniform bool  transparent;          // {"label":"Transparent background", "default":false, "group":"Colour"}
-uniform float gamma;                // {"label":"Gamma correction", "default":1, "min":0.1, "max":2, "step":0.01, "group":"Colour"}
-
-uniform vec3  light;                // {"label":["Light x", "Light y", "Light z"], "default":[-16.0, 100.0, -60.0], "min":-300, "max":300,  "step":1,   "group":"Shading", "group_label":"Light position"}
-uniform vec2  ambientColor;         // {"label":["Ambient intensity", "Ambient colour"],  "default":[0.5, 0.3], "group":"Colour", "group_label":"Ambient light & background"}
-uniform vec3  background1Color;     // {"label":"Background top",   "default":[0.0, 0.46, 0.8], "group":"Colour", "control":"color"}
-uniform vec3  background2Color;     // {"label":"Background bottom", "default":[0, 0, 0], "group":"Colour", "control":"color"}
-uniform vec3  innerGlowColor;       // {"label":"Inner glow", "default":[0.0, 0.6, 0.8], "group":"Shading", "control":"color", "group_label":"Glows"}
-uniform float innerGlowIntensity;   // {"label":"Inner glow intensity", "default":0.1, "min":0, "max":1, "step":0.01, "group":"Shading"}
-uniform vec3  outerGlowColor;       // {"label":"Outer glow", "default":[1.0, 1.0, 1.0], "group":"Shading", "control":"color"}
-uniform float outerGlowIntensity;   // {"label":"Outer glow intensity", "default":0.0, "min":0, "max":1, "step":0.01, "group":"Shading"}
-uniform float fog;                  // {"label":"Fog intensity",          "min":0,    "max":1,    "step":0.01,    "default":0,    "group":"Shading", "group_label":"Fog"}
-uniform float fogFalloff;           // {"label":"Fog falloff",  "min":0,    "max":10,   "step":0.01,    "default":0,    "group":"Shading"}
-uniform float specularity;          // {"label":"Specularity",  "min":0,    "max":3,    "step":0.01,    "default":0.8,  "group":"Shading", "group_label":"Shininess"}
-uniform float specularExponent;     // {"label":"Specular exponent", "min":0, "max":50, "step":0.1,     "default":4,    "group":"Shading"}
-
-uniform vec2  size;                 // {"default":[400, 300]}
-uniform vec2  outputSize;           // {"default":[800, 600]}
-uniform float aoIntensity;          // {"label":"AO intensity",     "min":0, "max":1, "step":0.01, "default":0.15,  "group":"Shading", "group_label":"Ambient occlusion"}
 uniform float aoSpread;             // {"label":"AO spread",    "min":0, "max":20, "step":0.01, "default":9,  "group":"Shading"}
 
 uniform mat3  objectRotation;       // {"label":["Rotate x", "Rotate y", "Rotate z"], "group":"Fractal", "control":"rotation", "default":[0,0,0], "min":-360, "max":360, "step":1, "group_label":"Object rotation"}
 uniform mat3  fractalRotation1;     // {"label":["Rotate x", "Rotate y", "Rotate z"], "group":"Fractal", "control":"rotation", "default":[0,0,0], "min":-360, "max":360, "step":1, "group_label":"Fractal rotation 1"}
 uniform mat3  fractalRotation2;     // {"label":["Rotate x", "Rotate y", "Rotate z"], "group":"Fractal", "control":"rotation", "default":[0,0,0], "min":-360, "max":360, "step":1, "group_label":"Fractal rotation 2"}
-uniform bool  depthMap;             // {"label":"Depth map", "default": false, "value":1, "group":"Shading"}
+
+// Cone pre-pass: drawn first at 1/CONE_BLOCK of the size, it finds how far every ray of
+// each CONE_BLOCK x CONE_BLOCK block can safely skip, so the full pass starts near the surface
+#define CONE_BLOCK 8.0              // keep in step with CONE_BLOCK in raymarch.h
+uniform bool  conePass;             // this draw is the pre-pass, one fragment per block
+uniform bool  coneMapOn;            // start the rays from coneMap
+uniform sampler2D coneMap;          // x = safe start distance, y = steps the cone took
+vec2  coneStart = vec2(0.0);
+
+// Reprojection: while the camera moves, the last frame's hit distances are splatted into the
+// new view (reproject.vs) and each ray starts a safety margin short of its predicted hit.
+// Pixels nothing landed on (just disoccluded, or a miss last frame) march in full.
+#define REPROJECT_MARGIN 0.05       // start this fraction of the predicted distance early
+#define REPROJECT_UNKNOWN 1e20      // reprojectMap is cleared above this, no prediction
+uniform bool  reprojectOn;          // start the rays from reprojectMap
+uniform sampler2D reprojectMap;     // x = predicted hit distance, y = the steps that glowed there
+uniform vec2  reprojectSize;        // its size in pixels, the viewport of this pass
+vec2  reprojectStart = vec2(0.0);
+// Low resolution AO: with aoResolution > 1 the march leaves the occlusion at 0 (aoSkip) and the AO pass,
+// drawn at 1/aoResolution of the size, works it out for one pixel of each block from the G-buffer just
+// marched. 3d_shade.frag scales it back up, following the edges in the depth and normals.
+uniform bool  aoPass;               // this draw is the AO pass, one fragment per block: x = occlusion, y = that pixel's hit distance
+uniform bool  aoSkip;               // the AO pass will do the occlusion
+uniform sampler2D hits;             // the G-buffer the AO pass reads, as 3d_shade.frag names it
+uniform sampler2D surfaces;
+
+// Accumulation: while the camera stays still Fractals.cpp adds a frame at a time up and shows the mean.
+// Each frame is one sample per pixel, its ray somewhere inside the pixel, its AO probes tilted at random
+// and the light moved a little (lightJitter), so the sum converges on soft lighting, AO and antialiasing.
+#define AO_CONE 0.5                 // how far an accumulated sample tilts its AO probes off the normal
+uniform bool  accumulate;           // one sample per pixel, linear (no gamma): antialiasing comes from the jitter
+uniform vec2  jitter;               // this sample's ray, from the pixel's centre
+uniform float sampleSeed;           // this sample's number, picks its AO probes
+
+vec2  hitLength = vec2(0.0);        // set by render(): distance to the surface (0 on a miss), steps for the glow
+vec4  hitSurface = vec4(0.0);       // and the rest of its G-buffer texel: normal, occlusion
+vec2  hitOrbit = vec2(0.0);         // dE()'s orbit values at the hit
+
+// Baked distance grid (raygrid.cpp): dE() sampled once over the bounding cube, coarse everywhere
+// plus a brick of finer samples in each cell near the surface, rebaked when the fractal changes.
+// Rays step by its lower bound (two texture reads) and call dE() only within gridExact of the surface.
+#define GRID_CELLS 32.0             // keep in step with GRID_CELLS and BRICK_SIZE in raymarch.h
+#define BRICK_SIZE 8.0
+uniform bool  gridOn;               // a grid for the current parameters is uploaded
+uniform sampler3D gridCoarse;       // dE() at the (GRID_CELLS + 1)^3 cell corners
+uniform sampler3D gridIndex;        // per cell: its brick's place in gridBricks, x < 0 for none
+uniform sampler3D gridBricks;       // BRICK_SIZE^3 samples per brick
+uniform vec3  gridAtlas;            // gridBricks' size in bricks
+uniform float gridRadius;           // half the cube's side
+uniform float gridExact;            // below this the grid hands over to dE()
 
 
-float aspectRatio = outputSize.x / outputSize.y;
 float fovfactor = 1.0 / sqrt(1.0 + cameraFocalLength * cameraFocalLength);
 float pixelScale = 1.0 / min(outputSize.x, outputSize.y);
 float epsfactor = 2.0 * fovfactor * pixelScale * surfaceDetail;
-vec3  w = vec3(0, 0, 1);
-vec3  v = vec3(0, 1, 0);
-vec3  u = vec3(1, 0, 0);
-mat3  cameraRotation;
 
 
-// Return rotation matrix for rotating around vector v by angle
-mat3 rotationMatrixVector(vec3 v, float angle)
-{
-    float c = cos(radians(angle));
-    float s = sin(radians(angle));
-    
-    return mat3(c + (1.0 - c) * v.x * v.x, (1.0 - c) * v.x * v.y - s * v.z, (1.0 - c) * v.x * v.z + s * v.y,
-              (1.0 - c) * v.x * v.y + s * v.z, c + (1.0 - c) * v.y * v.y, (1.0 - c) * v.y * v.z - s * v.x,
-              (1.0 - c) * v.x * v.z - s * v.y, (1.0 - c) * v.y * v.z + s * v.x, c + (1.0 - c) * v.z * v.z);
-}
 
 uniform float sphereHoles;          // {"label":"Holes",        "min":3,    "max":6,    "step":0.01,    "default":4,    "group":"Fractal", "group_label":"Additional parameters"}
 uniform float sphereScale;          // {"label":"Sphere scale", "min":0.01, "max":3,    "step":0.01,    "default":2.05,    "group":"Fractal"}
@@ -199,9 +209,7 @@ uniform float phi;  // {"label":"Phi", "min":0.1, "max":3, "step":0.01, "default
 // The normal vectors for the dodecahedra-siepinski folding planes are:
 // (phi^2, 1, -phi), (-phi, phi^2, 1), (1, -phi, phi^2), (-phi*(1+phi), phi^2-1, 1+phi), (1+phi, -phi*(1+phi), phi^2-1) and x=0, y=0, z=0 planes.
 
-// Pre-calculations
-vec3 scale_offset = offset * (scale - 1.0);
-
+// Pre-calculations (scale_offset is shared with OctahedralIFS)
 float _IKVNORM_ = 1.0 / sqrt(pow(phi * (1.0 + phi), 2.0) + pow(phi * phi - 1.0, 2.0) + pow(1.0 + phi, 2.0));
 float _C1_ = phi * (1.0 + phi) * _IKVNORM_;
 float _C2_ = (phi * phi - 1.0) * _IKVNORM_;
@@ -252,7 +260,7 @@ vec3 DodecahedronIFS(vec3 w)
     return vec3((length(w) - 2.0) * pow(scale, -float(maxIterations)), md, cd);
 }
 
-uniform float sphereScale;          // {"label":"Sphere scale", "min":0.01, "max":3,    "step":0.01,    "default":1,    "group":"Fractal", "group_label":"Additional parameters"}
+// sphereScale is shared with SphereSponge (Mandelbox default is 1)
 uniform float boxScale;             // {"label":"Box scale",    "min":0.01, "max":3,    "step":0.001,   "default":0.5,  "group":"Fractal"}
 uniform float boxFold;              // {"label":"Box fold",     "min":0.01, "max":3,    "step":0.001,   "default":1,    "group":"Fractal"}
 uniform float fudgeFactor;          // {"label":"Box size fudge factor",     "min":0, "max":100,    "step":0.001,   "default":0,    "group":"Fractal"}
@@ -377,18 +385,27 @@ vec3 Mandelbulb(vec3 w)
     return vec3(0.5 * log(r) * r / dr, md, 0.33 * log(dot(d, d)) + 1.0);
 }
 
-// Define the ray direction from the pixel coordinates
-vec3 rayDirection(vec2 pixel)
+// Distance estimate for the selected fractal: x = distance, y and z = orbit values for colouring
+vec3 dE(vec3 w)
 {
-    vec2 p = (0.5 * size - pixel) / vec2(size.x, -size.y);
-    p.x *= aspectRatio;
-    vec3 d = (p.x * u + p.y * v - cameraFocalLength * w);
-    
-    return normalize(cameraRotation * d);
+    if (TYPE == 0) {
+        return MengerSponge(w);
+    } else if (TYPE == 1) {
+        return SphereSponge(w);
+    } else if (TYPE == 2) {
+        return Mandelbulb(w);
+    } else if (TYPE == 3) {
+        return Mandelbox(w);
+    } else if (TYPE == 4) {
+        return OctahedralIFS(w);
+    } else {
+        return DodecahedronIFS(w);
+    }
 }
 
 
 
+
 // Intersect bounding sphere
 //
 // If we intersect then set the tmin and tmax values to set the start and
@@ -431,7 +448,7 @@ bool intersectBoundingSphere(vec3 origin,
 vec3 generateNormal(vec3 z, float d)
 {
     float e = max(d * 0.5, MIN_NORM);
-    /** TODO: Rewrite old dE version to use new uniforms!
+    
     float dx1 = dE(z + vec3(e, 0, 0)).x;
     float dx2 = dE(z - vec3(e, 0, 0)).x;
     
@@ -440,43 +457,98 @@ vec3 generateNormal(vec3 z, float d)
     
     float dz1 = dE(z + vec3(0, 0, e)).x;
     float dz2 = dE(z - vec3(0, 0, e)).x;
-    */
-    //return normalize(vec3(dx1 - dx2, dy1 - dy2, dz1 - dz2));
+    
+    return normalize(vec3(dx1 - dx2, dy1 - dy2, dz1 - dz2));
 }
 
 
-// Blinn phong shading model
-// base color, incident, point of intersection, normal
-vec3 blinnPhong(vec3 color, vec3 p, vec3 n)
-{
-    // Ambient colour based on background gradient
-    vec3 ambColor = clamp(mix(background2Color, background1Color, (sin(n.y * HALFPI) + 1.0) * 0.5), 0.0, 1.0);
-    ambColor = mix(vec3(ambientColor.x), ambColor, ambientColor.y);
-    
-    vec3  halfLV = normalize(light - p);
-    float diffuse = max(dot(n, halfLV), 0.0);
-    float specular = pow(diffuse, specularExponent);
-    
-    return ambColor * color + color * diffuse + specular * specularity;
-}
 
 
 
-// Ambient occlusion approximation.
+// A different number in [0, 1) for every pixel, sample and k
+float random(float k)
+{
+    return fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233)) + sampleSeed * 7.31 + k * 1.73) * 43758.5453);
+}
+
+// Ambient occlusion approximation: how much the surface closes in around p, shade() takes
+// aoIntensity of it off the colour (so that can change without marching again)
 float ambientOcclusion(vec3 p, vec3 n, float eps)
 {
-    float o = 1.0;                  // Start at full output colour intensity
+    float o = 0.0;                  // Start with nothing in the way
     eps *= aoSpread;                // Spread diffuses the effect
-    float k = aoIntensity / eps;    // Set intensity factor
+    float k = 1.0 / eps;            // Set intensity factor
     float d = 2.0 * eps;            // Start ray a little off the surface
     
+    if (accumulate) {               // Other probes every sample, they average out over a cone round n
+        n = normalize(n + (vec3(random(1.0), random(2.0), random(3.0)) * 2.0 - 1.0) * AO_CONE);
+        d *= 0.5 + random(4.0);
+    }
+    
     for (int i = 0; i < aoIterations; ++i) {
-        o -= (d - dE(p + n * d).x) * k; // TODO: fix dE
+        o += (d - dE(p + n * d).x) * k;
         d += eps;
         k *= 0.5;                   // AO contribution drops as we move further from the surface 
     }
     
-    return clamp(o, 0.0, 1.0);
+    return o;
+}
+
+
+// How far a ray at p going direction d can safely step, from the grid: 0 outside the cube, or
+// near the surface where only dE() will do. Through a cell with no surface in it the ray can go
+// straight to its far side (exits), a cone can't. The bound is DistanceGrid::distance() on the CPU
+float gridStep(vec3 p, vec3 d, bool exits)
+{
+    vec3 g = (p / gridRadius * 0.5 + 0.5) * GRID_CELLS;
+    if (any(lessThan(g, vec3(0.0))) || any(greaterThanEqual(g, vec3(GRID_CELLS)))) return 0.0;
+    vec3 cell = floor(g);
+    vec3 f = g - cell;
+    vec3 brick = texture3D(gridIndex, (cell + 0.5) / GRID_CELLS).xyz;
+    float cellSize = 2.0 * gridRadius / GRID_CELLS;
+    float bound;
+    
+    // Trilinear filtering, less how far the samples' weighted average is from p: dE() moves by at
+    // most the distance moved, and sum(w |p - c|) <= h sqrt(sum(f (1 - f))), 0 on a sample
+    if (brick.x < 0.0) { // no surface anywhere in the cell: at least as far as its far side
+        bound = texture3D(gridCoarse, (g + 0.5) / (GRID_CELLS + 1.0)).x - cellSize * sqrt(dot(f * (1.0 - f), vec3(1.0)));
+        if (!exits) return bound > gridExact ? bound * surfaceSmoothness : 0.0;
+        vec3 faces = ((cell + step(0.0, d)) * cellSize - gridRadius - p) / d; // to each axis' exit face
+        return max(bound * surfaceSmoothness, min(min(faces.x, faces.y), faces.z) + cellSize * 0.001);
+    }
+    vec3 texel = brick * BRICK_SIZE + 0.5 + f * (BRICK_SIZE - 1.0);
+    f = fract(f * (BRICK_SIZE - 1.0));
+    bound = texture3D(gridBricks, texel / (gridAtlas * BRICK_SIZE)).x - cellSize / (BRICK_SIZE - 1.0) * sqrt(dot(f * (1.0 - f), vec3(1.0)));
+    return bound > gridExact ? bound * surfaceSmoothness : 0.0;
+}
+
+
+// March the axis of the cone through one block. Every ray of the block stays within
+// t * spread of the axis, so a step of dE - t * spread is empty space for all of them
+vec2 coneMarch(vec2 block)
+{
+    vec2  lo = block * CONE_BLOCK;
+    vec2  hi = lo + CONE_BLOCK;
+    vec3  axis = rayDirection((lo + hi) * 0.5);
+    float spread = max(max(length(rayDirection(lo) - axis), length(rayDirection(hi) - axis)),
+                       max(length(rayDirection(vec2(lo.x, hi.y)) - axis), length(rayDirection(vec2(hi.x, lo.y)) - axis)));
+    float t = minRange;
+    float tmin, tmax;
+    int   steps = 0;
+
+    // Outside the bounding sphere the rays of the block may still hit it, so nothing is skipped
+    if (!intersectBoundingSphere(cameraPosition + t * axis, axis, tmin, tmax)) return vec2(0.0);
+
+    for (int i = 0; i < stepLimit; i++) {
+        vec3  p = cameraPosition + t * axis;
+        float skip = gridOn ? gridStep(p, axis, false) : 0.0;
+        float d = (skip > 0.0 ? skip : dE(p).x * surfaceSmoothness) - t * spread;
+        if (d < t * epsfactor || t > tmax) break;
+        t += d;
+        steps = i + 1;
+    }
+
+    return vec2(t, float(steps));
 }
 
 
@@ -486,8 +558,6 @@ vec4 render(vec2 pixel)
     vec3  ray_direction = rayDirection(pixel);
     float ray_length = minRange;
     vec3  ray = cameraPosition + ray_length * ray_direction;
-    vec4  bg_color = vec4(clamp(mix(background2Color, background1Color, (sin(ray_direction.y * HALFPI) + 1.0) * 0.5), 0.0, 1.0), 1.0);
-    vec4  color = bg_color;
     
     float eps = MIN_EPSILON;
     vec3  dist;
@@ -498,12 +568,18 @@ vec4 render(vec2 pixel)
     float tmax = 10000.0;
     
     if (intersectBoundingSphere(ray, ray_direction, tmin, tmax)) {
-        ray_length = tmin;
+        ray_length = max(max(tmin, coneStart.x), reprojectStart.x);
         ray = cameraPosition + ray_length * ray_direction;
         
         for (int i = 0; i < stepLimit; i++) {
             steps = i;
-            dist = dE(ray);//TODO: fix dE (maybe a function pointer?)
+            float skip = gridOn && !hit ? gridStep(ray, ray_direction, true) : 0.0;
+            if (skip > 0.0 && ray_length <= tmax) { // empty space by the grid, never a hit: dE() takes over first
+                ray_length += skip;
+                ray = cameraPosition + ray_length * ray_direction;
+                continue;
+            }
+            dist = dE(ray);
             dist.x *= surfaceSmoothness;
             
             // If we hit the surface on the previous step check again to make sure it wasn't
@@ -525,40 +601,35 @@ vec4 render(vec2 pixel)
     }
     
     // Found intersection?
-    float glowAmount = float(steps)/float(stepLimit);
-    float glow;
+    float glowSteps = max(float(steps) + coneStart.y, reprojectStart.y); // the cone's steps glow like the ray's own, a reprojected ray like the one it follows
+    float occlusion = 0.0;
     
     if (hit) {
-        float aof = 1.0, shadows = 1.0;
-        glow = clamp(glowAmount * innerGlowIntensity * 3.0, 0.0, 1.0);
-
         if (steps < 1 || ray_length < tmin) {
             normal = normalize(ray);
         } else {
             normal = generateNormal(ray, eps);
-            aof = ambientOcclusion(ray, normal, eps);
+            if (!aoSkip) occlusion = ambientOcclusion(ray, normal, eps);
         }
-        
-        color.rgb = mix(color1, mix(color2, color3, dist.y * color2Intensity), dist.z * color3Intensity);
-        color.rgb = blinnPhong(clamp(color.rgb * color1Intensity, 0.0, 1.0), ray, normal);
-        color.rgb *= aof;
-        color.rgb = mix(color.rgb, innerGlowColor, glow);
-        color.rgb = mix(bg_color.rgb, color.rgb, exp(-pow(ray_length * exp(fogFalloff), 2.0) * fog));
-        color.a = 1.0;
-    } else {
-        // Apply outer glow and fog
-        ray_length = tmax;
-        color.rgb = mix(bg_color.rgb, color.rgb, exp(-pow(ray_length * exp(fogFalloff), 2.0)) * fog);
-        glow = clamp(glowAmount * outerGlowIntensity * 3.0, 0.0, 1.0);
-        color.rgb = mix(color.rgb, outerGlowColor, glow);
-        if (transparent) color = vec4(0.0);
     }
     
-    // if (depthMap) {
-    //     color.rgb = vec3(ray_length / 10.0);
-    // }
+    hitLength = vec2(hit ? ray_length : 0.0, glowSteps);
+    hitSurface = vec4(normal, occlusion);
+    hitOrbit = hit ? dist.yz : vec2(0.0);
+    
+    return shade(ray_direction, hit, ray_length, normal, hitOrbit, glowSteps / float(stepLimit), occlusion);
+}
+
+// The AO pass: block's pixel found again from its hit distance, no marching
+vec2 blockOcclusion(vec2 block)
+{
+    vec2  pixel = aoPixel(block);
+    vec4  h = texture2D(hits, pixel / size);
+    if (h.x <= 0.0) return vec2(0.0); // a miss, nothing to occlude
     
-    return color;
+    vec3  normal = texture2D(surfaces, pixel / size).xyz;
+    float eps = h.x * epsfactor; // as the march had it when it stopped
+    return vec2(ambientOcclusion(cameraPosition + h.x * rayDirection(pixel), normal, eps), h.x);
 }
 
 // The main loop
@@ -567,22 +638,56 @@ void main()
     vec4 color = vec4(0.0);
     float n = 0.0;
     
-    cameraRotation = rotationMatrixVector(v, 180.0 - cameraYaw) * rotationMatrixVector(u, -cameraPitch) * rotationMatrixVector(w, cameraRoll);
+    aimCamera();
     
+    if (conePass) {
+        gl_FragData[0] = vec4(coneMarch(floor(gl_FragCoord.xy)), 0.0, 1.0);
+        return;
+    }
+    if (aoPass) {
+        gl_FragData[0] = vec4(blockOcclusion(floor(gl_FragCoord.xy)), 0.0, 1.0);
+        return;
+    }
+    if (coneMapOn) {
+        vec2 blocks = ceil(size / CONE_BLOCK);
+        vec2 block = floor(gl_FragCoord.xy / CONE_BLOCK);
+        if (block.x < blocks.x && block.y < blocks.y) { // past the edge of the map nothing is known
+            coneStart = texture2D(coneMap, (block + 0.5) / blocks).xy;
+        }
+    }
+    if (reprojectOn) {
+        vec2 guess = texture2D(reprojectMap, gl_FragCoord.xy / reprojectSize).xy;
+        if (guess.x < REPROJECT_UNKNOWN) reprojectStart = vec2(guess.x * (1.0 - REPROJECT_MARGIN), guess.y);
+    }
+    vec2  nearest = vec2(0.0); // hit distance for the next frame's reprojection (0 if any sample missed), and its glow
+    bool  missed = false;
     
-    if (antialiasingOn) {
+    if (accumulate) {
+        color = render(gl_FragCoord.xy + jitter);
+        nearest = hitLength;
+    }
+    else if (antialiasingOn) {
         for (float x = 0.0; x < 1.0; x += float(antialiasing)) {
             for (float y = 0.0; y < 1.0; y += float(antialiasing)) {
                 color += render(gl_FragCoord.xy + vec2(x, y));
                 n += 1.0;
+                missed = missed || hitLength.x == 0.0;
+                nearest = vec2(nearest.x == 0.0 ? hitLength.x : min(nearest.x, hitLength.x), nearest.y + hitLength.y);
             }
         }
-    color /= n;
+        color /= n;
+        nearest.y /= n;
+    }
     else {
         color = render(gl_FragCoord.xy);
+        nearest = hitLength;
     }
     
     if (color.a < 0.00392) discard; // Less than 1/255
     
-    gl_FragColor = vec4(pow(color.rgb, vec3(1.0 / gamma)), color.a);
+    gl_FragData[0] = accumulate ? color : vec4(pow(color.rgb, vec3(1.0 / gamma)), color.a); // gamma after the mean
+    // The G-buffer, only kept when the target has one: reprojection starts from the distances, 3d_shade.frag
+    // relights the lot (antialiased it holds the last sample's surface, but then nothing is relit)
+    gl_FragData[1] = vec4(missed ? 0.0 : nearest.x, nearest.y, hitOrbit);
+    gl_FragData[2] = hitSurface;
 }
@@ -0,0 +1,85 @@
+#ifdef GL_ES
+precision highp float;
+#endif
+
+/**
+ * 3D relighting pass: the last march's G-buffer shaded again, for when only the lighting,
+ * colours, glow or fog changed. One texel per pixel and no dE() at all, so it redraws in
+ * a fraction of the march's time. It can show the G-buffer itself too. With aoResolution > 1
+ * every 3D picture comes through here, to scale the AO pass' occlusion back up.
+ */
+
+#include "common.glsl"
+#include "3d_shading.glsl"
+
+uniform int   stepLimit;            // the march's, glow is steps over it
+uniform sampler2D hits;             // hit distance (0 == missed), glow steps, dE()'s orbit values
+uniform sampler2D surfaces;         // normal, occlusion
+uniform int   gbufferView;          // 0 the picture, 1 depth, 2 normals, 3 glow steps, 4 occlusion
+uniform bool  aoMapOn;              // the occlusion is in aoMap rather than surfaces.w
+uniform sampler2D aoMap;            // the AO pass: occlusion and hit distance of one pixel per aoResolution x aoResolution block
+
+#define AO_NORMAL_POWER 8.0         // how quickly a block stops counting as its normal turns away from the pixel's
+
+// Joint bilateral upsampling of the AO pass: the four blocks around the pixel, bilinear weights times
+// how close each block's pixel is in depth (aoDepthTolerance) and facing. Where none of them
+// is on the same surface (a thin edge between blocks) the closest one in depth is used as it is.
+float blockOcclusion(vec2 pixel, float depth, vec3 normal)
+{
+    float s = float(aoResolution);
+    vec2  blocks = ceil(size / s);
+    vec2  at = (pixel - floor(s * 0.5) - 0.5) / s; // in blocks, their pixels at whole numbers
+    vec2  base = floor(at);
+    vec2  f = at - base;
+    float sum = 0.0;
+    float weights = 0.0;
+    float nearest = 0.0;
+    float gap = 1e20;
+    
+    for (int i = 0; i < 4; i++) {
+        vec2  corner = vec2(mod(float(i), 2.0), floor(float(i) * 0.5));
+        vec2  block = clamp(base + corner, vec2(0.0), blocks - 1.0);
+        vec2  o = texture2D(aoMap, (block + 0.5) / blocks).xy;
+        if (o.y <= 0.0) continue; // its pixel missed, it knows nothing about this surface
+        
+        vec3  n = texture2D(surfaces, aoPixel(block) / size).xyz;
+        vec2  b = mix(1.0 - f, f, corner);
+        float d = abs(o.y - depth) / (depth * aoDepthTolerance);
+        float weight = b.x * b.y * pow(max(dot(n, normal), 0.0), AO_NORMAL_POWER) / (1.0 + d * d);
+        sum += o.x * weight;
+        weights += weight;
+        if (d < gap) {
+            gap = d;
+            nearest = o.x;
+        }
+    }
+    return weights > 1e-4 ? sum / weights : nearest;
+}
+
+void main()
+{
+    vec2  texel = gl_FragCoord.xy / size; // the G-buffer is this pass' size, one texel per pixel
+    vec4  h = texture2D(hits, texel);
+    vec4  s = texture2D(surfaces, texel);
+    bool  hit = h.x > 0.0;
+    vec4  color;
+    
+    aimCamera();
+    if (aoMapOn && hit) s.w = blockOcclusion(gl_FragCoord.xy, h.x, s.xyz);
+    
+    if (gbufferView == 1) {
+        color = vec4(vec3(h.x / 10.0), 1.0); // what the depthMap switch used to show
+    } else if (gbufferView == 2) {
+        color = vec4(hit ? s.xyz * 0.5 + 0.5 : vec3(0.0), 1.0);
+    } else if (gbufferView == 3) {
+        color = vec4(vec3(h.y / float(stepLimit)), 1.0);
+    } else if (gbufferView == 4) {
+        color = vec4(vec3(hit ? clamp(1.0 - s.w * aoIntensity, 0.0, 1.0) : 0.0), 1.0); // as shade() takes it off the colour
+    } else {
+        color = shade(rayDirection(gl_FragCoord.xy), hit, h.x, s.xyz, h.zw, h.y / float(stepLimit), s.w);
+        if (color.a < 0.00392) discard; // Less than 1/255
+        color.rgb = pow(color.rgb, vec3(1.0 / gamma));
+    }
+    
+    gl_FragColor = color;
+}
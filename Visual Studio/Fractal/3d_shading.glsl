@@ -0,0 +1,131 @@
+/**
+ * Camera and lighting of the 3D fractals, shared by the march (3d_fractals.frag) and the pass that
+ * relights its G-buffer (3d_shade.frag). Everything the colour of a hit depends on once the ray has
+ * stopped is here, so changing any of it never needs the march again.
+ */
+
+#define HALFPI 1.570796
+
+uniform float cameraRoll;           // {"label":"Roll",         "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera", "group_label":"Camera parameters"}
+uniform float cameraPitch;          // {"label":"Pitch",        "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera"}
+uniform float cameraYaw;            // {"label":"Yaw",          "min":-180, "max":180,  "step":0.5,     "default":0,    "group":"Camera"}
+uniform float cameraFocalLength;    // {"label":"Focal length", "min":0.1,  "max":3,    "step":0.01,    "default":0.9,  "group":"Camera"}
+uniform vec3  cameraPosition;       // {"label":["Camera x", "Camera y", "Camera z"],   "default":[0.0, 0.0, -2.5], "control":"camera", "group":"Camera", "group_label":"Position"}
+
+uniform vec3  color1;               // {"label":"Colour 1",  "default":[1.0, 1.0, 1.0], "group":"Colour", "control":"color"}
+uniform float color1Intensity;      // {"label":"Colour 1 intensity", "default":0.45, "min":0, "max":3, "step":0.01, "group":"Colour"}
+uniform vec3  color2;               // {"label":"Colour 2",  "default":[0, 0.53, 0.8], "group":"Colour", "control":"color"}
+uniform float color2Intensity;      // {"label":"Colour 2 intensity", "default":0.3, "min":0, "max":3, "step":0.01, "group":"Colour"}
+uniform vec3  color3;               // {"label":"Colour 3",  "default":[1.0, 0.53, 0.0], "group":"Colour", "control":"color"}
+uniform float color3Intensity;      // {"label":"Colour 3 intensity", "default":0, "min":0, "max":3, "step":0.01, "group":"Colour"}
+
+uniform vec3  light;                // {"label":["Light x", "Light y", "Light z"], "default":[-16.0, 100.0, -60.0], "min":-300, "max":300,  "step":1,   "group":"Shading", "group_label":"Light position"}
+uniform vec2  ambientColor;         // {"label":["Ambient intensity", "Ambient colour"],  "default":[0.5, 0.3], "group":"Colour", "group_label":"Ambient light & background"}
+uniform vec3  background1Color;     // {"label":"Background top",   "default":[0.0, 0.46, 0.8], "group":"Colour", "control":"color"}
+uniform vec3  background2Color;     // {"label":"Background bottom", "default":[0, 0, 0], "group":"Colour", "control":"color"}
+uniform vec3  innerGlowColor;       // {"label":"Inner glow", "default":[0.0, 0.6, 0.8], "group":"Shading", "control":"color", "group_label":"Glows"}
+uniform float innerGlowIntensity;   // {"label":"Inner glow intensity", "default":0.1, "min":0, "max":1, "step":0.01, "group":"Shading"}
+uniform vec3  outerGlowColor;       // {"label":"Outer glow", "default":[1.0, 1.0, 1.0], "group":"Shading", "control":"color"}
+uniform float outerGlowIntensity;   // {"label":"Outer glow intensity", "default":0.0, "min":0, "max":1, "step":0.01, "group":"Shading"}
+uniform float fog;                  // {"label":"Fog intensity",          "min":0,    "max":1,    "step":0.01,    "default":0,    "group":"Shading", "group_label":"Fog"}
+uniform float fogFalloff;           // {"label":"Fog falloff",  "min":0,    "max":10,   "step":0.01,    "default":0,    "group":"Shading"}
+uniform float specularity;          // {"label":"Specularity",  "min":0,    "max":3,    "step":0.01,    "default":0.8,  "group":"Shading", "group_label":"Shininess"}
+uniform float specularExponent;     // {"label":"Specular exponent", "min":0, "max":50, "step":0.1,     "default":4,    "group":"Shading"}
+
+uniform float aoIntensity;          // {"label":"AO intensity",     "min":0, "max":1, "step":0.01, "default":0.15,  "group":"Shading", "group_label":"Ambient occlusion"}
+uniform int   aoResolution;         // {"label":"AO resolution", "min":1, "max":4, "step":1, "default":1, "group":"Shading"} 1 works it out per pixel in the march, 2 or 4 once per block in a pass of its own
+uniform vec3  lightJitter;          // where this sample's light is, off light: a point in a ball round it, so accumulated samples see a soft, round light
+uniform float aoDepthTolerance;     // {"label":"AO edge tolerance", "min":0.001, "max":1, "step":0.001, "default":0.02, "group":"Shading"} how far a block's depth may be off, as a fraction of the pixel's, before its occlusion stops counting
+
+vec3  w = vec3(0, 0, 1);
+vec3  v = vec3(0, 1, 0);
+vec3  u = vec3(1, 0, 0);
+mat3  cameraRotation;
+
+
+// The pixel (its centre) that stands for block's aoResolution x aoResolution pixels in the AO pass.
+// The last row and column of blocks hang off the image when size isn't a multiple of aoResolution,
+// so theirs is kept to the edge pixel.
+vec2 aoPixel(vec2 block)
+{
+    return min(block * float(aoResolution) + floor(float(aoResolution) * 0.5) + 0.5, size - 0.5);
+}
+
+// Return rotation matrix for rotating around vector v by angle
+mat3 rotationMatrixVector(vec3 v, float angle)
+{
+    float c = cos(radians(angle));
+    float s = sin(radians(angle));
+    
+    return mat3(c + (1.0 - c) * v.x * v.x, (1.0 - c) * v.x * v.y - s * v.z, (1.0 - c) * v.x * v.z + s * v.y,
+              (1.0 - c) * v.x * v.y + s * v.z, c + (1.0 - c) * v.y * v.y, (1.0 - c) * v.y * v.z - s * v.x,
+              (1.0 - c) * v.x * v.z - s * v.y, (1.0 - c) * v.y * v.z + s * v.x, c + (1.0 - c) * v.z * v.z);
+}
+
+// Point the camera, before the first rayDirection()
+void aimCamera()
+{
+    cameraRotation = rotationMatrixVector(v, 180.0 - cameraYaw) * rotationMatrixVector(u, -cameraPitch) * rotationMatrixVector(w, cameraRoll);
+}
+
+// Define the ray direction from the pixel coordinates
+vec3 rayDirection(vec2 pixel)
+{
+    vec2 p = (0.5 * size - pixel) / vec2(size.x, -size.y);
+    p.x *= aspectRatio;
+    vec3 d = (p.x * u + p.y * v - cameraFocalLength * w);
+    
+    return normalize(cameraRotation * d);
+}
+
+// Background gradient seen along a direction
+vec3 background(vec3 d)
+{
+    return clamp(mix(background2Color, background1Color, (sin(d.y * HALFPI) + 1.0) * 0.5), 0.0, 1.0);
+}
+
+
+// Blinn phong shading model
+// base color, incident, point of intersection, normal
+vec3 blinnPhong(vec3 color, vec3 p, vec3 n)
+{
+    // Ambient colour based on background gradient
+    vec3 ambColor = background(n);
+    ambColor = mix(vec3(ambientColor.x), ambColor, ambientColor.y);
+    
+    vec3  halfLV = normalize(light + lightJitter - p);
+    float diffuse = max(dot(n, halfLV), 0.0);
+    float specular = pow(diffuse, specularExponent);
+    
+    return ambColor * color + color * diffuse + specular * specularity;
+}
+
+
+// The colour for a ray: whether it hit and how far along, the normal there, dE()'s orbit values
+// (dist.y and dist.z), its glow (steps over the step limit) and the occlusion ambientOcclusion()
+// summed. Exactly what the G-buffer keeps per pixel
+vec4 shade(vec3 direction, bool hit, float ray_length, vec3 normal, vec2 orbit, float glowAmount, float occlusion)
+{
+    vec4  bg_color = vec4(background(direction), 1.0);
+    vec4  color = bg_color;
+    float glow;
+    
+    if (hit) {
+        vec3 ray = cameraPosition + ray_length * direction;
+        glow = clamp(glowAmount * innerGlowIntensity * 3.0, 0.0, 1.0);
+        
+        color.rgb = mix(color1, mix(color2, color3, orbit.x * color2Intensity), orbit.y * color3Intensity);
+        color.rgb = blinnPhong(clamp(color.rgb * color1Intensity, 0.0, 1.0), ray, normal);
+        color.rgb *= clamp(1.0 - occlusion * aoIntensity, 0.0, 1.0);
+        color.rgb = mix(color.rgb, innerGlowColor, glow);
+        color.rgb = mix(bg_color.rgb, color.rgb, exp(-pow(ray_length * exp(fogFalloff), 2.0) * fog));
+        color.a = 1.0;
+    } else {
+        // Apply outer glow (fogging the background leaves the background)
+        glow = clamp(glowAmount * outerGlowIntensity * 3.0, 0.0, 1.0);
+        color.rgb = mix(color.rgb, outerGlowColor, glow);
+        if (transparent) color = vec4(0.0);
+    }
+    
+    return color;
+}
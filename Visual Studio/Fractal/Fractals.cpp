@@ -5,16 +5,92 @@
 #include <GL/glut.h>
 #include <iostream>
 #include <cstdlib>
+#include <chrono>
+#include <vector>
 #include "util.h"
+#include "streamer.h"
+#include "headless.h"
+#include "recorder.h"
+#include "frametime.h"
+#include "raymarch.h"
 #include "Fractals.h"
 
 float cx = 0.7f, cy = 0.0f;
 float scale = 2.2f;
-int iter = 70;
 const float zoom_factor = 0.025f;
-static Shader * shaders = new Shader;
+static Shader * shaders2d = new Shader;
+static Shader * shaders3d = new Shader;
+static Shader * shaders = shaders2d; // whichever one is on screen
 static Texture * textures = new Texture;
-static Camera * camera = new Camera(shaders, -0.5f, 0.0f, 2.5f, 0.0f, 0.0f);
+static TextureStreamer * streamer = 0; // started with the window, its workers decode images
+static Camera * camera = new Camera(shaders2d, -0.5f, 0.0f, 2.5f, 0.0f, 0.0f);
+// Drawn into in turn, at full or reduced size (a low resolution stand in while a program compiles, or while moving).
+// Each keeps its 3D hit distances, so the next frame can start its rays from the one before.
+static RenderTarget * frames[2] = { new RenderTarget(GL_RGBA8, true), new RenderTarget(GL_RGBA8, true) };
+static int frame = 0; // the one drawn next, frames[!frame] is the last
+static RenderTarget * coneMap = new RenderTarget(GL_RG32F); // the 3D pre-pass: safe start distance and steps per block
+static bool cones = true; // K toggles the pre-pass
+static RenderTarget * guesses = new RenderTarget(GL_RG32F); // the last frame's hits splatted into the new view
+static Shader * reprojector = new Shader; // reproject.vs, one point per pixel of the last frame
+static GLuint pointsVAO; // no attributes, reproject.vs works from gl_VertexID
+static bool reproject = true; // P toggles reprojection while moving
+static FractalParams lastView; // camera and surface of frames[!frame]
+static FractalParams lastSurface; // the same with the user's iterations, whatever the governor marched it with
+static bool lastValid = false; // frames[!frame] holds 3D hit distances
+static bool grid = false; // V toggles the baked distance grid
+static GridBaker * baker = 0; // its thread starts with the first bake
+static FractalParams gridView; // what the grid was (or is being) baked for
+static bool gridQueued = false; // gridView is valid
+static bool gridUploaded = false; // the textures hold gridView's grid
+static GLuint gridTextures[3]; // coarse, index, bricks
+static bool offscreen = false; // renderOffscreen(): no window, nothing to show until the grid is baked
+static Shader * relighter = new Shader; // 3d_shade.frag: the last march's G-buffer shaded again
+static RenderTarget * relit = new RenderTarget; // what it draws
+static bool deferred = true; // relight rather than march while only the shading changes
+static int gbufferView = 0; // O cycles: the picture, depth, normals, glow steps
+static unsigned int lastProgram = 0; // the 3D program frames[!frame] was marched with
+static RenderTarget * occlusion = new RenderTarget(GL_RG32F); // the AO pass: occlusion and hit distance per aoResolution x aoResolution block
+static bool occlusionValid = false; // occlusion holds frames[!frame]'s, which was marched without it
+static unsigned long occlusionMs = 0; // the AO pass' time offscreen, where waiting for the GPU is fine
+static int aoDivisor = 1; // aoResolution to start with (setAoResolution), N changes it after
+static GpuTimer * timer = 0; // needs a context, made with the window
+static GpuTimer * aoTimer = 0; // the AO pass alone, inside timer's frame
+static float aoPassMs = 0.0f, aoPassAt = 0.0f; // its latest GPU time in the window, and the aoResolution it ran at (0 == none yet)
+static ResolutionScaler * scaler = new ResolutionScaler;
+static QualityGovernor * governor = new QualityGovernor(scaler);
+
+static PixelReadback * readback = 0; // frames on their way back from the GPU, for recording
+static VideoRecorder * recorder = 0;
+static const char * capturePath = 0; // record from the start (setCapture)
+static const char * texturePath = 0; // the orbit trap's image (setTexture)
+static bool startThreeD = false; // the window opens on the 3D fractal (setThreeD)
+
+#define PREVIEW_DIVISOR 4 // preview is drawn at 1/4 of the window size
+#define CAPTURE_FPS 60 // frame rate written into the .y4m header
+#define CAPTURE_FILE "capture.y4m" // where the R key records to
+#define REPROJECT_UNKNOWN 1e30f // guesses is cleared to this, above REPROJECT_UNKNOWN in the shader
+#define REPROJECT_POINT 2.0f // splat size per last frame pixel, overlapping so a move doesn't open cracks
+#define FLY_STEP 0.02f // camera move per frame of renderOffscreen()'s fly through
+#define LIGHT_STEP 30.0f // degrees the L key swings the light round the fractal
+#define GBUFFER_VIEWS 5
+#define ACCUM_SAMPLES 256 // accumulation stops after this many samples per pixel
+#define ACCUM_NOISE 0.004f // or once the mean luminance's standard error (RMS over the pixels) is below this
+#define ACCUM_CHECK 16 // samples between noise checks, each reads the moments back
+#define ACCUM_LIGHT_SIZE 0.05f // radius of the accumulated light's ball, as a fraction of its distance from the origin (so 10% across)
+
+static Shader * accumulator = new Shader; // accumulate.frag: still 3D frames added up, and their mean
+static RenderTarget * samples = new RenderTarget(GL_RGBA32F); // this frame's sample, linear
+static RenderTarget * accumSum = new RenderTarget(GL_RGBA32F); // all the samples so far, summed
+static RenderTarget * accumMoments = new RenderTarget(GL_RG32F); // their luminance and its square, summed, for the noise
+static RenderTarget * accumMean = new RenderTarget; // what is shown
+static bool accumulating = false; // U toggles adding up still frames
+static int accumSamples = ACCUM_SAMPLES;
+static float accumNoise = ACCUM_NOISE;
+static FractalParams accumView; // what the sums are of
+static unsigned int accumProgram = 0; // and the program they were marched with
+static int accumCount = 0; // samples in the sums, 0 == start again
+static bool accumDone = false; // converged, nothing more to add until something changes
+static unsigned long accumStart = 0; // get_msec() at the first sample
 
 GLfloat vertices[12] = {
 	-1.0f, -1.0f, 0.0f,
@@ -29,6 +105,106 @@ GLuint indices[6] = {
 };
 
 GLuint VAO, VBO, EBO;
+static void setupScene() { // shaders and the quad, shared by the window and offscreen rendering
+	// load and set the mandelbrot shader
+	// Each of these settings gets its own specialised program, compiled the first time it is picked
+	shaders2d->addVariant("fractal", "FRACTAL");
+	shaders2d->addVariant("colorMode", "COLOR_MODE");
+	shaders2d->addVariant("bailoutStyle", "BAILOUT_STYLE");
+	shaders2d->addVariant("juliaMode", "JULIA_MODE");
+	shaders2d->load("2d_fractals.vs", "2d_fractals.frag");
+	setDefaultUniforms2d(shaders2d);
+
+	shaders3d->addVariant("type", "TYPE");
+	shaders3d->load("3d_fractals.vs", "3d_fractals.frag");
+	setDefaultUniforms3d(shaders3d);
+	shaders3d->set_uniform1i("aoResolution", aoDivisor);
+
+	reprojector->load("reproject.vs", "reproject.frag");
+	reprojector->set_uniform1i("distances", 2); // texture unit
+
+	relighter->load("3d_fractals.vs", "3d_shade.frag");
+	relighter->set_uniform1i("hits", 7); // texture units
+	relighter->set_uniform1i("surfaces", 8);
+	relighter->set_uniform1i("aoMap", 9);
+
+	accumulator->load("3d_fractals.vs", "accumulate.frag");
+	accumulator->set_uniform1i("samples", 10); // texture unit
+
+	shaders->updateValueStrings();
+
+	glGenVertexArrays(1, &pointsVAO);
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindVertexArray(0);
+}
+
+void setCapture(const char * path) {
+	capturePath = path;
+}
+
+void setTexture(const char * path) {
+	texturePath = path;
+}
+
+void setThreeD(bool on) {
+	startThreeD = on;
+}
+
+void setCones(bool on) {
+	cones = on;
+}
+
+void setReprojection(bool on) {
+	reproject = on;
+}
+
+void setGrid(bool on) {
+	grid = on;
+}
+
+void setDeferred(bool on) {
+	deferred = on;
+}
+
+void setAoResolution(int divisor) {
+	aoDivisor = divisor > 1 ? divisor : 1;
+}
+
+void setAccumulation(int samples, float noise) {
+	accumulating = samples > 0;
+	accumSamples = samples;
+	if (noise >= 0.0f) accumNoise = noise; // < 0 keeps ACCUM_NOISE
+}
+
+static void startRecording(const char * path) {
+	if (!readback) readback = new PixelReadback;
+	if (!recorder) recorder = new VideoRecorder(readback);
+	recorder->start(path, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT), CAPTURE_FPS);
+}
+
+static void stopRecording() {
+	if (!recorder || !recorder->recording()) return;
+	while (Frame * frame = readback->collect(true)) recorder->push(frame); // the last few frames are still on the GPU
+	recorder->stop();
+	if (readback->stalls) std::cerr << "Readback waited on the GPU " << readback->stalls << " times" << std::endl;
+}
+
 void startFractal() {
 	int argc = 0;
 	char ** argv = NULL;
@@ -56,49 +232,504 @@ void startFractal() {
 		exit(-1);
     } 
 
-	//textures->load("");
+	streamer = new TextureStreamer;
+	timer = new GpuTimer;
+	aoTimer = new GpuTimer;
+	if (texturePath) streamer->request(textures, texturePath); // decoded on a worker, swapped in once it is on the GPU
 
-	// load and set the mandelbrot shader
-	shaders->load("2d_fractals.vs", "2d_fractals.frag");
-	setDefaultUniforms2d(shaders);
-	shaders->updateValueStrings();
+	if (startThreeD) { // the 3D fractal, and a camera that starts where its defaults put it
+		shaders = shaders3d;
+		delete camera;
+		camera = new Camera(shaders3d, 0.0f, 0.0f, -2.5f, 0.0f, 0.0f);
+	}
+	setupScene();
+	if (capturePath) startRecording(capturePath);
 
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-	
+	glutMainLoop();
+}
+
+static void drawQuad() { // the whole fractal is one full screen quad
 	glBindVertexArray(VAO);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+static void drawCones() { // the 3D cone pre-pass, leaves coneMap bound: bind the real target after it
+	if (shaders != shaders3d) return;
+	shaders->set_uniform1i("coneMapOn", 0);
+	if (!cones) return;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	float sx, sy;
+	shaders->get_uniform2f("size", &sx, &sy);
+	coneMap->resize((unsigned int)ceilf(sx / CONE_BLOCK), (unsigned int)ceilf(sy / CONE_BLOCK));
+	coneMap->bind();
+	shaders->set_uniform1i("conePass", 1);
+	shaders->flush();
+	drawQuad();
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, coneMap->id());
+	glActiveTexture(GL_TEXTURE0);
+	shaders->set_uniform1i("conePass", 0);
+	shaders->set_uniform1i("coneMapOn", 1);
+	shaders->flush();
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+// surface: view with the user's settings, so the governor changing level doesn't count as a different fractal
+static void drawReprojection(RenderTarget * target, const FractalParams & view, const FractalParams & surface, bool moving) { // splat the last frame's hits into guesses for the 3D pass
+	shaders->set_uniform1i("reprojectOn", 0);
+	if (shaders != shaders3d || !reproject || !moving || !lastValid) return; // a still frame marches in full, it is the one that stays up
+	if (!sameSurface(lastSurface, surface)) return; // the last frame shows a different fractal
+
+	reprojector->use();
+	if (reprojector->compiling()) { // first use, nothing to draw with yet
+		shaders->use();
+		return;
+	}
+	RenderTarget * last = frames[!frame];
+	reprojector->set_uniform2f("lastSize", lastView.sizeX, lastView.sizeY);
+	reprojector->set_uniform3f("lastPosition", lastView.cameraPosition.x, lastView.cameraPosition.y, lastView.cameraPosition.z);
+	reprojector->set_uniformMatrix3f("lastRotation", lastView.cameraRotation.m);
+	reprojector->set_uniform1f("lastFocalLength", lastView.cameraFocalLength);
+	reprojector->set_uniform1f("lastAspectRatio", lastView.aspectRatio);
+	reprojector->set_uniform2f("size", view.sizeX, view.sizeY);
+	reprojector->set_uniform2f("viewport", (float)target->width, (float)target->height);
+	reprojector->set_uniform3f("cameraPosition", view.cameraPosition.x, view.cameraPosition.y, view.cameraPosition.z);
+	reprojector->set_uniformMatrix3f("cameraRotation", view.cameraRotation.m);
+	reprojector->set_uniform1f("cameraFocalLength", view.cameraFocalLength);
+	reprojector->set_uniform1f("aspectRatio", view.aspectRatio);
+	reprojector->flush();
 
+	guesses->resize(target->width, target->height);
+	guesses->bind();
+	glClearColor(REPROJECT_UNKNOWN, REPROJECT_UNKNOWN, REPROJECT_UNKNOWN, REPROJECT_UNKNOWN); // float target, not clamped
+	glClear(GL_COLOR_BUFFER_BIT);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, last->distanceId());
+	glEnable(GL_BLEND);
+	glBlendEquation(GL_MIN); // nearest surface wins where points overlap
+	glPointSize(ceilf(REPROJECT_POINT * fmaxf((float)target->width / last->width, 1.0f))); // cover the gaps when the new frame has more pixels
+	glBindVertexArray(pointsVAO);
+	glDrawArrays(GL_POINTS, 0, last->width * last->height);
 	glBindVertexArray(0);
+	glBlendEquation(GL_FUNC_ADD);
+	glDisable(GL_BLEND);
 
-	glutMainLoop();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, guesses->id());
+	glActiveTexture(GL_TEXTURE0);
+	shaders->use(); // back to the fractal program
+	shaders->set_uniform1i("reprojectOn", 1);
+	shaders->set_uniform2f("reprojectSize", (float)target->width, (float)target->height);
+}
+
+static void updateGrid(const FractalParams & view, bool wait) { // keep the baked grid in step with the fractal, rays use it once it is up
+	shaders->set_uniform1i("gridOn", 0);
+	if (shaders != shaders3d || !grid) return;
+	if (!baker) baker = new GridBaker;
+	if (!gridQueued || !sameSurface(gridView, view)) { // new parameters: the old grid is wrong from now on
+		baker->bake(view);
+		gridView = view;
+		gridQueued = true;
+		gridUploaded = false;
+	}
+
+	DistanceGrid baked;
+	while (!gridUploaded) {
+		if (baker->finished(baked)) {
+			gridTextures[0] = uploadVolume(gridTextures[0], GL_R32F, GL_RED, GRID_CELLS + 1, GRID_CELLS + 1, GRID_CELLS + 1, &baked.coarse[0], true);
+			gridTextures[1] = uploadVolume(gridTextures[1], GL_RGB32F, GL_RGB, GRID_CELLS, GRID_CELLS, GRID_CELLS, &baked.index[0], false);
+			gridTextures[2] = uploadVolume(gridTextures[2], GL_R32F, GL_RED, baked.atlasX * BRICK_SIZE, baked.atlasY * BRICK_SIZE, baked.atlasZ * BRICK_SIZE, &baked.bricks[0], true);
+			shaders->set_uniform3f("gridAtlas", (float)baked.atlasX, (float)baked.atlasY, (float)baked.atlasZ);
+			shaders->set_uniform1f("gridRadius", baked.radius);
+			shaders->set_uniform1f("gridExact", baked.exact());
+			std::cout << "Distance grid baked in " << baker->lastMs << " ms, " << baked.brickCount << " bricks" << std::endl;
+			gridUploaded = true;
+		}
+		else if (!wait) {
+			return; // plain dE() until it's ready
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE4 + i);
+		glBindTexture(GL_TEXTURE_3D, gridTextures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	shaders->set_uniform1i("gridOn", 1);
+}
+
+static void drawOcclusion(const FractalParams & view) { // the AO pass over frames[!frame]'s G-buffer, for relight() to scale up
+	RenderTarget * last = frames[!frame];
+	float s = (float)view.aoResolution;
+	unsigned long start = 0;
+
+	if (offscreen) {
+		glFinish(); // the march, so only the pass itself is timed
+		start = get_msec();
+	}
+	else if (aoTimer) aoTimer->begin(s);
+	occlusion->resize((unsigned int)ceilf(view.sizeX / s), (unsigned int)ceilf(view.sizeY / s));
+	occlusion->bind();
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D, last->distanceId());
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, last->surfaceId());
+	glActiveTexture(GL_TEXTURE0);
+	shaders->set_uniform1i("aoPass", 1);
+	shaders->flush();
+	drawQuad();
+	shaders->set_uniform1i("aoPass", 0);
+	shaders->flush();
+	if (offscreen) {
+		glFinish();
+		occlusionMs = get_msec() - start;
+	}
+	else if (aoTimer) aoTimer->end();
+}
+
+// marched: frames[!frame] was drawn just now, so its picture needs occlusion's AO even with deferred off
+static bool relight(const FractalParams & view, bool marched = false) { // nothing moved since the last march: shade its G-buffer again into relit
+	RenderTarget * last = frames[!frame];
+	if (shaders != shaders3d || !lastValid || (!deferred && !gbufferView && !(marched && occlusionValid))) return false;
+	if (view.antialiasingOn) return false; // an antialiased pixel blends several hits, one texel can't stand in for them
+	if (!sameView(lastView, view) || shaders->id() != lastProgram) return false; // moved, reshaped, or the shader was edited
+
+	relighter->copy_uniforms(shaders); // the lighting, colours and camera as they are now
+	relighter->set_uniform1i("gbufferView", gbufferView);
+	relighter->set_uniform1i("aoMapOn", occlusionValid);
+	relighter->use();
+	if (relighter->compiling()) { // first use, nothing to draw with yet
+		shaders->use();
+		return false;
+	}
+	relit->resize(last->width, last->height);
+	relit->bind();
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D, last->distanceId());
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, last->surfaceId());
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, occlusion->id());
+	glActiveTexture(GL_TEXTURE0);
+	drawQuad();
+	shaders->use(); // back to the fractal program
+	return true;
+}
+
+static float halton(unsigned int i, unsigned int base) { // low discrepancy: well spread out however many samples there are
+	float f = 1.0f, r = 0.0f;
+	for (; i > 0; i /= base) {
+		f /= base;
+		r += f * (i % base);
+	}
+	return r;
+}
+
+static float accumulatedNoise() { // standard error of the mean luminance, RMS over the pixels
+	std::vector<float> moments(accumMoments->width * accumMoments->height * 4);
+	accumMoments->read(&moments[0]);
+	double sum = 0.0;
+	for (size_t i = 0; i < moments.size(); i += 4) {
+		double mean = moments[i] / accumCount, variance = moments[i + 1] / accumCount - mean * mean;
+		if (variance > 0.0) sum += variance / accumCount;
+	}
+	return (float)sqrt(sum / (moments.size() / 4));
+}
+
+// One more sample of a still 3D frame into the sums, their mean into accumMean: the ray jittered inside
+// the pixel, the AO probes (in the shader) and the light too. Starts again whenever anything about the
+// picture changed, stops at accumSamples, or once the noise is below accumNoise
+static RenderTarget * accumulateFrame(RenderTarget * target, const FractalParams & view) {
+	if (accumCount == 0 || !sameLook(accumView, view) || shaders->id() != accumProgram || accumSum->width != target->width || accumSum->height != target->height) {
+		samples->resize(target->width, target->height);
+		accumSum->resize(target->width, target->height);
+		accumMoments->resize(target->width, target->height);
+		accumMean->resize(target->width, target->height);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		accumSum->bind();
+		glClear(GL_COLOR_BUFFER_BIT);
+		accumMoments->bind();
+		glClear(GL_COLOR_BUFFER_BIT);
+		accumView = view;
+		accumProgram = shaders->id();
+		accumCount = 0;
+		accumDone = false;
+		accumStart = get_msec();
+	}
+	if (accumDone) return accumMean;
+
+	float x, y, z;
+	unsigned int k = accumCount + 1; // halton() of 0 is 0 in every base
+	shaders->get_uniform3f("light", &x, &y, &z);
+	float r = ACCUM_LIGHT_SIZE * sqrtf(x * x + y * y + z * z) * cbrtf(halton(k, 11)); // cube root: as many samples near the surface as there is volume there
+	float cz = 2.0f * halton(k, 5) - 1.0f, a = 2.0f * 3.141593f * halton(k, 7), cr = sqrtf(1.0f - cz * cz); // a direction, uniform over the sphere
+	shaders->set_uniform1i("accumulate", 1);
+	shaders->set_uniform2f("jitter", halton(k, 2) - 0.5f, halton(k, 3) - 0.5f);
+	shaders->set_uniform1f("sampleSeed", (float)accumCount);
+	shaders->set_uniform3f("lightJitter", cr * cosf(a) * r, cr * sinf(a) * r, cz * r);
+	shaders->set_uniform1i("aoSkip", 0); // every sample's own AO, it is what converges
+	shaders->set_uniform1i("reprojectOn", 0);
+	updateGrid(view, offscreen);
+	drawCones(); // the jitter stays inside the pixel, so inside its block's cone
+	samples->bind();
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT); // transparent misses are discarded
+	shaders->flush();
+	drawQuad();
+	shaders->set_uniform1i("accumulate", 0);
+	shaders->set_uniform2f("jitter", 0.0f, 0.0f);
+	shaders->set_uniform3f("lightJitter", 0.0f, 0.0f, 0.0f);
+
+	accumulator->use();
+	accumulator->set_uniform2f("size", (float)target->width, (float)target->height);
+	accumulator->set_uniform1f("gamma", view.gamma);
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_2D, samples->id());
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE); // float targets, nothing clamps
+	accumSum->bind();
+	accumulator->set_uniform1i("mode", 0);
+	accumulator->flush();
+	drawQuad();
+	accumMoments->bind();
+	accumulator->set_uniform1i("mode", 1);
+	accumulator->flush();
+	drawQuad();
+	glBlendFunc(GL_ONE, GL_ZERO);
+	glDisable(GL_BLEND);
+	accumCount++;
+
+	glBindTexture(GL_TEXTURE_2D, accumSum->id());
+	accumMean->bind();
+	accumulator->set_uniform1i("mode", 2);
+	accumulator->set_uniform1f("count", (float)accumCount);
+	accumulator->flush();
+	drawQuad();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	shaders->use(); // back to the fractal program
+
+	if (accumCount >= accumSamples || accumCount % ACCUM_CHECK == 0) {
+		float noise = accumulatedNoise();
+		if (accumCount >= accumSamples || noise < accumNoise) {
+			accumDone = true;
+			std::cout << "Accumulated " << accumCount << " samples in " << get_msec() - accumStart << " ms, noise " << noise << std::endl;
+		}
+	}
+	return accumMean;
+}
+
+// The pre-passes, then the picture into target at the current size. Returns where the picture is:
+// target, or relit when the last frame's G-buffer could be shaded again instead
+static RenderTarget * drawTarget(RenderTarget * target, bool moving) {
+	FractalParams view, surface; // what is marched, and the grid's and reprojection's key
+	bool lowAO = false; // the march leaves AO to drawOcclusion()
+
+	if (shaders == shaders3d) {
+		float sx, sy, ox, oy;
+		shaders->get_uniform2f("size", &sx, &sy);
+		shaders->get_uniform2f("outputSize", &ox, &oy);
+		view.load(shaders, sx, sy);
+		view.aspectRatio = ox / oy; // the shader's, from outputSize
+		lowAO = view.aoResolution > 1 && view.aoIterations > 0 && !view.antialiasingOn; // antialiased pixels are never relit, they keep the march's own
+		shaders->set_uniform1i("aoSkip", lowAO);
+	}
+	surface = view;
+	surface.maxIterations = governor->userIterations(view.maxIterations); // the only governed setting sameSurface() looks at
+	if (accumulating && shaders == shaders3d && !moving) return accumulateFrame(target, view);
+	if (relight(view)) return relit;
+	updateGrid(surface, offscreen); // baked at the user's iterations, so it survives the governor's level changes
+	drawReprojection(target, view, surface, moving);
+	drawCones();
+	target->bind();
+	shaders->flush(); // the pre-passes' switches, even when they were skipped
+	drawQuad();
+
+	lastView = view;
+	lastSurface = surface;
+	lastValid = shaders == shaders3d; // 2D leaves nothing to reproject
+	lastProgram = shaders->id();
+	frame = !frame;
+	occlusionValid = lowAO;
+	if (lowAO) drawOcclusion(view);
+	if ((gbufferView || lowAO) && relight(view, true)) return relit; // the G-buffer rather than the picture, or the picture with the AO scaled up
+	return target;
+}
+
+static void swingLight(float degrees) { // round the fractal's vertical axis
+	float x, y, z, a = degrees * 3.141593f / 180.0f;
+	shaders->get_uniform3f("light", &x, &y, &z);
+	shaders->set_uniform3f("light", x * cosf(a) - z * sinf(a), y, x * sinf(a) + z * cosf(a));
+}
+
+int renderOffscreen(const char * path, unsigned int width, unsigned int height, const RenderOptions & options) {
+	HeadlessContext context; // no window, no display needed
+	RenderTarget * target;
+	unsigned long start;
+
+	if (!context.create()) return -1;
+	offscreen = true;
+	std::cout << "Rendering " << width << "x" << height << " offscreen (" << context.backend() << ", " << glGetString(GL_RENDERER) << ")" << std::endl;
+
+	setupScene();
+	shaders = options.threeD ? shaders3d : shaders2d;
+	if (options.threeD && options.type >= 0) shaders->set_uniform1i("type", options.type);
+	shaders->set_uniform2f("size", (float)width, (float)height); // one fractal pixel per output pixel
+	shaders->set_uniform2f("outputSize", (float)width, (float)height);
+
+	frames[0]->resize(width, height);
+	frames[1]->resize(width, height);
+	start = get_msec();
+	shaders->use(); // nothing to preview, so this compiles (or loads from the cache) right here
+	target = drawTarget(frames[frame], false);
+	while (target == accumMean && !accumDone) target = drawTarget(frames[frame], false); // a still, add samples up until it converges
+
+	uint8_t * pixels = new uint8_t[width * height * 4];
+	target->read(pixels); // waits for the GPU (or llvmpipe) to finish
+	std::cout << "Rendered in " << get_msec() - start << " ms" << std::endl;
+	if (occlusionValid) {
+		int s = shaders->get_uniform1i("aoResolution");
+		std::cout << "AO pass at 1/" << s << " resolution: " << occlusionMs << " ms, " << occlusion->width * occlusion->height << " pixels of AO instead of " << width * height << std::endl;
+	}
+
+	if (options.moves > 0 && options.threeD) { // fly forward a little at a time, as the arrow keys would, reprojecting each frame from the last
+		float x, y, z;
+		reprojector->use(); // compile it outside the timing
+		shaders->use();
+		start = get_msec();
+		for (int i = 0; i < options.moves; i++) {
+			shaders->get_uniform3f("cameraPosition", &x, &y, &z);
+			shaders->set_uniform3f("cameraPosition", x, y, z + FLY_STEP);
+			target = drawTarget(frames[frame], true);
+			target->read(pixels);
+		}
+		std::cout << options.moves << " moving frames, " << (get_msec() - start) / options.moves << " ms each" << (reproject ? " (reprojected)" : "") << std::endl;
+	}
+	if (options.relights > 0 && options.threeD) { // swing the light round, as the L key does: only the shading changes
+		relighter->use(); // compile it outside the timing
+		shaders->use();
+		start = get_msec();
+		for (int i = 0; i < options.relights; i++) {
+			swingLight(LIGHT_STEP);
+			target = drawTarget(frames[frame], false);
+			target->read(pixels);
+		}
+		std::cout << options.relights << " relit frames, " << (get_msec() - start) / options.relights << " ms each" << (target == relit ? " (from the G-buffer)" : " (marched)") << std::endl;
+	}
+	bool saved = save_ppm(path, width, height, pixels, true);
+	delete[] pixels;
+	return saved ? 0 : -1;
+}
+
+int renderCpu(const char * path, unsigned int width, unsigned int height, const RenderOptions & options) {
+	Shader settings; // only its CPU side uniform table, no GL anywhere
+	FractalParams params;
+	CpuRaymarcher tracer;
+
+	tracer.packets = options.packets;
+	tracer.cones = cones;
+	setDefaultUniforms3d(&settings);
+	if (options.type >= 0) settings.set_uniform1i("type", options.type);
+	params.load(&settings, (float)width, (float)height);
+	if (options.dualNormals >= 0) params.dualNormals = options.dualNormals != 0;
+	if (options.checkNormals) compareNormals(params, width, height);
+	std::cout << "Rendering " << width << "x" << height << " on the CPU (" << tracer.threads() << " threads)" << std::endl;
+
+	uint8_t * pixels = new uint8_t[width * height * 4];
+	tracer.render(params, width, height, pixels);
+	tracer.report();
+	bool saved = save_ppm(path, width, height, pixels, true);
+	delete[] pixels;
+	return saved ? 0 : -1;
+}
+
+int exportMesh(const char * path, unsigned int resolution, int type) {
+	Shader settings; // the uniform table again, for the fractal's parameters
+	FractalParams params;
+
+	setDefaultUniforms3d(&settings);
+	if (type >= 0) settings.set_uniform1i("type", type);
+	params.load(&settings, 1.0f, 1.0f); // no image, the size doesn't matter
+	return writeMesh(params, path, resolution) ? 0 : -1;
+}
+
+static void drawScaled(float scale) { // the same picture with fewer pixels, stretched over the window
+	int width = glutGet(GLUT_WINDOW_WIDTH);
+	int height = glutGet(GLUT_WINDOW_HEIGHT);
+	float sx, sy;
+
+	shaders->get_uniform2f("size", &sx, &sy);
+	shaders->set_uniform2f("size", sx * scale, sy * scale);
+	shaders->flush();
+
+	RenderTarget * target = frames[frame];
+	target->resize((unsigned int)(width * scale), (unsigned int)(height * scale));
+	target = drawTarget(target, scaler->interacting());
+	target->blit(width, height);
+
+	shaders->set_uniform2f("size", sx, sy); // goes back out on the next flush
 }
 
 void draw(void) {
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	shaders->use();
+	shaders->use(); // may start (or finish) compiling a new variant
+	textures->enable(); // unit 0: a streamed swap or a RenderTarget resize leaves it pointing elsewhere
 
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	if (shaders->compiling()) { // keep showing the old program, cheaply, until the new one is ready
+		drawScaled(1.0f / PREVIEW_DIVISOR);
+	}
+	else {
+		governor->apply(shaders, scaler->interacting()); // fewer iterations etc. if resolution alone can't keep up
+		if (scaler->reduced()) { // moving: hold the frame rate, the picture sharpens once input stops
+			timer->begin(scaler->scale());
+			drawScaled(scaler->scale());
+			timer->end();
+		}
+		else {
+			timer->begin(1.0f);
+			if (shaders == shaders3d) { // through a frame target, its distances seed the reprojection once the camera moves
+				drawScaled(1.0f);
+			}
+			else {
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				glViewport(0, 0, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+				drawQuad();
+				lastValid = false;
+			}
+			timer->end();
+		}
+		governor->restore(shaders);
+	}
+	float ms, at;
+	while (timer->result(&ms, &at)) governor->measured(ms, at); // from a frame or two ago, never waits
+	while (aoTimer->result(&aoPassMs, &aoPassAt)); // the latest one is kept for the N key
+
+	if (recorder && recorder->recording()) {
+		if ((unsigned int)glutGet(GLUT_WINDOW_WIDTH) < recorder->width || (unsigned int)glutGet(GLUT_WINDOW_HEIGHT) < recorder->height) {
+			std::cerr << "Window shrank below the recording size" << std::endl; // a .y4m can't change size
+			stopRecording();
+		}
+		else {
+			readback->capture(0, 0, recorder->width, recorder->height); // the back buffer, before the swap
+			while (Frame * frame = readback->collect()) recorder->push(frame); // whatever the GPU has finished, never waits
+		}
+	}
 
 	glutSwapBuffers();
 }
 
 void idle_handler(void) {
+	Shader * all[] = { shaders2d, shaders3d, reprojector, relighter, accumulator };
+	for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+		all[i]->checkReload(); // pick up shader edits without restarting, the helpers #include 3d_shading.glsl and common.glsl too
+	}
+	streamer->update(); // finish any texture uploads (never waits)
 	glutPostRedisplay();
 }
 
@@ -106,12 +737,15 @@ float step = 0.5f;
 
 void key_handler(unsigned char key, int x, int y) {
 	int dir = -1;
+	int iter = shaders->get_uniform1i("maxIterations"); // the shader's copy is the only one
 	float step_factor = 5 * camera->z;
 
+	if (key != 'l' && key != 'L') scaler->interact(); // nearly every key changes the picture (the light only its shading, relit at full size)
 	switch (key) {
 	case 27: // ESC
 	case 'q':
 	case 'Q':
+		stopRecording(); // finish the file properly
 		exit(0);
 		break;
 	case GLUT_KEY_UP:
@@ -154,6 +788,53 @@ void key_handler(unsigned char key, int x, int y) {
 	case 'j':
 	case 'J':
 		shaders->toggle("juliaMode");
+		shaders->updateValueStrings();
+		break;
+	case 'r':
+	case 'R':
+		if (recorder && recorder->recording()) stopRecording();
+		else startRecording(CAPTURE_FILE);
+		break;
+	case 'k':
+	case 'K':
+		cones = !cones;
+		std::cout << "Cone pre-pass " << (cones ? "on" : "off") << std::endl;
+		break;
+	case 'p':
+	case 'P':
+		reproject = !reproject;
+		std::cout << "Reprojection " << (reproject ? "on" : "off") << std::endl;
+		break;
+	case 'v':
+	case 'V':
+		grid = !grid;
+		std::cout << "Distance grid " << (grid ? "on" : "off") << std::endl;
+		break;
+	case 'l':
+	case 'L':
+		if (shaders == shaders3d) swingLight(LIGHT_STEP);
+		break;
+	case 'o':
+	case 'O':
+		gbufferView = (gbufferView + 1) % GBUFFER_VIEWS;
+		std::cout << "Showing " << (gbufferView == 0 ? "the picture" : gbufferView == 1 ? "depth" : gbufferView == 2 ? "normals" : gbufferView == 3 ? "glow steps" : "occlusion") << std::endl;
+		break;
+	case 'u':
+	case 'U':
+		accumulating = !accumulating;
+		accumCount = 0;
+		std::cout << "Accumulating still frames " << (accumulating ? "on" : "off") << std::endl;
+		break;
+	case 'n':
+	case 'N':
+		if (shaders == shaders3d) {
+			int s = shaders->get_uniform1i("aoResolution") * 2;
+			shaders->set_uniform1i("aoResolution", s > 4 ? 1 : s);
+			std::cout << "Ambient occlusion at " << (s > 4 ? "full" : s == 2 ? "1/2" : "1/4") << " resolution";
+			if (scaler->estimate() > 0.0f) std::cout << " (full size frames were taking " << scaler->estimate() << " ms)";
+			if (aoPassAt > 0.0f) std::cout << ", the AO pass at 1/" << aoPassAt << " took " << aoPassMs << " ms of the last one";
+			std::cout << std::endl;
+		}
 		break;
 	default:
 		break;
@@ -169,6 +850,7 @@ void bn_handler(int bn, int state, int x, int y) {
 	px = (float)x;
 	py = (float)y;
 	which_bn = bn;
+	scaler->interact();
 	if (which_bn == 3) { // scroll up
 		scale *= 1 - zoom_factor * 2.0f;
 	}
@@ -187,6 +869,7 @@ void mouse_handler(int x, int y) {
 	float u = dx*step, v = dy*step;
 
 	float step_factor = 4.0f * camera->z / (float)xres;
+	scaler->interact(); // dragging
 	camera->x -= u * step_factor;
 	camera->y += v * step_factor;
 
@@ -1,6 +1,28 @@
 #ifndef __FRACTAL_H__
 #define __FRACTAL_H__ // Don't include this file multiple times.
 void startFractal(); // Launches the Fractal Window
+void setCapture(const char * path); // record from the moment the window opens, to a .y4m file or "-" for stdout
+void setTexture(const char * path); // the image the 2D orbit trap maps into fractal space, streamed in once the window opens
+void setThreeD(bool on); // open the window on the 3D fractal instead of the 2D one (off by default)
+void setCones(bool on); // the 3D cone pre-pass, GPU and CPU (on by default, K in the window)
+void setGrid(bool on); // march the 3D fractal through a baked distance grid, rebaked in the background when it changes (off by default, V in the window)
+void setReprojection(bool on); // start 3D rays from the last frame's hits while the camera moves (on by default, P in the window)
+void setDeferred(bool on); // shade the last 3D frame's G-buffer again while only the lighting and colours change (on by default)
+void setAccumulation(int samples, float noise); // add still 3D frames up, jittered, until samples per pixel or the noise drops below noise (< 0: the default; off by default, U in the window)
+void setAoResolution(int divisor); // 3D ambient occlusion once per divisor x divisor block, scaled up along the edges (1 by default: every pixel, N in the window)
+struct RenderOptions { // what a batch render draws, beyond its size (batch.cpp fills it in from --render's arguments)
+	RenderOptions() : threeD(false), type(-1), moves(0), relights(0), packets(true), dualNormals(-1), checkNormals(false) {}
+	bool threeD; // the 3D fractal (always, on the CPU)
+	int type; // 3D fractal type, -1 == the default
+	int moves; // GPU 3D: then fly the camera this many frames, the last one is saved
+	int relights; // GPU 3D: then swing the light round this many times
+	bool packets; // CPU: SIMD ray packets for the types that have them
+	int dualNormals; // CPU: 0 central differences, 1 dual numbers, -1 == per type
+	bool checkNormals; // CPU: time both kinds of normal and compare them first
+};
+int renderOffscreen(const char * path, unsigned int width, unsigned int height, const RenderOptions & options); // no window: render once to a .ppm, 0 on success
+int renderCpu(const char * path, unsigned int width, unsigned int height, const RenderOptions & options); // the 3D fractal without any GPU, 0 on success
+int exportMesh(const char * path, unsigned int resolution, int type = -1); // the 3D fractal's surface to a .ply or .stl, resolution cells across the bounding cube, 0 on success
 void draw(void); // Handler for redrawing
 void idle_handler(void); // Handler for when nothing is happenning
 void key_handler(unsigned char key, int x, int y); // keyboard event handler
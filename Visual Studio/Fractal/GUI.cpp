@@ -5,6 +5,8 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <thread>
 
 #ifndef GLEW_STATIC
@@ -34,6 +36,38 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 	HWND hwnd;
 	MSG msg;
 
+	if (strncmp(lpCmdLine, "-benchppm ", 10) == 0) { // Fractal.exe -benchppm image.ppm: time the image loader and quit
+		std::string report = benchmark_pnm(lpCmdLine + 10, 20);
+		MessageBox(NULL, report.c_str(), "Image loading benchmark", MB_OK | MB_ICONINFORMATION);
+		return 0;
+	}
+	if (strncmp(lpCmdLine, "-mesh ", 6) == 0) { // Fractal.exe -mesh out.ply 512 [type]: the 3D surface as triangles and quit
+		char path[MAX_PATH] = "";
+		unsigned int resolution = 0;
+		int type = -1;
+		if (sscanf(lpCmdLine + 6, "%259s %u %d", path, &resolution, &type) < 2 || resolution == 0) {
+			MessageBox(NULL, "usage: Fractal.exe -mesh out.ply|out.stl resolution [type]", "Mesh export", MB_OK | MB_ICONERROR);
+			return -1;
+		}
+		return exportMesh(path, resolution, type);
+	}
+	if (strncmp(lpCmdLine, "-render ", 8) == 0) { // Fractal.exe -render out.ppm 1920 1080 [3d | cpu]: one offscreen frame and quit
+		char path[MAX_PATH] = "";
+		unsigned int width = 0, height = 0;
+		char mode[8] = "";
+		if (sscanf(lpCmdLine + 8, "%259s %u %u %7s", path, &width, &height, mode) < 3 || width == 0 || height == 0) {
+			MessageBox(NULL, "usage: Fractal.exe -render out.ppm width height [3d | cpu]", "Offscreen render", MB_OK | MB_ICONERROR);
+			return -1;
+		}
+		RenderOptions options;
+		options.threeD = strcmp(mode, "3d") == 0;
+		if (strcmp(mode, "cpu") == 0) return renderCpu(path, width, height, options); // 3D without the GPU
+		return renderOffscreen(path, width, height, options);
+	}
+
+	if (strncmp(lpCmdLine, "-texture ", 9) == 0) setTexture(lpCmdLine + 9); // Fractal.exe -texture flower.png: the orbit trap's image
+	if (strcmp(lpCmdLine, "-3d") == 0) setThreeD(true); // Fractal.exe -3d: the window opens on the 3D fractal
+
 	wc.cbSize = sizeof(WNDCLASSEX);
 	wc.style = CS_VREDRAW | CS_HREDRAW;
 	wc.lpfnWndProc = guiProc;
@@ -84,7 +118,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 LRESULT CALLBACK guiProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
 	static RECT rect;
-	static PCTSTR controls = getControls();
+	static const char * controls = getControls();
 	PAINTSTRUCT ps;
 	HDC hdc;
 
@@ -111,8 +145,8 @@ LRESULT CALLBACK guiProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		break;
 	case WM_PAINT:
 		{
-			PCTSTR leftText = getLeftStrings();
-			PCTSTR rightText = getRightStrings();
+			const char * leftText = getLeftStrings();
+			const char * rightText = getRightStrings();
 			hdc = BeginPaint(hwnd, &ps);
 			GetClientRect(hwnd, &rect);
 			DrawText(hdc, leftText, -1, &rect, DT_LEFT);
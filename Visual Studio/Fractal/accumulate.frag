@@ -0,0 +1,30 @@
+#ifdef GL_ES
+precision highp float;
+#endif
+
+/**
+ * accumulate.frag
+ * Still 3D frames adding up: drawn with additive blending, each sample goes into the running sum and its
+ * luminance (and that squared, for the noise) into the moments. Then the mean, with gamma, for showing.
+ */
+
+uniform sampler2D samples;          // mode 0 and 1: this frame's linear colour. Mode 2: the sum of them all
+uniform vec2  size;                 // of the targets, in pixels
+uniform int   mode;                 // 0 add the sample, 1 add its luminance moments, 2 show the mean
+uniform float count;                // samples in the sum, for mode 2
+uniform float gamma;
+
+void main()
+{
+    vec4  c = texture2D(samples, gl_FragCoord.xy / size);
+
+    if (mode == 0) {
+        gl_FragColor = c;
+    } else if (mode == 1) {
+        float l = dot(c.rgb, vec3(0.299, 0.587, 0.114));
+        gl_FragColor = vec4(l, l * l, 0.0, 1.0);
+    } else {
+        c /= count;
+        gl_FragColor = vec4(pow(c.rgb, vec3(1.0 / gamma)), c.a);
+    }
+}
@@ -0,0 +1,331 @@
+/** asset.cpp
+ * File loading for shaders (and anything else that wants raw bytes)
+ * Files are memory mapped, or read once when they may change under us, and handed
+ * to OpenGL piece by piece, so #include never has to glue sources together into a
+ * new string.
+ */
+#if defined(__unix__) || defined(unix)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif	// __linux__
+#else	// assume windows
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif	// __unix__
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+#include "asset.h"
+
+using namespace std;
+
+#define MAX_INCLUDE_DEPTH 16 // anything deeper is almost certainly an include loop
+#define POLL_INTERVAL 250 // ms between modification time checks when there is no inotify
+
+bool MappedFile::open(const char * path, bool copy) {
+	close();
+	if (copy) return read(path);
+#if defined(__unix__) || defined(unix)
+	struct stat st;
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	size = (size_t)st.st_size;
+	if (size > 0) {
+		void * view = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED) {
+			::close(fd);
+			size = 0;
+			return false;
+		}
+		data = (const char *)view;
+	}
+	else {
+		data = ""; // mmap refuses empty files, but an empty view is fine
+	}
+	::close(fd); // the mapping keeps the file alive
+#else
+	LARGE_INTEGER length;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	if (!GetFileSizeEx(file, &length)) {
+		CloseHandle(file);
+		return false;
+	}
+	size = (size_t)length.QuadPart;
+	if (size > 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void * view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (mapping) CloseHandle(mapping); // the view keeps the mapping alive
+		if (!view) {
+			CloseHandle(file);
+			size = 0;
+			return false;
+		}
+		data = (const char *)view;
+	}
+	else {
+		data = "";
+	}
+	CloseHandle(file);
+#endif	// __unix__
+	return true;
+}
+
+bool MappedFile::read(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (length < 0) {
+		fclose(f);
+		return false;
+	}
+	size = (size_t)length;
+	if (size > 0) {
+		char * bytes = new char[size];
+		size = fread(bytes, 1, size, f); // shorter if it was truncated since, what is there is still good
+		data = bytes;
+		copied = true;
+	}
+	else {
+		data = "";
+	}
+	fclose(f);
+	return true;
+}
+
+void MappedFile::close() {
+	if (copied) {
+		delete[] data;
+	}
+	else if (data && size > 0) {
+#if defined(__unix__) || defined(unix)
+		munmap((void *)data, size);
+#else
+		UnmapViewOfFile(data);
+#endif	// __unix__
+	}
+	data = 0;
+	size = 0;
+	copied = false;
+}
+
+static string directoryOf(const string & path) { // "shaders/a.frag" -> "shaders/"
+	size_t slash = path.find_last_of("/\\");
+	return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+bool ShaderSource::load(const char * path) {
+	clear();
+	return include(path, 0);
+}
+
+void ShaderSource::clear() {
+	for (size_t i = 0; i < mapped.size(); i++) {
+		delete mapped[i];
+	}
+	mapped.clear();
+	lines.clear();
+	strings.clear();
+	lengths.clear();
+	paths.clear();
+}
+
+void ShaderSource::add(const char * s, size_t len) {
+	if (len == 0) return;
+	strings.push_back(s);
+	lengths.push_back((int)len);
+}
+
+bool ShaderSource::include(const string & path, int depth) {
+	if (depth > MAX_INCLUDE_DEPTH) {
+		cout << path << ": #include nested too deeply" << endl;
+		return false;
+	}
+
+	MappedFile * file = new MappedFile;
+	if (!file->open(path.c_str(), true)) { // a copy: hot reload means an editor may truncate it while we still use the pieces
+		cout << "failed to open: " << path << endl;
+		delete file;
+		return false;
+	}
+	mapped.push_back(file);
+	paths.push_back(path);
+	int index = (int)paths.size() - 1; // GLSL source string number, so errors point at the right file
+
+	if (depth > 0) { // included files count their lines from 1 again
+		lines.push_back("#line 1 " + to_string(index) + "\n");
+		add(lines.back().c_str(), lines.back().size());
+	}
+
+	const char * p = file->data;
+	const char * end = file->data + file->size;
+	const char * start = p; // beginning of the current run of plain lines
+	int line = 1;
+
+	while (p < end) {
+		const char * eol = (const char *)memchr(p, '\n', end - p);
+		const char * next = eol ? eol + 1 : end;
+		const char * q = p;
+		while (q < next && (*q == ' ' || *q == '\t')) q++; // directives can be indented
+
+		if (next - q > 8 && strncmp(q, "#include", 8) == 0) {
+			const char * open = (const char *)memchr(q, '"', next - q);
+			const char * close = open ? (const char *)memchr(open + 1, '"', next - open - 1) : NULL;
+			if (!close) {
+				cout << path << ":" << line << ": expected #include \"file\"" << endl;
+				return false;
+			}
+
+			add(start, p - start); // everything up to the #include line
+			if (!include(directoryOf(path) + string(open + 1, close), depth + 1)) {
+				return false;
+			}
+			lines.push_back("\n#line " + to_string(line + 1) + " " + to_string(index) + "\n"); // back in this file (the include may not end in a newline)
+			add(lines.back().c_str(), lines.back().size());
+			start = next; // skip the directive itself
+		}
+		p = next;
+		line++;
+	}
+	add(start, end - start);
+	return true;
+}
+
+void ShaderSource::pieces(const string & defines, vector<const char *> & outStrings, vector<int> & outLengths) const {
+	outStrings.clear();
+	outLengths.clear();
+	size_t first = 0;
+
+	if (!defines.empty()) { // #version has to stay the very first line
+		if (!strings.empty() && lengths[0] >= 8 && strncmp(strings[0], "#version", 8) == 0) {
+			const char * eol = (const char *)memchr(strings[0], '\n', lengths[0]);
+			int head = eol ? (int)(eol - strings[0]) + 1 : lengths[0];
+			outStrings.push_back(strings[0]);
+			outLengths.push_back(head);
+			outStrings.push_back(defines.c_str());
+			outLengths.push_back((int)defines.length());
+			if (head < lengths[0]) {
+				outStrings.push_back(strings[0] + head);
+				outLengths.push_back(lengths[0] - head);
+			}
+			first = 1;
+		}
+		else {
+			outStrings.push_back(defines.c_str());
+			outLengths.push_back((int)defines.length());
+		}
+	}
+	for (size_t i = first; i < strings.size(); i++) {
+		outStrings.push_back(strings[i]);
+		outLengths.push_back(lengths[i]);
+	}
+}
+
+static long long modificationTime(const string & path) { // 0 if the file is missing (mid save)
+#if defined(__unix__) || defined(unix)
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return 0;
+	return (long long)st.st_mtime;
+#else
+	struct _stat st;
+	if (_stat(path.c_str(), &st) != 0) return 0;
+	return (long long)st.st_mtime;
+#endif	// __unix__
+}
+
+static unsigned long now() { // ms, only used for spacing out polls
+	using namespace std::chrono;
+	return (unsigned long)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+FileWatcher::FileWatcher() : fd(-1), lastPoll(0) {
+#if defined(__linux__)
+	fd = inotify_init1(IN_NONBLOCK); // falls back to polling if this fails
+#endif	// __linux__
+}
+
+FileWatcher::~FileWatcher() {
+#if defined(__linux__)
+	if (fd >= 0) ::close(fd);
+#endif	// __linux__
+}
+
+void FileWatcher::watch(const vector<string> & list) {
+	files = list;
+	times.clear();
+	for (size_t i = 0; i < files.size(); i++) {
+		times.push_back(modificationTime(files[i]));
+	}
+
+#if defined(__linux__)
+	if (fd < 0) return;
+	for (size_t i = 0; i < dirs.size(); i++) {
+		inotify_rm_watch(fd, dirs[i]);
+	}
+	dirs.clear();
+	dirNames.clear();
+	for (size_t i = 0; i < files.size(); i++) { // watch directories, editors often save by replacing the file
+		string dir = directoryOf(files[i]);
+		bool seen = false;
+		for (size_t j = 0; j < dirNames.size(); j++) {
+			if (dirNames[j] == dir) seen = true;
+		}
+		if (seen) continue;
+		int wd = inotify_add_watch(fd, dir.empty() ? "." : dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd >= 0) {
+			dirs.push_back(wd);
+			dirNames.push_back(dir);
+		}
+	}
+#endif	// __linux__
+}
+
+bool FileWatcher::changed() {
+	bool hit = false;
+
+#if defined(__linux__)
+	if (fd >= 0) {
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t len;
+		while ((len = read(fd, buf, sizeof(buf))) > 0) { // drain everything, IN_NONBLOCK stops us at the end
+			for (char * p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+				struct inotify_event * ev = (struct inotify_event *)p;
+				if (ev->len == 0) continue;
+				for (size_t i = 0; i < dirs.size(); i++) {
+					if (dirs[i] != ev->wd) continue;
+					string name = dirNames[i] + ev->name;
+					for (size_t j = 0; j < files.size(); j++) {
+						if (files[j] == name) hit = true;
+					}
+				}
+			}
+		}
+		return hit;
+	}
+#endif	// __linux__
+
+	if (now() - lastPoll < POLL_INTERVAL) return false; // stat() on every frame is a waste
+	lastPoll = now();
+	for (size_t i = 0; i < files.size(); i++) {
+		long long t = modificationTime(files[i]);
+		if (t != 0 && t != times[i]) {
+			times[i] = t;
+			hit = true;
+		}
+	}
+	return hit;
+}
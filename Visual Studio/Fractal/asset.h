@@ -0,0 +1,57 @@
+#ifndef __ASSET_H__
+#define __ASSET_H__
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+
+class MappedFile { // read only view of a whole file, straight from the page cache (no copies), or a copy of it
+public:
+	MappedFile() : data(0), size(0), copied(false) {}
+	~MappedFile() { close(); }
+	// false if it can't be opened or mapped. copy: read it into memory instead, for files that may be
+	// truncated or rewritten while still in use (touching a mapping past the new end is a SIGBUS)
+	bool open(const char * path, bool copy = false);
+	void close();
+	const char * data; // the bytes, NOT null terminated
+	size_t size;
+private:
+	bool copied; // data is ours, from new[], rather than a view
+	bool read(const char * path);
+	MappedFile(const MappedFile &); // one mapping, one owner
+	MappedFile & operator=(const MappedFile &);
+};
+
+class ShaderSource { // a shader as a list of pieces of files, handed to glShaderSource as is
+public:
+	~ShaderSource() { clear(); }
+	bool load(const char * path); // read the file and everything it #includes
+	void clear();
+	// Pieces with a #define block spliced in after the #version line (defines may be empty)
+	void pieces(const std::string & defines, std::vector<const char *> & strings, std::vector<int> & lengths) const;
+	const std::vector<std::string> & files() const { return paths; } // every file it was built from
+private:
+	std::vector<MappedFile *> mapped;
+	std::deque<std::string> lines; // generated #line directives (a deque never moves its strings)
+	std::vector<const char *> strings;
+	std::vector<int> lengths;
+	std::vector<std::string> paths;
+	bool include(const std::string & path, int depth); // append one file's pieces, expanding #include "file"
+	void add(const char * s, size_t len);
+};
+
+class FileWatcher { // notices when files change on disk (inotify on linux, modification times elsewhere)
+public:
+	FileWatcher();
+	~FileWatcher();
+	void watch(const std::vector<std::string> & files); // replaces the previous list
+	bool changed(); // true once for every batch of changes, never blocks
+private:
+	std::vector<std::string> files;
+	std::vector<long long> times; // last seen modification times (polling fallback)
+	std::vector<int> dirs; // inotify watch descriptors
+	std::vector<std::string> dirNames; // directory for each watch descriptor
+	int fd; // inotify instance, -1 if we are polling
+	unsigned long lastPoll;
+};
+#endif
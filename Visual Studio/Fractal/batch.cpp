@@ -0,0 +1,82 @@
+/** batch.cpp
+ * Entry point for unix builds, which have no launcher GUI.
+ * With --render it draws a single frame offscreen (no display needed) for batch jobs,
+ * or with --render ... --cpu on the CPU alone (no GL at all),
+ * --mesh writes the 3D fractal's surface out as triangles (also no GL),
+ * otherwise it opens the fractal window just like the launcher's start button (on the 3D fractal with --3d),
+ * recording it from the first frame with --capture out.y4m (or - to pipe it into an encoder)
+ * and mapping --texture image.png into the orbit trap.
+ */
+#if defined(__unix__) || defined(unix)
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "Fractals.h"
+
+using namespace std;
+
+static const char * renderUsage = // after "--render out.ppm width height"
+	"  --3d [type]                 the 3D fractal on the GPU (type 0-5, or its default)\n"
+	"  --cpu [type]                the 3D fractal on the CPU, no GL at all\n"
+	"  scalar                      CPU: one ray at a time instead of SIMD packets\n"
+	"  fdnormals | dualnormals     CPU: central difference or dual number normals for every type\n"
+	"  normals                     CPU: compare the two kinds of normal first\n"
+	"  nocone                      every ray from the bounding sphere, no cone pre-pass\n"
+	"  fly frames                  GPU 3D: then time frames with the camera moving\n"
+	"  noreproject                 march those in full instead of reprojecting\n"
+	"  relight frames              GPU 3D: then time frames where only the light moves\n"
+	"  nodeferred                  march those in full instead of shading the G-buffer again\n"
+	"  grid                        bake the distance grid first and march through it\n"
+	"  ao divisor                  ambient occlusion at 1/2 or 1/4 resolution\n"
+	"  accumulate samples [noise]  add still frames up until they converge\n";
+
+int main(int argc, char ** argv) {
+	if (argc > 1 && strcmp(argv[1], "--render") == 0) { // fractal --render out.ppm 1920 1080 [options], see renderUsage
+		if (argc < 5 || atoi(argv[3]) <= 0 || atoi(argv[4]) <= 0) {
+			cout << "usage: " << argv[0] << " --render out.ppm width height [options]" << endl << renderUsage;
+			return -1;
+		}
+		RenderOptions options;
+		for (int i = 5; i < argc; i++) {
+			if (strcmp(argv[i], "scalar") == 0) options.packets = false; // to compare against the packets
+			if (strcmp(argv[i], "fdnormals") == 0) options.dualNormals = 0; // as the shader does
+			if (strcmp(argv[i], "dualnormals") == 0) options.dualNormals = 1;
+			if (strcmp(argv[i], "normals") == 0) options.checkNormals = true;
+			if (strcmp(argv[i], "nocone") == 0) setCones(false);
+			if (strcmp(argv[i], "fly") == 0 && i + 1 < argc) options.moves = atoi(argv[i + 1]);
+			if (strcmp(argv[i], "noreproject") == 0) setReprojection(false);
+			if (strcmp(argv[i], "grid") == 0) setGrid(true);
+			if (strcmp(argv[i], "relight") == 0 && i + 1 < argc) options.relights = atoi(argv[i + 1]);
+			if (strcmp(argv[i], "nodeferred") == 0) setDeferred(false);
+			if (strcmp(argv[i], "accumulate") == 0 && i + 1 < argc) {
+				bool noise = i + 2 < argc && isdigit(argv[i + 2][0]); // optional
+				setAccumulation(atoi(argv[i + 1]), noise ? (float)atof(argv[i + 2]) : -1.0f);
+			}
+			if (strcmp(argv[i], "ao") == 0 && i + 1 < argc) setAoResolution(atoi(argv[i + 1]));
+		}
+		options.type = argc > 6 && isdigit(argv[6][0]) ? atoi(argv[6]) : -1; // after --3d or --cpu
+		if (argc > 5 && strcmp(argv[5], "--cpu") == 0) { // 3D on the CPU, no GL needed at all
+			return renderCpu(argv[2], atoi(argv[3]), atoi(argv[4]), options);
+		}
+		options.threeD = argc > 5 && strcmp(argv[5], "--3d") == 0;
+		return renderOffscreen(argv[2], atoi(argv[3]), atoi(argv[4]), options);
+	}
+	if (argc > 1 && strcmp(argv[1], "--mesh") == 0) { // fractal --mesh out.ply 512 [type]
+		if (argc < 4 || atoi(argv[3]) <= 0) {
+			cout << "usage: " << argv[0] << " --mesh out.ply|out.stl resolution [type]" << endl;
+			return -1;
+		}
+		return exportMesh(argv[2], atoi(argv[3]), argc > 4 ? atoi(argv[4]) : -1);
+	}
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--3d") == 0) setThreeD(true); // fractal --3d
+		if (i + 1 < argc && strcmp(argv[i], "--capture") == 0) setCapture(argv[i + 1]); // fractal --capture - | ffmpeg -i - out.mp4
+		if (i + 1 < argc && strcmp(argv[i], "--texture") == 0) setTexture(argv[i + 1]); // fractal --texture flower.png
+	}
+	startFractal();
+	return 0;
+}
+
+#endif	// __unix__
@@ -0,0 +1,12 @@
+/**
+ * Uniforms and helpers shared by the 2D and 3D fractal shaders.
+ * Pulled in with #include "common.glsl", which the loader expands (GLSL has no #include of its own).
+ */
+
+uniform bool  antialiasingOn;
+uniform bool  transparent;          // {"label":"Transparent background", "default":false, "group":"Colour"}
+uniform float gamma;                // {"label":"Gamma correction", "default":1, "min":0.1, "max":2, "step":0.01, "group":"Colour"}
+uniform vec2  size;                 // {"default":[400, 300]}
+uniform vec2  outputSize;           // {"default":[800, 600]}
+
+float aspectRatio = outputSize.x / outputSize.y;
@@ -0,0 +1,159 @@
+/** frametime.cpp
+ * Measuring how long frames take on the GPU, and trading resolution for speed
+ * while the user is moving around. Cost is close to proportional to the number
+ * of pixels, so each measurement gives an estimate of the full resolution cost,
+ * and from that the largest scale that still fits in the target frame time.
+ * When even a quarter of the resolution isn't enough, QualityGovernor starts
+ * giving up shader quality as well, a level at a time, and hands it all back
+ * the moment the view is still.
+ */
+#include <cmath>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+#include "util.h"
+#include "frametime.h"
+
+GpuTimer::GpuTimer() : head(0), count(0), running(false) {
+	glGenQueries(TIMER_QUERIES * 2, queries[0]);
+}
+
+GpuTimer::~GpuTimer() {
+	glDeleteQueries(TIMER_QUERIES * 2, queries[0]);
+}
+
+void GpuTimer::begin(float tag) {
+	if (count == TIMER_QUERIES) return; // nobody is reading results, skip rather than wait
+	int i = (head + count) % TIMER_QUERIES;
+	tags[i] = tag;
+	glQueryCounter(queries[i][0], GL_TIMESTAMP);
+	running = true;
+}
+
+void GpuTimer::end() {
+	if (!running) return;
+	glQueryCounter(queries[(head + count) % TIMER_QUERIES][1], GL_TIMESTAMP);
+	running = false;
+	count++;
+}
+
+bool GpuTimer::result(float * ms, float * tag) {
+	GLint available = 0;
+	GLuint64 from = 0, to = 0;
+
+	if (count == 0) return false;
+	glGetQueryObjectiv(queries[head][1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return false; // still in flight, asking for the result now would stall
+	glGetQueryObjectui64v(queries[head][0], GL_QUERY_RESULT, &from); // done too, it went in before
+	glGetQueryObjectui64v(queries[head][1], GL_QUERY_RESULT, &to);
+	*ms = (to - from) / 1000000.0f;
+	*tag = tags[head];
+	head = (head + 1) % TIMER_QUERIES;
+	count--;
+	return true;
+}
+
+void ResolutionScaler::interact() {
+	lastInput = get_msec();
+	moving = true;
+}
+
+bool ResolutionScaler::interacting() {
+	if (moving && get_msec() - lastInput > SETTLE_MS) moving = false; // settled: the next frame is full resolution
+	return moving;
+}
+
+bool ResolutionScaler::reduced() {
+	return interacting() && current < 1.0f;
+}
+
+void ResolutionScaler::measured(float ms, float atScale) {
+	if (ms <= 0.0f || ms > 1000.0f || atScale <= 0.0f) return; // over a second is a stall (or a bogus first query), not a cost
+	float cost = ms / (atScale * atScale); // what it would have taken at full resolution
+	fullCost = fullCost > 0.0f ? fullCost * 0.7f + cost * 0.3f : cost; // smoothed, one slow frame shouldn't jolt it
+
+	float wanted = sqrtf(target / fullCost);
+	if (wanted > 1.0f) wanted = 1.0f;
+	if (wanted < MIN_RENDER_SCALE) wanted = MIN_RENDER_SCALE;
+	wanted = floorf(wanted / RENDER_SCALE_STEP + 0.001f) * RENDER_SCALE_STEP; // round down, better a bit fast than a bit slow
+	if (wanted < MIN_RENDER_SCALE) wanted = MIN_RENDER_SCALE;
+	current = wanted;
+}
+
+struct QualityLevel { // fractions of the user's settings
+	float iterations, steps, ao;
+	int aa; // 1 keeps the user's anti-aliasing, 2 halves its density each way, 0 turns it off
+};
+
+static const QualityLevel levels[QUALITY_LEVELS] = {
+	{ 1.0f, 1.0f, 1.0f, 1 }, // the user's own
+	{ 1.0f, 1.0f, 1.0f, 2 }, // anti-aliasing is the most expensive thing and the least missed while moving
+	{ 1.0f, 1.0f, 0.5f, 0 },
+	{ 0.75f, 0.75f, 0.5f, 0 },
+	{ 0.5f, 0.5f, 0.25f, 0 },
+	{ 0.35f, 0.35f, 0.0f, 0 },
+};
+
+void QualityGovernor::change(int to) {
+	level = to;
+	over = under = 0;
+	ignore = TIMER_QUERIES; // what is still in flight was drawn at the old level
+	scaler->reset(); // and the old cost estimate is no good either
+}
+
+void QualityGovernor::measured(float ms, float atScale) {
+	if (ignore > 0) {
+		ignore--;
+		return;
+	}
+	scaler->measured(ms, atScale);
+	if (!scaler->interacting()) return; // static frames are always the user's settings
+
+	if (scaler->scale() < DOWN_SCALE && level < QUALITY_LEVELS - 1) { // resolution alone would go blurry
+		under = 0;
+		if (++over >= DOWN_FRAMES) change(level + 1);
+	}
+	else if (scaler->scale() >= 1.0f && scaler->estimate() < scaler->target * UP_COST && level > 0) { // lots of room
+		over = 0;
+		if (++under >= UP_FRAMES) change(level - 1);
+	}
+	else {
+		over = under = 0; // in between: leave it alone, that gap is the hysteresis
+	}
+}
+
+void QualityGovernor::apply(Shader * shader, bool moving) {
+	if (!moving) {
+		if (level != 0) change(0); // still: the user's maximum quality, straight away
+		return;
+	}
+	if (level == 0) return;
+
+	const QualityLevel & q = levels[level];
+	iterations = shader->get_uniform1i("maxIterations");
+	steps = shader->get_uniform1i("stepLimit");
+	ao = shader->get_uniform1i("aoIterations");
+	aaOn = shader->get_uniform1i("antialiasingOn");
+	aa = shader->get_uniform1f("antialiasing");
+
+	shader->set_uniform1i("maxIterations", (int)(iterations * q.iterations) > 1 ? (int)(iterations * q.iterations) : 1);
+	if (shader->has_uniform("stepLimit")) shader->set_uniform1i("stepLimit", (int)(steps * q.steps) > 10 ? (int)(steps * q.steps) : 10); // 3D only
+	if (shader->has_uniform("aoIterations")) shader->set_uniform1i("aoIterations", (int)(ao * q.ao));
+	if (aaOn && q.aa == 0) shader->set_uniform1i("antialiasingOn", 0);
+	if (aaOn && q.aa == 2) shader->set_uniform1f("antialiasing", aa * 2.0f < 1.0f ? aa * 2.0f : 1.0f); // it is the sample spacing
+	shader->flush();
+	applied = true;
+}
+
+void QualityGovernor::restore(Shader * shader) {
+	if (!applied) return;
+	shader->set_uniform1i("maxIterations", iterations);
+	if (shader->has_uniform("stepLimit")) shader->set_uniform1i("stepLimit", steps);
+	if (shader->has_uniform("aoIterations")) shader->set_uniform1i("aoIterations", ao);
+	shader->set_uniform1i("antialiasingOn", aaOn);
+	shader->set_uniform1f("antialiasing", aa);
+	applied = false; // sent with the next flush
+}
@@ -0,0 +1,68 @@
+#ifndef __FRAMETIME_H__
+#define __FRAMETIME_H__
+
+#define TIMER_QUERIES 4 // results arrive a frame or two late, keep enough queries in flight not to wait for one
+#define TARGET_FRAME_MS 16.7f // 60 fps while interacting
+#define MIN_RENDER_SCALE 0.25f // never below 1/4 of the window in each direction
+#define RENDER_SCALE_STEP 0.05f // scales are rounded to this, so the render target isn't reallocated every frame
+#define SETTLE_MS 150 // no input for this long and we go back to full resolution
+#define QUALITY_LEVELS 6 // 0 is the user's own settings, each level after gives up a bit more
+#define DOWN_SCALE 0.5f // resolution alone would have to drop below this: lower the quality a level
+#define DOWN_FRAMES 3 // ...for this many measurements in a row
+#define UP_COST 0.5f // a full resolution frame takes less than this much of the target: raise it a level
+#define UP_FRAMES 20 // ...for this many in a row, slower up than down so it doesn't flip back and forth
+
+class Shader;
+
+class GpuTimer { // GPU time of a block of draw calls, between two GL_TIMESTAMP queries that are never waited on
+                 // (unlike GL_TIME_ELAPSED, one timer's block can sit inside another's)
+public:
+	GpuTimer();
+	~GpuTimer();
+	void begin(float tag = 0.0f); // tag comes back with the result (e.g. the scale it was drawn at)
+	void end();
+	bool result(float * ms, float * tag); // oldest finished measurement, false if nothing is ready yet
+private:
+	GLuint queries[TIMER_QUERIES][2]; // the start and end stamps
+	float tags[TIMER_QUERIES];
+	int head, count; // oldest query in flight, and how many
+	bool running;
+};
+
+class ResolutionScaler { // picks an internal resolution that holds the target frame time while the view is moving
+public:
+	ResolutionScaler(float targetMs = TARGET_FRAME_MS) : target(targetMs), current(1.0f), fullCost(0.0f), lastInput(0), moving(false) {}
+	void interact(); // input that changes the picture (camera moves, drags, zooms)
+	bool interacting(); // had input recently? false once it has settled
+	bool reduced(); // render below window resolution this frame?
+	float scale() const { return current; } // fraction of the window size in each direction
+	float estimate() const { return fullCost; } // ms for a full resolution frame, 0 if unknown
+	void measured(float ms, float atScale); // a GPU time, and the scale it was rendered at
+	void reset() { fullCost = 0.0f; } // the cost changed (different quality settings), keep the scale until we know more
+	float target; // ms per frame
+private:
+	float current;
+	float fullCost; // estimated ms for a full resolution frame (0 == no idea yet)
+	unsigned long lastInput;
+	bool moving;
+};
+
+class QualityGovernor { // lowers iterations, steps, AO and anti-aliasing while moving, when resolution alone isn't enough
+public:
+	QualityGovernor(ResolutionScaler * scaler) : scaler(scaler), level(0), ignore(0), over(0), under(0), applied(false) {}
+	void measured(float ms, float atScale); // instead of scaler->measured(), decides the level as well
+	void apply(Shader * shader, bool moving); // before drawing: swap in this level's settings (the user's own once static)
+	void restore(Shader * shader); // after drawing: the user's settings go back, so keys and the text always see those
+	int current() const { return level; }
+	int userIterations(int marched) const { return applied ? iterations : marched; } // the user's maxIterations while apply() has them lowered
+private:
+	ResolutionScaler * scaler; // does the resolution part, we step in when it runs out of room
+	int level;
+	int ignore; // measurements still in flight from before the last level change
+	int over, under; // measurements in a row asking for a lower / higher level
+	bool applied;
+	int iterations, steps, ao, aaOn; // the user's settings while ours are in
+	float aa;
+	void change(int to);
+};
+#endif
@@ -0,0 +1,192 @@
+/** headless.cpp
+ * OpenGL without a window: a surfaceless EGL context (Mesa llvmpipe is fine, no GPU
+ * or display needed), or OSMesa when built with USE_OSMESA. Everything is drawn into
+ * framebuffer objects, so no default framebuffer is ever used.
+ * On windows there is no surfaceless path, so it falls back to a hidden freeglut window.
+ */
+#include <cstring>
+#include <iostream>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+#if defined(__unix__) || defined(unix)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifdef USE_OSMESA
+#include <GL/osmesa.h>
+#endif	// USE_OSMESA
+#else	// assume windows
+#include <GL/freeglut.h>
+#endif	// __unix__
+
+#include "headless.h"
+
+using namespace std;
+
+#if defined(__unix__) || defined(unix)
+
+HeadlessContext::HeadlessContext() : name("none"), display(0), context(0), osmesa(0), osmesaBuffer(0) {}
+
+static bool hasExtension(const char * list, const char * ext) { // whole word match in an extension string
+	size_t len = strlen(ext);
+	for (const char * p = list; p && (p = strstr(p, ext)); p += len) {
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == 0)) return true;
+	}
+	return false;
+}
+
+bool HeadlessContext::createEGL() {
+	const char * clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS); // null without EGL 1.5 / EXT_client_extensions
+	EGLDisplay dpy = EGL_NO_DISPLAY;
+	EGLint major, minor, count = 0;
+	EGLConfig config = 0;
+
+	if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) { // no X, no wayland, no DRM device needed
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay) dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (dpy == EGL_NO_DISPLAY) dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor)) {
+		cout << "headless: no EGL display" << endl;
+		return false;
+	}
+	display = dpy;
+
+	if (!hasExtension(eglQueryString(dpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		cout << "headless: EGL " << major << "." << minor << " can't make a context current without a surface" << endl;
+		destroy();
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) { // desktop GL, not GLES
+		cout << "headless: EGL has no desktop OpenGL" << endl;
+		destroy();
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	eglChooseConfig(dpy, configAttribs, &config, 1, &count);
+	if (count == 0 && !hasExtension(eglQueryString(dpy, EGL_EXTENSIONS), "EGL_KHR_no_config_context")) {
+		cout << "headless: no EGL config for OpenGL" << endl;
+		destroy();
+		return false;
+	}
+
+	const EGLint contextAttribs[] = { // the same version our shaders are written against
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR, // the shaders still use gl_FragColor
+		EGL_NONE
+	};
+	EGLContext ctx = eglCreateContext(dpy, count ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+	if (ctx == EGL_NO_CONTEXT) {
+		cout << "headless: couldn't create an OpenGL 3.3 context (EGL error 0x" << hex << eglGetError() << dec << ")" << endl;
+		destroy();
+		return false;
+	}
+	context = ctx;
+
+	if (!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+		cout << "headless: eglMakeCurrent failed" << endl;
+		destroy();
+		return false;
+	}
+	name = "EGL";
+	return true;
+}
+
+bool HeadlessContext::createOSMesa() {
+#ifdef USE_OSMESA
+	const int attribs[] = {
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 0,
+		OSMESA_CONTEXT_MAJOR_VERSION, 3,
+		OSMESA_CONTEXT_MINOR_VERSION, 3,
+		OSMESA_PROFILE, OSMESA_COMPAT_PROFILE,
+		0
+	};
+	OSMesaContext ctx = OSMesaCreateContextAttribs(attribs, NULL);
+	if (!ctx) {
+		cout << "headless: couldn't create an OSMesa context" << endl;
+		return false;
+	}
+	osmesa = ctx;
+	osmesaBuffer = new unsigned char[4];
+	if (!OSMesaMakeCurrent(ctx, osmesaBuffer, GL_UNSIGNED_BYTE, 1, 1)) {
+		cout << "headless: OSMesaMakeCurrent failed" << endl;
+		destroy();
+		return false;
+	}
+	name = "OSMesa";
+	return true;
+#else
+	return false; // not built in
+#endif	// USE_OSMESA
+}
+
+bool HeadlessContext::create() {
+	if (!createEGL() && !createOSMesa()) {
+		cout << "headless: no offscreen OpenGL available" << endl;
+		return false;
+	}
+
+	glewExperimental = GL_TRUE;
+	GLenum error = glewInit(); // a GLX build of GLEW complains there is no GLX display, after loading everything
+	if (error != GLEW_OK && !glGenFramebuffers) {
+		cout << "headless: failed to initialize GLEW: " << glewGetErrorString(error) << endl;
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void HeadlessContext::destroy() {
+	if (display) {
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context) eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		eglTerminate((EGLDisplay)display);
+	}
+#ifdef USE_OSMESA
+	if (osmesa) OSMesaDestroyContext((OSMesaContext)osmesa);
+#endif	// USE_OSMESA
+	delete[] osmesaBuffer;
+	display = context = osmesa = 0;
+	osmesaBuffer = 0;
+	name = "none";
+}
+
+#else	// assume windows
+
+HeadlessContext::HeadlessContext() : name("none"), window(0) {}
+
+bool HeadlessContext::create() {
+	int argc = 0;
+	char ** argv = NULL;
+
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_RGBA);
+	glutInitWindowSize(1, 1);
+	window = glutCreateWindow("Fractal (offscreen)");
+	glutHideWindow(); // only here for its context
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK) {
+		cout << "headless: failed to initialize GLEW" << endl;
+		destroy();
+		return false;
+	}
+	name = "hidden window";
+	return true;
+}
+
+void HeadlessContext::destroy() {
+	if (window) glutDestroyWindow(window);
+	window = 0;
+	name = "none";
+}
+
+#endif	// __unix__
@@ -0,0 +1,26 @@
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+class HeadlessContext { // an OpenGL 3.3 context with no window, for batch rendering on machines without a display
+public:
+	HeadlessContext();
+	~HeadlessContext() { destroy(); }
+	bool create(); // makes it current and loads GLEW, false (and prints why) if nothing worked
+	void destroy();
+	const char * backend() const { return name; } // which one we ended up with
+private:
+	const char * name;
+#if defined(__unix__) || defined(unix)
+	void * display; // EGLDisplay, void * so nobody else needs the EGL headers
+	void * context; // EGLContext
+	void * osmesa; // OSMesaContext (only with USE_OSMESA)
+	unsigned char * osmesaBuffer; // OSMesa insists on a default framebuffer, we draw to FBOs anyway
+	bool createEGL();
+	bool createOSMesa();
+#else	// assume windows
+	int window; // hidden freeglut window, there is no surfaceless path there
+#endif	// __unix__
+	HeadlessContext(const HeadlessContext &); // one context, one owner
+	HeadlessContext & operator=(const HeadlessContext &);
+};
+#endif
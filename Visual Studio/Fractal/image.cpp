@@ -0,0 +1,367 @@
+/** image.cpp
+ * Netpbm (ppm/pgm) decoding straight out of a memory mapped file.
+ * The header is parsed once, then the pixel payload is converted in bulk,
+ * 16 pixels per step with SSSE3/SSE2 when the compiler allows it.
+ */
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(__SSSE3__) || defined(__AVX__) // MSVC only tells us about AVX, which implies SSSE3
+#include <tmmintrin.h>
+#define PNM_SSSE3
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PNM_SSE2
+#endif
+
+#include <SOIL.h>
+
+#include "asset.h"
+#include "image.h"
+
+using namespace std;
+
+static const char * skipSpace(const char * p, const char * end) { // whitespace and # comments
+	while (p < end) {
+		if (*p == '#') {
+			while (p < end && *p != '\n' && *p != '\r') p++;
+		}
+		else if (isspace((unsigned char)*p)) {
+			p++;
+		}
+		else {
+			break;
+		}
+	}
+	return p;
+}
+
+static bool readNumber(const char *& p, const char * end, unsigned long & out) {
+	p = skipSpace(p, end);
+	if (p >= end || !isdigit((unsigned char)*p)) return false;
+	out = 0;
+	while (p < end && isdigit((unsigned char)*p)) {
+		unsigned long d = (unsigned long)(*p++ - '0');
+		if (out > (ULONG_MAX - d) / 10) return false; // would wrap, nothing sane is this big
+		out = out * 10 + d;
+	}
+	return true;
+}
+
+static void rgb_to_bgra(const uint8_t * src, uint8_t * dst, size_t count) { // 8 bit, maxval 255
+	size_t i = 0;
+#ifdef PNM_SSSE3
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1); // -1 zeroes the byte
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+	for (; i + 16 <= count; i += 16) { // 48 bytes in, 64 bytes out, never reads past the payload
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i * 3));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i * 3 + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + i * 3 + 32));
+		__m128i p0 = a; // pixels 0-3 (and a bit of 4)
+		__m128i p1 = _mm_alignr_epi8(b, a, 12); // pixels 4-7 start at byte 12
+		__m128i p2 = _mm_alignr_epi8(c, b, 8); // pixels 8-11 at byte 24
+		__m128i p3 = _mm_srli_si128(c, 4); // pixels 12-15 at byte 36
+		_mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(p0, mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 16), _mm_or_si128(_mm_shuffle_epi8(p1, mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 32), _mm_or_si128(_mm_shuffle_epi8(p2, mask), alpha));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 48), _mm_or_si128(_mm_shuffle_epi8(p3, mask), alpha));
+	}
+#endif	// PNM_SSSE3
+	for (; i < count; i++) {
+		dst[i * 4 + 0] = src[i * 3 + 2];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 0];
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+static void gray_to_bgra(const uint8_t * src, uint8_t * dst, size_t count) { // 8 bit, maxval 255
+	size_t i = 0;
+#ifdef PNM_SSE2
+	const __m128i ones = _mm_set1_epi8((char)0xff);
+	for (; i + 16 <= count; i += 16) {
+		__m128i g = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i ggLo = _mm_unpacklo_epi8(g, g); // g0 g0 g1 g1 ...
+		__m128i ggHi = _mm_unpackhi_epi8(g, g);
+		__m128i gaLo = _mm_unpacklo_epi8(g, ones); // g0 ff g1 ff ...
+		__m128i gaHi = _mm_unpackhi_epi8(g, ones);
+		_mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi16(ggLo, gaLo)); // g0 g0 g0 ff ...
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 16), _mm_unpackhi_epi16(ggLo, gaLo));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 32), _mm_unpacklo_epi16(ggHi, gaHi));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 48), _mm_unpackhi_epi16(ggHi, gaHi));
+	}
+#endif	// PNM_SSE2
+	for (; i < count; i++) {
+		dst[i * 4 + 0] = dst[i * 4 + 1] = dst[i * 4 + 2] = src[i];
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+static inline uint8_t scale(unsigned long v, unsigned long maxval) { // 0..maxval -> 0..255, rounded
+	return (uint8_t)((v * 255 + maxval / 2) / maxval);
+}
+
+uint32_t * decode_pnm(const char * data, size_t size, unsigned long * xsz, unsigned long * ysz) {
+	const char * p = data;
+	const char * end = data + size;
+	unsigned long w, h, maxval;
+	int channels;
+	bool ascii;
+
+	if (size < 2 || p[0] != 'P' || p[1] < '2' || p[1] > '6' || p[1] == '4') {
+		cout << "load_pnm: not a P2, P3, P5 or P6 image" << endl;
+		return 0;
+	}
+	ascii = p[1] == '2' || p[1] == '3';
+	channels = (p[1] == '3' || p[1] == '6') ? 3 : 1;
+	p += 2;
+
+	if (!readNumber(p, end, w) || !readNumber(p, end, h) || w == 0 || h == 0) {
+		cout << "load_pnm: invalid size" << endl;
+		return 0;
+	}
+	if (!readNumber(p, end, maxval) || maxval == 0 || maxval > 65535) {
+		cout << "load_pnm: invalid max value" << endl;
+		return 0;
+	}
+	if ((uint64_t)w * h > (1ULL << 28)) { // 1GB of pixels, surely a broken header
+		cout << "load_pnm: image too large: " << w << "x" << h << endl;
+		return 0;
+	}
+
+	size_t count = (size_t)w * h;
+	uint32_t * pixels = new (nothrow) uint32_t[count];
+	if (!pixels) {
+		cout << "load_pnm: out of memory" << endl;
+		return 0;
+	}
+	uint8_t * dst = (uint8_t *)pixels;
+
+	if (ascii) { // P2/P3: one number at a time, there is no shortcut
+		unsigned long v[3];
+		for (size_t i = 0; i < count; i++) {
+			for (int c = 0; c < channels; c++) {
+				if (!readNumber(p, end, v[c]) || v[c] > maxval) {
+					cout << "load_pnm: bad or missing sample " << i << endl;
+					delete[] pixels;
+					return 0;
+				}
+			}
+			dst[i * 4 + 0] = scale(v[channels - 1], maxval);
+			dst[i * 4 + 1] = scale(v[channels == 3 ? 1 : 0], maxval);
+			dst[i * 4 + 2] = scale(v[0], maxval);
+			dst[i * 4 + 3] = 0xff;
+		}
+	}
+	else {
+		size_t sampleBytes = maxval > 255 ? 2 : 1;
+		size_t payload = count * channels * sampleBytes;
+		p++; // exactly one whitespace character ends the header
+		if (p > end || (size_t)(end - p) < payload) {
+			cout << "load_pnm: truncated pixel data" << endl;
+			delete[] pixels;
+			return 0;
+		}
+		const uint8_t * src = (const uint8_t *)p;
+
+		if (maxval == 255) { // the common case, straight through the SIMD paths
+			if (channels == 3) rgb_to_bgra(src, dst, count);
+			else gray_to_bgra(src, dst, count);
+		}
+		else {
+			uint8_t lut[256]; // 8 bit samples with an odd maxval
+			if (sampleBytes == 1) {
+				for (unsigned long v = 0; v < 256; v++) lut[v] = v > maxval ? 0xff : scale(v, maxval);
+			}
+			for (size_t i = 0; i < count; i++) {
+				uint8_t s[3];
+				for (int c = 0; c < channels; c++) {
+					if (sampleBytes == 1) {
+						s[c] = lut[*src++];
+					}
+					else { // 16 bit samples are big endian
+						unsigned long v = ((unsigned long)src[0] << 8) | src[1];
+						s[c] = v > maxval ? 0xff : scale(v, maxval);
+						src += 2;
+					}
+				}
+				dst[i * 4 + 0] = s[channels - 1];
+				dst[i * 4 + 1] = s[channels == 3 ? 1 : 0];
+				dst[i * 4 + 2] = s[0];
+				dst[i * 4 + 3] = 0xff;
+			}
+		}
+	}
+
+	if (xsz) *xsz = w;
+	if (ysz) *ysz = h;
+	return pixels;
+}
+
+uint32_t * load_pnm(const char * path, unsigned long * xsz, unsigned long * ysz) {
+	MappedFile file; // the pixels are read straight from the page cache
+	if (!file.open(path)) {
+		cout << "failed to open: " << path << endl;
+		return 0;
+	}
+	return decode_pnm(file.data, file.size, xsz, ysz);
+}
+
+bool decode_image(const char * path, DecodedImage & image) {
+	const char * ext = strrchr(path, '.');
+	image.pixels = 0;
+	image.width = image.height = 0;
+
+	if (ext && (strcmp(ext, ".ppm") == 0 || strcmp(ext, ".pgm") == 0 || strcmp(ext, ".pnm") == 0)) {
+		image.pixels = (uint8_t *)load_pnm(path, &image.width, &image.height);
+		image.bgra = true;
+		image.soil = false;
+	}
+	else {
+		int width, height;
+		image.pixels = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGBA); // no GL calls, fine on any thread
+		image.width = width;
+		image.height = height;
+		image.bgra = false;
+		image.soil = true;
+		if (!image.pixels) cout << "failed to load: " << path << endl;
+	}
+	return image.pixels != 0;
+}
+
+void free_image(DecodedImage & image) {
+	if (image.soil) SOIL_free_image_data(image.pixels);
+	else delete[] (uint32_t *)image.pixels;
+	image.pixels = 0;
+}
+
+bool save_ppm(const char * path, unsigned long width, unsigned long height, const uint8_t * rgba, bool bottomUp) {
+	ofstream out(path, ios::binary);
+	if (!out) {
+		cout << "failed to open: " << path << endl;
+		return false;
+	}
+	out << "P6\n" << width << " " << height << "\n255\n";
+
+	char * row = new char[width * 3];
+	for (unsigned long y = 0; y < height; y++) {
+		const uint8_t * src = rgba + (bottomUp ? height - 1 - y : y) * width * 4;
+		for (unsigned long x = 0; x < width; x++) {
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+		out.write(row, width * 3);
+	}
+	delete[] row;
+	return (bool)out;
+}
+
+// The loader this replaced: ifstream, one fp.get() per byte. Only kept so the benchmark has a baseline.
+static int read_to_wspace(ifstream & fp, char * buf, int bsize) {
+	int count = 0;
+	char c;
+
+	while (fp.get(c) && !isspace(c) && count < bsize - 1) {
+		if (c == '#') {
+			while (fp.get(c) && c != '\n' && c != '\r');
+			c = fp.get();
+			if (c == '\n' || c == '\r') continue;
+		}
+		*buf++ = c;
+		count++;
+	}
+	*buf = 0;
+
+	while (fp.get(c) && isspace(c));
+	fp.putback(c);
+	return count;
+}
+
+static uint32_t * load_ppm_stream(const char * path, unsigned long * xsz, unsigned long * ysz) { // P6, maxval 255 only
+	ifstream fp(path, ios::binary);
+	char buf[64];
+	unsigned int w, h;
+
+	if (!fp.is_open() || read_to_wspace(fp, buf, 64) == 0 || strcmp(buf, "P6") != 0) return 0;
+	if (read_to_wspace(fp, buf, 64) == 0 || !isdigit(*buf)) return 0;
+	w = atoi(buf);
+	if (read_to_wspace(fp, buf, 64) == 0 || !isdigit(*buf)) return 0;
+	h = atoi(buf);
+	if (read_to_wspace(fp, buf, 64) == 0 || atoi(buf) != 255) return 0;
+
+	uint32_t * pixels = new uint32_t[w * h];
+	for (unsigned int i = 0; i < w * h; i++) {
+		int r = fp.get();
+		int g = fp.get();
+		int b = fp.get();
+
+		if (r == -1 || g == -1 || b == -1) {
+			delete[] pixels;
+			return 0;
+		}
+		pixels[i] = (r << 16) | (g << 8) | b; // what PACK_COLOR24 gave on little endian
+	}
+	if (xsz) *xsz = w;
+	if (ysz) *ysz = h;
+	return pixels;
+}
+
+string benchmark_pnm(const char * path, int runs) {
+	typedef chrono::high_resolution_clock clock;
+	ostringstream report;
+	unsigned long w = 0, h = 0;
+	double oldMs = 0, newMs = 0;
+	bool same = true;
+
+	if (runs < 1) runs = 1;
+	uint32_t * reference = load_pnm(path, &w, &h); // warms the page cache too
+	if (!reference) {
+		report << path << ": can't be loaded" << endl;
+		return report.str();
+	}
+
+	for (int i = 0; i < runs; i++) {
+		clock::time_point start = clock::now();
+		uint32_t * pixels = load_pnm(path, 0, 0);
+		newMs += chrono::duration<double, milli>(clock::now() - start).count();
+		delete[] pixels;
+	}
+
+	for (int i = 0; i < runs; i++) {
+		clock::time_point start = clock::now();
+		uint32_t * pixels = load_ppm_stream(path, 0, 0);
+		oldMs += chrono::duration<double, milli>(clock::now() - start).count();
+		if (!pixels) { // the old loader only ever understood 8 bit P6
+			oldMs = -1;
+			break;
+		}
+		if (i == 0) { // same pixels, apart from the alpha the old loader never set
+			const uint8_t * bgra = (const uint8_t *)reference;
+			for (unsigned long j = 0; j < w * h && same; j++) {
+				same = pixels[j] == (uint32_t)((bgra[j * 4 + 2] << 16) | (bgra[j * 4 + 1] << 8) | bgra[j * 4]);
+			}
+		}
+		delete[] pixels;
+	}
+	delete[] reference;
+
+	double megapixels = (double)w * h / 1e6;
+	report << path << ": " << w << "x" << h << ", " << runs << " runs" << endl;
+	report << "  load_pnm (mapped): " << newMs / runs << " ms, " << megapixels * runs / (newMs / 1000) << " Mpixel/s" << endl;
+	if (oldMs >= 0) {
+		report << "  load_ppm (ifstream): " << oldMs / runs << " ms, " << megapixels * runs / (oldMs / 1000) << " Mpixel/s" << endl;
+		report << "  speedup: " << oldMs / newMs << "x, output " << (same ? "matches" : "DIFFERS") << endl;
+	}
+	else {
+		report << "  load_ppm (ifstream): can't read this format" << endl;
+	}
+	return report.str();
+}
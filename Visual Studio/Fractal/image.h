@@ -0,0 +1,26 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Netpbm images (P2/P3 ascii, P5/P6 binary, 8 or 16 bit) decoded straight out of a mapped file.
+// Pixels come back as B,G,R,A bytes (upload with GL_BGRA / GL_UNSIGNED_BYTE), alpha is always 255.
+// The returned buffer is new[]'d, delete[] it when done. Returns 0 (and prints why) on failure.
+uint32_t * load_pnm(const char * path, unsigned long * xsz, unsigned long * ysz);
+uint32_t * decode_pnm(const char * data, size_t size, unsigned long * xsz, unsigned long * ysz); // same, from memory
+
+// Write 8 bit RGBA pixels (alpha dropped) as a binary P6 file; bottomUp flips GL's row order
+bool save_ppm(const char * path, unsigned long width, unsigned long height, const uint8_t * rgba, bool bottomUp);
+
+struct DecodedImage { // pixels ready for glTexImage2D
+	unsigned long width, height;
+	uint8_t * pixels; // 4 bytes per pixel, 0 if decoding failed
+	bool bgra; // B,G,R,A (load_pnm) rather than R,G,B,A (SOIL)
+	bool soil; // allocated by SOIL rather than new[], free_image() knows which
+};
+bool decode_image(const char * path, DecodedImage & image); // ppm/pgm ourselves, anything else through SOIL (safe off the render thread)
+void free_image(DecodedImage & image);
+
+std::string benchmark_pnm(const char * path, int runs); // new loader vs the old ifstream one, returns a report
+#endif
@@ -0,0 +1,285 @@
+/** raydual.cpp
+ * Normals without the six extra dE() calls: the distance part of every estimate again,
+ * carried through forward mode dual numbers so one pass gives the distance and its
+ * gradient with respect to the sample point. Colouring orbits are left out, they
+ * never affect the normal. Each function follows its twin in raymarch.cpp line for
+ * line, a change to one needs the same change here.
+ * Where the shader branches (folds, swaps, clamps, min/max) the derivative is that of
+ * the branch taken, which is what the finite differences see too, away from the seams.
+ */
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+#include "util.h"
+#include "raymarch.h"
+
+using namespace std;
+
+struct dual { // a value and its gradient
+	float v;
+	vec3f d;
+	dual() {}
+	dual(float v) : v(v), d(0.0f) {} // a constant
+	dual(float v, const vec3f & d) : v(v), d(d) {}
+};
+inline dual operator-(const dual & a) { return dual(-a.v, a.d * -1.0f); }
+inline dual operator+(const dual & a, const dual & b) { return dual(a.v + b.v, a.d + b.d); }
+inline dual operator-(const dual & a, const dual & b) { return dual(a.v - b.v, a.d - b.d); }
+inline dual operator*(const dual & a, const dual & b) { return dual(a.v * b.v, a.d * b.v + b.d * a.v); }
+inline dual operator/(const dual & a, const dual & b) { return dual(a.v / b.v, (a.d * b.v - b.d * a.v) / (b.v * b.v)); }
+inline dual operator+(const dual & a, float b) { return dual(a.v + b, a.d); }
+inline dual operator-(const dual & a, float b) { return dual(a.v - b, a.d); }
+inline dual operator-(float a, const dual & b) { return dual(a - b.v, b.d * -1.0f); }
+inline dual operator*(const dual & a, float b) { return dual(a.v * b, a.d * b); }
+inline dual operator*(float a, const dual & b) { return dual(a * b.v, b.d * a); }
+inline dual operator/(const dual & a, float b) { return dual(a.v / b, a.d / b); }
+inline dual operator/(float a, const dual & b) { return dual(a / b.v, b.d * (-a / (b.v * b.v))); }
+inline dual sqrt(const dual & a) { float s = sqrtf(a.v); return dual(s, a.d * (0.5f / s)); }
+inline dual abs(const dual & a) { return a.v < 0.0f ? -a : a; }
+inline dual floor(const dual & a) { return dual(floorf(a.v)); } // flat between the steps
+inline dual log(const dual & a) { return dual(logf(a.v), a.d / a.v); }
+inline dual pow(const dual & a, float n) { float p = powf(a.v, n - 1.0f); return dual(p * a.v, a.d * (n * p)); }
+inline dual sin(const dual & a) { return dual(sinf(a.v), a.d * cosf(a.v)); }
+inline dual cos(const dual & a) { return dual(cosf(a.v), a.d * -sinf(a.v)); }
+inline dual asin(const dual & a) { return dual(asinf(a.v), a.d / sqrtf(1.0f - a.v * a.v)); }
+inline dual atan2(const dual & y, const dual & x) { float r2 = x.v * x.v + y.v * y.v; return dual(atan2f(y.v, x.v), (y.d * x.v - x.d * y.v) / r2); }
+inline dual max(const dual & a, const dual & b) { return a.v < b.v ? b : a; }
+inline dual min(const dual & a, const dual & b) { return b.v < a.v ? b : a; }
+inline dual max(const dual & a, float b) { return a.v < b ? dual(b) : a; }
+inline dual clamp(const dual & a, float lo, float hi) { return a.v < lo ? dual(lo) : (a.v > hi ? dual(hi) : a); }
+inline dual mod(const dual & a, float b) { return a - floor(a / b) * b; } // GLSL mod(), see modf_glsl()
+
+struct vec3d { // vec3f of duals
+	dual x, y, z;
+	vec3d() {}
+	vec3d(const dual & x, const dual & y, const dual & z) : x(x), y(y), z(z) {}
+	vec3d(const vec3f & w) : x(w.x, vec3f(1, 0, 0)), y(w.y, vec3f(0, 1, 0)), z(w.z, vec3f(0, 0, 1)) {} // the point everything is differentiated against
+	vec3d operator+(const vec3d & b) const { return vec3d(x + b.x, y + b.y, z + b.z); }
+	vec3d operator-(const vec3d & b) const { return vec3d(x - b.x, y - b.y, z - b.z); }
+	vec3d operator+(const vec3f & b) const { return vec3d(x + b.x, y + b.y, z + b.z); }
+	vec3d operator-(const vec3f & b) const { return vec3d(x - b.x, y - b.y, z - b.z); }
+	vec3d operator*(float s) const { return vec3d(x * s, y * s, z * s); }
+	vec3d operator*(const dual & s) const { return vec3d(x * s, y * s, z * s); }
+};
+inline vec3d operator-(const vec3f & a, const vec3d & b) { return vec3d(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline vec3d operator*(const vec3d & v, const mat3f & a) { // v * M
+	return vec3d(v.x * a.m[0] + v.y * a.m[1] + v.z * a.m[2], v.x * a.m[3] + v.y * a.m[4] + v.z * a.m[5], v.x * a.m[6] + v.y * a.m[7] + v.z * a.m[8]);
+}
+inline dual dot(const vec3d & a, const vec3d & b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline dual length(const vec3d & a) { return sqrt(dot(a, a)); }
+inline vec3d abs(const vec3d & a) { return vec3d(abs(a.x), abs(a.y), abs(a.z)); }
+inline vec3d clamp(const vec3d & a, float lo, float hi) { return vec3d(clamp(a.x, lo, hi), clamp(a.y, lo, hi), clamp(a.z, lo, hi)); }
+inline vec3d operator*(const vec3f & c, const dual & t) { return vec3d(t * c.x, t * c.y, t * c.z); } // a constant direction times t
+
+static dual SphereSpongeDual(const FractalParams & p, vec3d w) {
+	w = w * p.objectRotation;
+	float k = p.scale;
+	dual d = -10000.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		vec3d zz = vec3d(mod(w.x * k, p.sphereHoles), mod(w.y * k, p.sphereHoles), mod(w.z * k, p.sphereHoles)) - vec3f(0.5f * p.sphereHoles) + p.offset;
+		dual r = length(zz);
+		dual d1 = (p.sphereScale - r) / k;
+		k *= p.scale;
+		d = max(d, d1);
+	}
+
+	return d;
+}
+
+static dual MengerSpongeDual(const FractalParams & p, vec3d w) {
+	w = w * p.objectRotation;
+	w = (w * 0.5f + vec3f(0.5f)) * p.scale;
+
+	vec3d v = abs(w - p.halfSpongeScale) - p.halfSpongeScale;
+	dual d = max(v.x, max(v.y, v.z));
+	float q = 1.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		vec3d a = vec3d(mod(3.0f * w.x * q, 3.0f), mod(3.0f * w.y * q, 3.0f), mod(3.0f * w.z * q, 3.0f));
+		q *= 3.0f;
+
+		v = vec3f(0.5f) - abs(a - vec3f(1.5f)) + p.offset;
+		v = v * p.fractalRotation1;
+
+		dual d1 = min(max(v.x, v.z), min(max(v.x, v.y), max(v.y, v.z))) / q;
+		d = max(d, d1);
+	}
+
+	return d * 2.0f / p.scale;
+}
+
+static dual OctahedralIFSDual(const FractalParams & p, vec3d w) {
+	w = w * p.objectRotation;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		w = w * p.fractalRotation1;
+		w = abs(w + p.shift) - p.shift;
+
+		if (w.x.v < w.y.v) swap(w.x, w.y);
+		if (w.x.v < w.z.v) swap(w.x, w.z);
+		if (w.y.v < w.z.v) swap(w.y, w.z);
+
+		w = w * p.fractalRotation2;
+		w = w * p.scale;
+		w = w - p.scale_offset;
+	}
+
+	return (length(w) - 2.0f) * powf(p.scale, -(float)p.maxIterations);
+}
+
+static dual DodecahedronIFSDual(const FractalParams & p, vec3d w) {
+	const vec3f & phi3 = p.phi3;
+	const vec3f & c3 = p.c3;
+	w = w * p.objectRotation;
+	dual t;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		w = w * p.fractalRotation1;
+		w = abs(w + p.shift) - p.shift;
+
+		t = w.x * phi3.z + w.y * phi3.y - w.z * phi3.x;
+		if (t.v < 0.0f) w = w + vec3f(-2.0f, -2.0f, 2.0f) * vec3f(phi3.z, phi3.y, phi3.x) * t;
+
+		t = -w.x * phi3.x + w.y * phi3.z + w.z * phi3.y;
+		if (t.v < 0.0f) w = w + vec3f(2.0f, -2.0f, -2.0f) * vec3f(phi3.x, phi3.z, phi3.y) * t;
+
+		t = w.x * phi3.y - w.y * phi3.x + w.z * phi3.z;
+		if (t.v < 0.0f) w = w + vec3f(-2.0f, 2.0f, -2.0f) * vec3f(phi3.y, phi3.x, phi3.z) * t;
+
+		t = -w.x * c3.x + w.y * c3.y + w.z * c3.z;
+		if (t.v < 0.0f) w = w + vec3f(2.0f, -2.0f, -2.0f) * c3 * t;
+
+		t = w.x * c3.z - w.y * c3.x + w.z * c3.y;
+		if (t.v < 0.0f) w = w + vec3f(-2.0f, 2.0f, -2.0f) * vec3f(c3.z, c3.x, c3.y) * t;
+
+		w = w * p.fractalRotation2;
+		w = w * p.scale;
+		w = w - p.scale_offset;
+	}
+
+	return (length(w) - 2.0f) * powf(p.scale, -(float)p.maxIterations);
+}
+
+static dual MandelboxDual(const FractalParams & p, vec3d w) {
+	w = w * p.objectRotation;
+	vec3d z = w;
+	dual dr = 1.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		z = clamp(z, -p.boxFold, p.boxFold) * (2.0f * p.boxFold) - z; // box fold
+		z = z * p.fractalRotation1;
+
+		dual d = dot(z, z);
+		dual k = clamp(max(p.fR2 / d, p.mR2), 0.0f, 1.0f); // sphere fold
+		z = z * k;
+		dr = dr * k;
+
+		z = z * p.scaleFactorX + w + p.offset;
+		dr = dr * p.scaleFactorY + 1.0f;
+		z = z * p.fractalRotation2;
+	}
+
+	return (length(z) - p.fudgeFactor) / dr;
+}
+
+static inline void powN(float pw, vec3d & z, const dual & zr0, dual & dr) {
+	dual zo = asin(z.z / zr0) * pw;
+	dual zi = atan2(z.y, z.x) * pw;
+	dual zr = pow(zr0, pw - 1.0f);
+	dual czo = cos(zo);
+
+	dr = zr * dr * pw + 1.0f;
+	zr = zr * zr0;
+
+	z = vec3d(czo * cos(zi), czo * sin(zi), sin(zo)) * zr;
+}
+
+static dual MandelbulbDual(const FractalParams & p, vec3d w) {
+	w = w * p.objectRotation;
+
+	vec3d z = w;
+	vec3d c = w + (p.offset - w) * p.juliaFactor; // mix(w, offset, juliaFactor)
+	dual dr = 1.0f;
+	dual r = length(z);
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		powN(p.power, z, r, dr);
+
+		z = z + c;
+
+		if (z.y.v > p.radiolariaFactor) {
+			z.y = z.y + (p.radiolariaFactor - z.y) * p.radiolaria;
+		}
+
+		r = length(z);
+		if (r.v > CPU_BAILOUT) break;
+	}
+
+	return 0.5f * log(r) * r / dr;
+}
+
+float dEGradient(const FractalParams & p, const vec3f & w, vec3f & gradient) {
+	dual d;
+	switch (p.type) {
+	case 0: d = MengerSpongeDual(p, w); break;
+	case 1: d = SphereSpongeDual(p, w); break;
+	case 2: d = MandelbulbDual(p, w); break;
+	case 3: d = MandelboxDual(p, w); break;
+	case 4: d = OctahedralIFSDual(p, w); break;
+	default: d = DodecahedronIFSDual(p, w); break;
+	}
+	gradient = d.d;
+	return d.v;
+}
+
+vec3f dualNormal(const FractalParams & p, const vec3f & z) {
+	vec3f g;
+	dEGradient(p, z, g);
+	float l = length(g);
+	return l > 0.0f ? g / l : normalize(z); // flat spot (or a seam): point away from the centre like a bounding sphere hit
+}
+
+void compareNormals(const FractalParams & p, unsigned int width, unsigned int height) {
+	vector<Hit> hits;
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			Hit h = march(p, rayDirection(p, x + 0.5f, y + 0.5f));
+			if (h.hit && !flatShaded(h)) hits.push_back(h);
+		}
+	}
+	if (hits.empty()) {
+		cout << "Normals: nothing hit" << endl;
+		return;
+	}
+
+	vector<vec3f> central(hits.size()), analytic(hits.size());
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < hits.size(); i++) central[i] = generateNormal(p, hits[i].position, hits[i].eps);
+	float centralMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+	start = chrono::steady_clock::now();
+	for (size_t i = 0; i < hits.size(); i++) analytic[i] = dualNormal(p, hits[i].position);
+	float dualMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+
+	// Angle between the two, in degrees
+	double sum = 0.0;
+	float worst = 0.0f;
+	size_t over1 = 0, over10 = 0;
+	for (size_t i = 0; i < hits.size(); i++) {
+		float angle = acosf(clampf(dot(central[i], analytic[i]), -1.0f, 1.0f)) * 57.2957795f;
+		sum += angle;
+		worst = max(worst, angle);
+		if (angle > 1.0f) over1++;
+		if (angle > 10.0f) over10++;
+	}
+	cout << "Normals at " << hits.size() << " hits: central differences " << centralMs << " ms, dual numbers " << dualMs << " ms" << endl;
+	cout << "  angle between them: mean " << sum / hits.size() << " deg, worst " << worst << " deg, "
+		<< 100.0f * over1 / hits.size() << "% over 1 deg, " << 100.0f * over10 / hits.size() << "% over 10 deg" << endl;
+}
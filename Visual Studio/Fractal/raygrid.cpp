@@ -0,0 +1,170 @@
+/** raygrid.cpp
+ * The baked distance grid: while the fractal stays the same only the camera moves, so
+ * dE() gives the same answer at a point every frame. Sampling it once into a grid lets
+ * the shader take the long steps through empty space from two texture reads instead
+ * of the full iteration, calling dE() itself only near the surface.
+ * The grid is a dense GRID_CELLS^3 coarse level over the bounding cube, plus a brick of
+ * BRICK_SIZE^3 finer samples in each cell that can hold some surface (at the defaults: almost
+ * none for the IFS types, a sixth for the Menger sponge and the bulb, every cell of the Mandelbox). Each is read with trilinear filtering, less how far the
+ * samples' weighted average is from the point: a DE moves by at most the distance moved, so
+ * that is never more than dE() itself. Cells without a brick hold no surface at all, so a ray
+ * can go straight through to the far side of one.
+ */
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "raymarch.h"
+
+using namespace std;
+
+static inline float lerpf(float a, float b, float t) {
+	return a + (b - a) * t;
+}
+
+static float spread(float fx, float fy, float fz) { // bound on sum(w |p - c|) over the 8 samples, in cell sizes
+	return sqrtf(fx * (1.0f - fx) + fy * (1.0f - fy) + fz * (1.0f - fz));
+}
+
+static float trilinear(const float * v, int strideY, int strideZ, float fx, float fy, float fz) { // v at the low corner
+	float x00 = lerpf(v[0], v[1], fx), x10 = lerpf(v[strideY], v[strideY + 1], fx);
+	float x01 = lerpf(v[strideZ], v[strideZ + 1], fx), x11 = lerpf(v[strideZ + strideY], v[strideZ + strideY + 1], fx);
+	return lerpf(lerpf(x00, x10, fy), lerpf(x01, x11, fy), fz);
+}
+
+float DistanceGrid::distance(const vec3f & q) const {
+	vec3f g = (q / radius * 0.5f + vec3f(0.5f)) * (float)GRID_CELLS; // 0..GRID_CELLS across the cube
+	if (g.x < 0.0f || g.y < 0.0f || g.z < 0.0f || g.x >= GRID_CELLS || g.y >= GRID_CELLS || g.z >= GRID_CELLS) return 0.0f;
+	int cx = (int)g.x, cy = (int)g.y, cz = (int)g.z;
+	float fx = g.x - cx, fy = g.y - cy, fz = g.z - cz;
+	const float * brick = &index[(cx + GRID_CELLS * (cy + GRID_CELLS * cz)) * 3];
+
+	if (brick[0] < 0.0f) { // far from the surface, the coarse corners are enough
+		const int n = GRID_CELLS + 1;
+		return trilinear(&coarse[cx + n * (cy + n * cz)], n, n * n, fx, fy, fz) - cellSize() * spread(fx, fy, fz);
+	}
+	const int w = atlasX * BRICK_SIZE, h = atlasY * BRICK_SIZE;
+	float px = fx * (BRICK_SIZE - 1), py = fy * (BRICK_SIZE - 1), pz = fz * (BRICK_SIZE - 1);
+	int ix = min((int)px, BRICK_SIZE - 2), iy = min((int)py, BRICK_SIZE - 2), iz = min((int)pz, BRICK_SIZE - 2);
+	int x = (int)brick[0] * BRICK_SIZE + ix, y = (int)brick[1] * BRICK_SIZE + iy, z = (int)brick[2] * BRICK_SIZE + iz;
+	fx = px - ix;
+	fy = py - iy;
+	fz = pz - iz;
+	return trilinear(&bricks[x + w * (y + h * z)], w, w * h, fx, fy, fz) - cellSize() / (BRICK_SIZE - 1) * spread(fx, fy, fz);
+}
+
+bool bakeGrid(const FractalParams & p, DistanceGrid & grid, const function<bool()> & cancelled) {
+	const int n = GRID_CELLS + 1;
+	grid.radius = sqrtf(p.boundingRadius); // intersectBoundingSphere() compares |o|^2 with the radius itself, so this is the sphere the rays see
+	float cell = grid.cellSize();
+	float diagonal = cell * sqrtf(3.0f);
+	vector<vec3f> points(BRICK_SIZE * BRICK_SIZE * BRICK_SIZE), out(points.size());
+
+	grid.coarse.resize(n * n * n);
+	for (int z = 0; z < n; z++) {
+		for (int y = 0; y < n; y++) { // a row at a time through dEBatch(), packets for the types that have them
+			for (int x = 0; x < n; x++) points[x] = vec3f(x * cell - grid.radius, y * cell - grid.radius, z * cell - grid.radius);
+			dEBatch(p, &points[0], n, &out[0]);
+			for (int x = 0; x < n; x++) grid.coarse[x + n * (y + n * z)] = out[x].x;
+		}
+		if (cancelled()) return false;
+	}
+
+	// A brick wherever a corner is within a diagonal of the surface: with every corner further
+	// out than that the DE rules out any surface in the cell
+	vector<int> near;
+	for (int z = 0; z < GRID_CELLS; z++) {
+		for (int y = 0; y < GRID_CELLS; y++) {
+			for (int x = 0; x < GRID_CELLS; x++) {
+				const float * c = &grid.coarse[x + n * (y + n * z)];
+				float lowest = min(min(min(c[0], c[1]), min(c[n], c[n + 1])), min(min(c[n * n], c[n * n + 1]), min(c[n * n + n], c[n * n + n + 1])));
+				if (lowest < diagonal) near.push_back(x + GRID_CELLS * (y + GRID_CELLS * z));
+			}
+		}
+	}
+	grid.brickCount = (int)near.size();
+	grid.atlasX = grid.atlasY = 16; // 128 texels square, as deep as it needs (at most GRID_CELLS^3 / 256 bricks)
+	grid.atlasZ = max(1, (grid.brickCount + 255) / 256);
+	const int w = grid.atlasX * BRICK_SIZE, h = grid.atlasY * BRICK_SIZE;
+	grid.bricks.assign((size_t)w * h * grid.atlasZ * BRICK_SIZE, 0.0f);
+	grid.index.assign(GRID_CELLS * GRID_CELLS * GRID_CELLS * 3, -1.0f);
+
+	float step = cell / (BRICK_SIZE - 1); // samples on the cell's faces too, so neighbouring bricks meet without a seam
+	for (int b = 0; b < grid.brickCount; b++) {
+		int c = near[b];
+		int cx = c % GRID_CELLS, cy = (c / GRID_CELLS) % GRID_CELLS, cz = c / (GRID_CELLS * GRID_CELLS);
+		int bx = b % grid.atlasX, by = (b / grid.atlasX) % grid.atlasY, bz = b / (grid.atlasX * grid.atlasY);
+		vec3f origin = vec3f(cx * cell, cy * cell, cz * cell) - vec3f(grid.radius);
+		int i = 0;
+		for (int z = 0; z < BRICK_SIZE; z++)
+			for (int y = 0; y < BRICK_SIZE; y++)
+				for (int x = 0; x < BRICK_SIZE; x++) points[i++] = origin + vec3f(x * step, y * step, z * step);
+		dEBatch(p, &points[0], i, &out[0]);
+		i = 0;
+		for (int z = 0; z < BRICK_SIZE; z++)
+			for (int y = 0; y < BRICK_SIZE; y++)
+				for (int x = 0; x < BRICK_SIZE; x++) grid.bricks[(bx * BRICK_SIZE + x) + w * ((by * BRICK_SIZE + y) + h * (bz * BRICK_SIZE + z))] = out[i++].x;
+		grid.index[c * 3] = (float)bx;
+		grid.index[c * 3 + 1] = (float)by;
+		grid.index[c * 3 + 2] = (float)bz;
+		if ((b & 63) == 63 && cancelled()) return false;
+	}
+	return true;
+}
+
+GridBaker::GridBaker() : lastMs(0.0f), queued(false), ready(false), stopping(false), generation(0) {
+	worker = thread(&GridBaker::work, this);
+}
+
+GridBaker::~GridBaker() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+		generation++; // a bake in progress stops at its next check
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void GridBaker::bake(const FractalParams & p) {
+	{
+		lock_guard<mutex> guard(lock);
+		job = p;
+		queued = true;
+		ready = false; // whatever finished before is for the old parameters
+		generation++;
+	}
+	wake.notify_all();
+}
+
+bool GridBaker::finished(DistanceGrid & grid) {
+	lock_guard<mutex> guard(lock);
+	if (!ready) return false;
+	grid = move(result);
+	ready = false;
+	return true;
+}
+
+void GridBaker::work() {
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		wake.wait(guard, [&] { return stopping || queued; });
+		if (stopping) return;
+		FractalParams p = job;
+		unsigned long mine = generation;
+		queued = false;
+		guard.unlock();
+
+		DistanceGrid grid;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool done = bakeGrid(p, grid, [&] { return generation != mine; });
+		float ms = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+
+		guard.lock();
+		if (done && generation == mine) { // nobody asked for something else meanwhile
+			result = move(grid);
+			ready = true;
+			lastMs = ms;
+		}
+	}
+}
@@ -0,0 +1,864 @@
+/** raymarch.cpp
+ * The 3D fractals on the CPU: a line by line port of 3d_fractals.frag (distance
+ * estimates, the marching loop, normals, AO, Blinn-Phong, fog and glow) driven by
+ * a pool of threads that take 32x32 tiles off a shared counter. Tiles near the
+ * surface cost many times more than empty sky, handing them out one at a time
+ * keeps every core busy to the end.
+ */
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+#include "util.h"
+#include "raymarch.h"
+
+using namespace std;
+
+#define HALFPI 1.570796f
+
+mat3f mat3f::operator*(const mat3f & b) const {
+	mat3f r;
+	for (int c = 0; c < 3; c++) {
+		for (int row = 0; row < 3; row++) {
+			r.m[c * 3 + row] = m[row] * b.m[c * 3] + m[3 + row] * b.m[c * 3 + 1] + m[6 + row] * b.m[c * 3 + 2];
+		}
+	}
+	return r;
+}
+
+// Return rotation matrix for rotating around vector v by angle
+static mat3f rotationMatrixVector(const vec3f & v, float angle) {
+	float c = cosf(angle * 3.14159265f / 180.0f);
+	float s = sinf(angle * 3.14159265f / 180.0f);
+	mat3f r = { {
+		c + (1.0f - c) * v.x * v.x, (1.0f - c) * v.x * v.y - s * v.z, (1.0f - c) * v.x * v.z + s * v.y,
+		(1.0f - c) * v.x * v.y + s * v.z, c + (1.0f - c) * v.y * v.y, (1.0f - c) * v.y * v.z - s * v.x,
+		(1.0f - c) * v.x * v.z - s * v.y, (1.0f - c) * v.y * v.z + s * v.x, c + (1.0f - c) * v.z * v.z
+	} };
+	return r;
+}
+
+static vec3f get3(Shader * shader, const char * name) {
+	vec3f v;
+	shader->get_uniform3f(name, &v.x, &v.y, &v.z);
+	return v;
+}
+
+void FractalParams::load(Shader * shader, float width, float height) {
+	type = shader->get_uniform1i("type");
+	maxIterations = shader->get_uniform1i("maxIterations");
+	stepLimit = shader->get_uniform1i("stepLimit");
+	aoIterations = shader->get_uniform1i("aoIterations");
+	aoResolution = shader->get_uniform1i("aoResolution");
+	colorIterations = shader->get_uniform1i("colorIterations");
+	antialiasingOn = shader->get_uniform1i("antialiasingOn") != 0;
+	transparent = shader->get_uniform1i("transparent") != 0;
+	antialiasing = shader->get_uniform1f("antialiasing");
+	gamma = shader->get_uniform1f("gamma");
+	sizeX = width; // size and outputSize: one sample per output pixel
+	sizeY = height;
+	aspectRatio = width / height;
+
+	scale = shader->get_uniform1f("scale");
+	power = shader->get_uniform1f("power");
+	surfaceDetail = shader->get_uniform1f("surfaceDetail");
+	surfaceSmoothness = shader->get_uniform1f("surfaceSmoothness");
+	boundingRadius = shader->get_uniform1f("boundingRadius");
+	offset = get3(shader, "offset");
+	shift = get3(shader, "shift");
+
+	cameraRoll = shader->get_uniform1f("cameraRoll");
+	cameraPitch = shader->get_uniform1f("cameraPitch");
+	cameraYaw = shader->get_uniform1f("cameraYaw");
+	cameraFocalLength = shader->get_uniform1f("cameraFocalLength");
+	cameraPosition = get3(shader, "cameraPosition");
+
+	color1 = get3(shader, "color1");
+	color2 = get3(shader, "color2");
+	color3 = get3(shader, "color3");
+	color1Intensity = shader->get_uniform1f("color1Intensity");
+	color2Intensity = shader->get_uniform1f("color2Intensity");
+	color3Intensity = shader->get_uniform1f("color3Intensity");
+
+	light = get3(shader, "light");
+	shader->get_uniform2f("ambientColor", &ambientIntensity, &ambientMix);
+	background1Color = get3(shader, "background1Color");
+	background2Color = get3(shader, "background2Color");
+	innerGlowColor = get3(shader, "innerGlowColor");
+	innerGlowIntensity = shader->get_uniform1f("innerGlowIntensity");
+	outerGlowColor = get3(shader, "outerGlowColor");
+	outerGlowIntensity = shader->get_uniform1f("outerGlowIntensity");
+	fog = shader->get_uniform1f("fog");
+	fogFalloff = shader->get_uniform1f("fogFalloff");
+	specularity = shader->get_uniform1f("specularity");
+	specularExponent = shader->get_uniform1f("specularExponent");
+	aoIntensity = shader->get_uniform1f("aoIntensity");
+	aoSpread = shader->get_uniform1f("aoSpread");
+
+	shader->get_uniformMatrix3f("objectRotation", objectRotation.m);
+	shader->get_uniformMatrix3f("fractalRotation1", fractalRotation1.m);
+	shader->get_uniformMatrix3f("fractalRotation2", fractalRotation2.m);
+
+	sphereHoles = shader->get_uniform1f("sphereHoles");
+	sphereScale = shader->get_uniform1f("sphereScale");
+	phi = shader->get_uniform1f("phi");
+	boxScale = shader->get_uniform1f("boxScale");
+	boxFold = shader->get_uniform1f("boxFold");
+	fudgeFactor = shader->get_uniform1f("fudgeFactor");
+	juliaFactor = shader->get_uniform1f("juliaFactor");
+	radiolariaFactor = shader->get_uniform1f("radiolariaFactor");
+	radiolaria = shader->get_uniform1f("radiolaria");
+
+	// The shader's globals, worked out once here instead of once per pixel
+	fovfactor = 1.0f / sqrtf(1.0f + cameraFocalLength * cameraFocalLength);
+	pixelScale = 1.0f / min(width, height);
+	epsfactor = 2.0f * fovfactor * pixelScale * surfaceDetail;
+	cameraRotation = rotationMatrixVector(vec3f(0, 1, 0), 180.0f - cameraYaw) * rotationMatrixVector(vec3f(1, 0, 0), -cameraPitch) * rotationMatrixVector(vec3f(0, 0, 1), cameraRoll);
+	halfSpongeScale = vec3f(0.5f * scale);
+	scale_offset = offset * (scale - 1.0f);
+	float ikvnorm = 1.0f / sqrtf(powf(phi * (1.0f + phi), 2.0f) + powf(phi * phi - 1.0f, 2.0f) + powf(1.0f + phi, 2.0f));
+	phi3 = vec3f(0.5f, 0.5f / phi, 0.5f * phi);
+	c3 = vec3f(phi * (1.0f + phi) * ikvnorm, (phi * phi - 1.0f) * ikvnorm, (1.0f + phi) * ikvnorm);
+	mR2 = boxScale * boxScale;
+	fR2 = sphereScale * mR2;
+	scaleFactorX = scale / mR2;
+	scaleFactorY = fabsf(scale) / mR2;
+	// Exact gradients only where the estimate is smooth. The folds and mod() of the sponges and the
+	// Mandelbox put a seam within eps of nearly every hit, and there the central differences' blur is the look
+	dualNormals = type == 2 || type == 4 || type == 5;
+}
+
+static bool same(const vec3f & a, const vec3f & b) {
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool same(const mat3f & a, const mat3f & b) {
+	for (int i = 0; i < 9; i++) if (a.m[i] != b.m[i]) return false;
+	return true;
+}
+
+bool sameSurface(const FractalParams & a, const FractalParams & b) {
+	return a.type == b.type && a.maxIterations == b.maxIterations &&
+		a.scale == b.scale && a.power == b.power && a.surfaceDetail == b.surfaceDetail &&
+		a.surfaceSmoothness == b.surfaceSmoothness && a.boundingRadius == b.boundingRadius &&
+		same(a.offset, b.offset) && same(a.shift, b.shift) &&
+		same(a.objectRotation, b.objectRotation) && same(a.fractalRotation1, b.fractalRotation1) && same(a.fractalRotation2, b.fractalRotation2) &&
+		a.sphereHoles == b.sphereHoles && a.sphereScale == b.sphereScale && a.phi == b.phi &&
+		a.boxScale == b.boxScale && a.boxFold == b.boxFold && a.fudgeFactor == b.fudgeFactor &&
+		a.juliaFactor == b.juliaFactor && a.radiolariaFactor == b.radiolariaFactor && a.radiolaria == b.radiolaria;
+}
+
+bool sameView(const FractalParams & a, const FractalParams & b) {
+	return sameSurface(a, b) && a.stepLimit == b.stepLimit && a.aoIterations == b.aoIterations && a.aoSpread == b.aoSpread &&
+		a.aoResolution == b.aoResolution &&
+		a.colorIterations == b.colorIterations && a.antialiasingOn == b.antialiasingOn && a.antialiasing == b.antialiasing &&
+		a.sizeX == b.sizeX && a.sizeY == b.sizeY && a.aspectRatio == b.aspectRatio &&
+		same(a.cameraPosition, b.cameraPosition) && a.cameraRoll == b.cameraRoll && a.cameraPitch == b.cameraPitch &&
+		a.cameraYaw == b.cameraYaw && a.cameraFocalLength == b.cameraFocalLength;
+}
+
+bool sameLook(const FractalParams & a, const FractalParams & b) {
+	return sameView(a, b) && a.transparent == b.transparent && a.gamma == b.gamma &&
+		same(a.color1, b.color1) && same(a.color2, b.color2) && same(a.color3, b.color3) &&
+		a.color1Intensity == b.color1Intensity && a.color2Intensity == b.color2Intensity && a.color3Intensity == b.color3Intensity &&
+		same(a.light, b.light) && same(a.background1Color, b.background1Color) && same(a.background2Color, b.background2Color) &&
+		same(a.innerGlowColor, b.innerGlowColor) && same(a.outerGlowColor, b.outerGlowColor) &&
+		a.ambientIntensity == b.ambientIntensity && a.ambientMix == b.ambientMix &&
+		a.innerGlowIntensity == b.innerGlowIntensity && a.outerGlowIntensity == b.outerGlowIntensity &&
+		a.fog == b.fog && a.fogFalloff == b.fogFalloff && a.specularity == b.specularity && a.specularExponent == b.specularExponent &&
+		a.aoIntensity == b.aoIntensity;
+}
+
+vec3f SphereSponge(const FractalParams & p, vec3f w) {
+	w = w * p.objectRotation;
+	float k = p.scale;
+	float d = -10000.0f;
+	float d1, r, md = 100000.0f, cd = 0.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		vec3f zz = vec3f(modf_glsl(w.x * k, p.sphereHoles), modf_glsl(w.y * k, p.sphereHoles), modf_glsl(w.z * k, p.sphereHoles)) - vec3f(0.5f * p.sphereHoles) + p.offset;
+		r = length(zz);
+
+		// distance to the edge of the sphere (positive inside)
+		d1 = (p.sphereScale - r) / k;
+		k *= p.scale;
+
+		// intersection
+		d = max(d, d1);
+
+		if (i < p.colorIterations) {
+			md = min(md, d);
+			cd = r;
+		}
+	}
+
+	return vec3f(d, cd, md);
+}
+
+vec3f MengerSponge(const FractalParams & p, vec3f w) {
+	w = w * p.objectRotation;
+	w = (w * 0.5f + vec3f(0.5f)) * p.scale; // scale [-1, 1] range to [0, 1]
+
+	vec3f v = abs(w - p.halfSpongeScale) - p.halfSpongeScale;
+	float d1 = max(v.x, max(v.y, v.z)); // distance to the box
+	float d = d1;
+	float q = 1.0f; // p in the shader
+	float md = 10000.0f;
+	vec3f cd = v;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		vec3f a = vec3f(modf_glsl(3.0f * w.x * q, 3.0f), modf_glsl(3.0f * w.y * q, 3.0f), modf_glsl(3.0f * w.z * q, 3.0f));
+		q *= 3.0f;
+
+		v = vec3f(0.5f) - abs(a - vec3f(1.5f)) + p.offset;
+		v = v * p.fractalRotation1;
+
+		// distance inside the 3 axis aligned square tubes
+		d1 = min(max(v.x, v.z), min(max(v.x, v.y), max(v.y, v.z))) / q;
+
+		// intersection
+		d = max(d, d1);
+
+		if (i < p.colorIterations) {
+			md = min(md, d);
+			cd = v;
+		}
+	}
+
+	// The distance estimate, min distance, and fractional iteration count
+	return vec3f(d * 2.0f / p.scale, md, dot(cd, cd));
+}
+
+vec3f OctahedralIFS(const FractalParams & p, vec3f w) {
+	w = w * p.objectRotation;
+	float d;
+	float md = 1000.0f, cd = 0.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		w = w * p.fractalRotation1;
+		w = abs(w + p.shift) - p.shift;
+
+		// Octahedral
+		if (w.x < w.y) swap(w.x, w.y);
+		if (w.x < w.z) swap(w.x, w.z);
+		if (w.y < w.z) swap(w.y, w.z);
+
+		w = w * p.fractalRotation2;
+		w *= p.scale;
+		w -= p.scale_offset;
+
+		// Record minimum orbit for colouring
+		d = dot(w, w);
+
+		if (i < p.colorIterations) {
+			md = min(md, d);
+			cd = d;
+		}
+	}
+
+	return vec3f((length(w) - 2.0f) * powf(p.scale, -(float)p.maxIterations), md, cd);
+}
+
+vec3f DodecahedronIFS(const FractalParams & p, vec3f w) {
+	const vec3f & phi3 = p.phi3;
+	const vec3f & c3 = p.c3;
+	w = w * p.objectRotation;
+	float d, t;
+	float md = 1000.0f, cd = 0.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		w = w * p.fractalRotation1;
+		w = abs(w + p.shift) - p.shift;
+
+		t = w.x * phi3.z + w.y * phi3.y - w.z * phi3.x;
+		if (t < 0.0f) w += vec3f(-2.0f, -2.0f, 2.0f) * t * vec3f(phi3.z, phi3.y, phi3.x);
+
+		t = -w.x * phi3.x + w.y * phi3.z + w.z * phi3.y;
+		if (t < 0.0f) w += vec3f(2.0f, -2.0f, -2.0f) * t * vec3f(phi3.x, phi3.z, phi3.y);
+
+		t = w.x * phi3.y - w.y * phi3.x + w.z * phi3.z;
+		if (t < 0.0f) w += vec3f(-2.0f, 2.0f, -2.0f) * t * vec3f(phi3.y, phi3.x, phi3.z);
+
+		t = -w.x * c3.x + w.y * c3.y + w.z * c3.z;
+		if (t < 0.0f) w += vec3f(2.0f, -2.0f, -2.0f) * t * c3;
+
+		t = w.x * c3.z - w.y * c3.x + w.z * c3.y;
+		if (t < 0.0f) w += vec3f(-2.0f, 2.0f, -2.0f) * t * vec3f(c3.z, c3.x, c3.y);
+
+		w = w * p.fractalRotation2;
+		w *= p.scale;
+		w -= p.scale_offset;
+
+		// Record minimum orbit for colouring
+		d = dot(w, w);
+
+		if (i < p.colorIterations) {
+			md = min(md, d);
+			cd = d;
+		}
+	}
+
+	return vec3f((length(w) - 2.0f) * powf(p.scale, -(float)p.maxIterations), md, cd);
+}
+
+vec3f Mandelbox(const FractalParams & p, vec3f w) {
+	w = w * p.objectRotation;
+	float md = 1000.0f;
+	vec3f c = w;
+
+	// distance estimate
+	vec3f z = w; // p.xyz in the shader
+	float dr = 1.0f; // p.w, knighty's DEfactor
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		z = clamp(z, -p.boxFold, p.boxFold) * 2.0f * p.boxFold - z; // box fold
+		z = z * p.fractalRotation1;
+
+		float d = dot(z, z);
+		float k = clampf(max(p.fR2 / d, p.mR2), 0.0f, 1.0f); // sphere fold
+		z *= k;
+		dr *= k;
+
+		z = z * p.scaleFactorX + w + p.offset;
+		dr = dr * p.scaleFactorY + 1.0f;
+		z = z * p.fractalRotation2;
+
+		if (i < p.colorIterations) {
+			md = min(md, d);
+			c = z;
+		}
+	}
+
+	// Return distance estimate, min distance, fractional iteration count
+	return vec3f((length(z) - p.fudgeFactor) / dr, md, 0.33f * logf(dot(c, c)) + 1.0f);
+}
+
+static inline void powN(float pw, vec3f & z, float zr0, float & dr) {
+	float zo0 = asinf(z.z / zr0);
+	float zi0 = atan2f(z.y, z.x);
+	float zr = powf(zr0, pw - 1.0f);
+	float zo = zo0 * pw;
+	float zi = zi0 * pw;
+	float czo = cosf(zo);
+
+	dr = zr * dr * pw + 1.0f;
+	zr *= zr0;
+
+	z = vec3f(czo * cosf(zi), czo * sinf(zi), sinf(zo)) * zr;
+}
+
+vec3f Mandelbulb(const FractalParams & p, vec3f w) {
+	w = w * p.objectRotation;
+
+	vec3f z = w;
+	vec3f c = mix(w, p.offset, p.juliaFactor);
+	vec3f d = w;
+	float dr = 1.0f;
+	float r = length(z);
+	float md = 10000.0f;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		powN(p.power, z, r, dr);
+
+		z += c;
+
+		if (z.y > p.radiolariaFactor) {
+			z.y = mixf(z.y, p.radiolariaFactor, p.radiolaria);
+		}
+
+		r = length(z);
+
+		if (i < p.colorIterations) {
+			md = min(md, r);
+			d = z;
+		}
+
+		if (r > CPU_BAILOUT) break;
+	}
+
+	return vec3f(0.5f * logf(r) * r / dr, md, 0.33f * logf(dot(d, d)) + 1.0f);
+}
+
+vec3f dE(const FractalParams & p, const vec3f & w) {
+	switch (p.type) {
+	case 0: return MengerSponge(p, w);
+	case 1: return SphereSponge(p, w);
+	case 2: return Mandelbulb(p, w);
+	case 3: return Mandelbox(p, w);
+	case 4: return OctahedralIFS(p, w);
+	default: return DodecahedronIFS(p, w);
+	}
+}
+
+vec3f rayDirection(const FractalParams & p, float px, float py) {
+	float x = (0.5f * p.sizeX - px) / p.sizeX * p.aspectRatio;
+	float y = (0.5f * p.sizeY - py) / -p.sizeY;
+	vec3f d = vec3f(x, y, -p.cameraFocalLength); // p.x * u + p.y * v - cameraFocalLength * w
+
+	return normalize(p.cameraRotation * d);
+}
+
+bool intersectBoundingSphere(const FractalParams & p, const vec3f & origin, const vec3f & direction, float & tmin, float & tmax) {
+	bool hit = false;
+	float b = dot(origin, direction);
+	float c = dot(origin, origin) - p.boundingRadius; // (sic) the shader compares against the radius, not its square
+	float disc = b * b - c; // discriminant
+	tmin = tmax = 0.0f;
+
+	if (disc > 0.0f) {
+		// Real root of disc, so intersection
+		float sdisc = sqrtf(disc);
+		float t0 = -b - sdisc; // closest intersection distance
+		float t1 = -b + sdisc; // furthest intersection distance
+
+		if (t0 >= 0.0f) {
+			// Ray intersects front of sphere
+			tmin = t0;
+			tmax = t0 + t1;
+		}
+		else {
+			// Ray starts inside sphere
+			tmax = t1;
+		}
+		hit = true;
+	}
+
+	return hit;
+}
+
+ConeStart coneMarch(const FractalParams & p, float x0, float y0) {
+	ConeStart cone = { 0.0f, 0 };
+	float x1 = x0 + CONE_BLOCK, y1 = y0 + CONE_BLOCK;
+	vec3f axis = rayDirection(p, (x0 + x1) * 0.5f, (y0 + y1) * 0.5f);
+	float spread = max(max(length(rayDirection(p, x0, y0) - axis), length(rayDirection(p, x1, y1) - axis)),
+		max(length(rayDirection(p, x0, y1) - axis), length(rayDirection(p, x1, y0) - axis)));
+	float t = CPU_MIN_RANGE;
+	float tmin, tmax;
+
+	// Outside the bounding sphere the rays of the block may still hit it, so nothing is skipped
+	if (!intersectBoundingSphere(p, p.cameraPosition + axis * t, axis, tmin, tmax)) return cone;
+
+	for (int i = 0; i < p.stepLimit; i++) {
+		float d = dE(p, p.cameraPosition + axis * t).x * p.surfaceSmoothness - t * spread;
+		if (d < t * p.epsfactor || t > tmax) break;
+		t += d;
+		cone.steps = i + 1;
+	}
+	cone.t = t;
+	return cone;
+}
+
+Hit march(const FractalParams & p, const vec3f & direction, const ConeStart * cone) {
+	Hit h;
+	float ray_length = CPU_MIN_RANGE;
+	vec3f ray = p.cameraPosition + direction * ray_length;
+	float eps = CPU_MIN_EPSILON;
+	vec3f dist(0.0f);
+	int steps = 0;
+	bool hit = false;
+	float tmin = 0.0f;
+	float tmax = 10000.0f;
+
+	if (intersectBoundingSphere(p, ray, direction, tmin, tmax)) {
+		ray_length = cone ? max(tmin, cone->t) : tmin;
+		ray = p.cameraPosition + direction * ray_length;
+
+		for (int i = 0; i < p.stepLimit; i++) {
+			steps = i;
+			dist = dE(p, ray);
+			dist.x *= p.surfaceSmoothness;
+
+			// If we hit the surface on the previous step check again to make sure it wasn't
+			// just a thin filament
+			if ((hit && dist.x < eps) || ray_length > tmax || ray_length < tmin) {
+				steps--;
+				break;
+			}
+
+			hit = false;
+			ray_length += dist.x;
+			ray = p.cameraPosition + direction * ray_length;
+			eps = ray_length * p.epsfactor;
+
+			if (dist.x < eps || ray_length < tmin) {
+				hit = true;
+			}
+		}
+	}
+
+	h.direction = direction;
+	h.position = ray;
+	h.dist = dist;
+	h.length = ray_length;
+	h.eps = eps;
+	h.tmin = tmin;
+	h.tmax = tmax;
+	h.steps = steps;
+	h.coneSteps = cone ? cone->steps : 0;
+	h.hit = hit;
+	return h;
+}
+
+vec3f generateNormal(const FractalParams & p, const vec3f & z, float d) {
+	float e = max(d * 0.5f, CPU_MIN_NORM);
+
+	float dx1 = dE(p, z + vec3f(e, 0, 0)).x;
+	float dx2 = dE(p, z - vec3f(e, 0, 0)).x;
+
+	float dy1 = dE(p, z + vec3f(0, e, 0)).x;
+	float dy2 = dE(p, z - vec3f(0, e, 0)).x;
+
+	float dz1 = dE(p, z + vec3f(0, 0, e)).x;
+	float dz2 = dE(p, z - vec3f(0, 0, e)).x;
+
+	return normalize(vec3f(dx1 - dx2, dy1 - dy2, dz1 - dz2));
+}
+
+vec3f blinnPhong(const FractalParams & p, const vec3f & color, const vec3f & pos, const vec3f & n) {
+	// Ambient colour based on background gradient
+	vec3f ambColor = clamp(mix(p.background2Color, p.background1Color, (sinf(n.y * HALFPI) + 1.0f) * 0.5f), 0.0f, 1.0f);
+	ambColor = mix(vec3f(p.ambientIntensity), ambColor, p.ambientMix);
+
+	vec3f halfLV = normalize(p.light - pos);
+	float diffuse = max(dot(n, halfLV), 0.0f);
+	float specular = powf(diffuse, p.specularExponent);
+
+	return ambColor * color + color * diffuse + vec3f(specular * p.specularity);
+}
+
+float ambientOcclusion(const FractalParams & p, const vec3f & pos, const vec3f & n, float eps) {
+	float o = 1.0f; // Start at full output colour intensity
+	eps *= p.aoSpread; // Spread diffuses the effect
+	float k = p.aoIntensity / eps; // Set intensity factor
+	float d = 2.0f * eps; // Start ray a little off the surface
+
+	for (int i = 0; i < p.aoIterations; ++i) {
+		o -= (d - dE(p, pos + n * d).x) * k;
+		d += eps;
+		k *= 0.5f; // AO contribution drops as we move further from the surface
+	}
+
+	return clampf(o, 0.0f, 1.0f);
+}
+
+bool flatShaded(const Hit & h) {
+	return h.steps < 1 || h.length < h.tmin;
+}
+
+void shade(const FractalParams & p, const Hit & h, float rgba[4]) {
+	float aof = 1.0f;
+	vec3f normal(0.0f);
+	if (h.hit) {
+		if (flatShaded(h)) {
+			normal = normalize(h.position);
+		}
+		else {
+			normal = p.dualNormals ? dualNormal(p, h.position) : generateNormal(p, h.position, h.eps);
+			aof = ambientOcclusion(p, h.position, normal, h.eps);
+		}
+	}
+	shade(p, h, normal, aof, rgba);
+}
+
+void shade(const FractalParams & p, const Hit & h, const vec3f & normal, float aof, float rgba[4]) {
+	vec3f bg = clamp(mix(p.background2Color, p.background1Color, (sinf(h.direction.y * HALFPI) + 1.0f) * 0.5f), 0.0f, 1.0f);
+	vec3f color = bg;
+	float alpha = 1.0f;
+	float glowAmount = (float)(h.steps + h.coneSteps) / (float)p.stepLimit;
+	float glow;
+
+	if (h.hit) {
+		glow = clampf(glowAmount * p.innerGlowIntensity * 3.0f, 0.0f, 1.0f);
+		color = mix(p.color1, mix(p.color2, p.color3, h.dist.y * p.color2Intensity), h.dist.z * p.color3Intensity);
+		color = blinnPhong(p, clamp(color * p.color1Intensity, 0.0f, 1.0f), h.position, normal);
+		color *= aof;
+		color = mix(color, p.innerGlowColor, glow);
+		color = mix(bg, color, expf(-powf(h.length * expf(p.fogFalloff), 2.0f) * p.fog));
+	}
+	else {
+		// Apply outer glow and fog (the shader's parentheses, fog scales the mix amount here)
+		color = mix(bg, color, expf(-powf(h.tmax * expf(p.fogFalloff), 2.0f)) * p.fog);
+		glow = clampf(glowAmount * p.outerGlowIntensity * 3.0f, 0.0f, 1.0f);
+		color = mix(color, p.outerGlowColor, glow);
+		if (p.transparent) {
+			color = vec3f(0.0f);
+			alpha = 0.0f;
+		}
+	}
+
+	rgba[0] = color.x;
+	rgba[1] = color.y;
+	rgba[2] = color.z;
+	rgba[3] = alpha;
+}
+
+int renderPixel(const FractalParams & p, float px, float py, float rgba[4], const ConeStart * cone) {
+	Hit h = march(p, rayDirection(p, px, py), cone);
+	shade(p, h, rgba);
+	return h.steps > 0 ? h.steps : 0; // the cone's are paid once per block
+}
+
+TilePool::TilePool(int threads) : job(0), next(0), finished(0), generation(0), stopping(false) {
+	if (threads <= 0) threads = (int)thread::hardware_concurrency();
+	if (threads < 1) threads = 1;
+	for (int i = 0; i < threads; i++) {
+		workers.push_back(thread(&TilePool::work, this));
+	}
+}
+
+TilePool::~TilePool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+void TilePool::run(unsigned int w, unsigned int h, unsigned int size, const function<void(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)> & fn) {
+	unique_lock<mutex> guard(lock);
+	job = &fn;
+	width = w;
+	height = h;
+	tileSize = size;
+	tilesX = (w + size - 1) / size;
+	tiles = tilesX * ((h + size - 1) / size);
+	next = finished = 0;
+	generation++;
+	wake.notify_all();
+	done.wait(guard, [this] { return finished == tiles; });
+	job = 0;
+}
+
+void TilePool::work() {
+	unsigned long seen = 0;
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		wake.wait(guard, [&] { return stopping || (job && generation != seen && next < tiles); });
+		if (stopping) return;
+		while (next < tiles) { // take tiles until they run out, the lock is only held to pick one
+			unsigned int t = next++;
+			unsigned int x0 = (t % tilesX) * tileSize, y0 = (t / tilesX) * tileSize;
+			unsigned int x1 = min(x0 + tileSize, width), y1 = min(y0 + tileSize, height);
+			const function<void(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)> & fn = *job;
+			guard.unlock();
+			fn(x0, y0, x1, y1, t);
+			guard.lock();
+			if (++finished == tiles) done.notify_all();
+		}
+		seen = generation; // this run is used up, wait for the next
+	}
+}
+
+static inline uint8_t toByte(float v) {
+	return (uint8_t)(clampf(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static void writePixel(const FractalParams & p, const float color[4], uint8_t * out) {
+	if (color[3] < 0.00392f) { // discard
+		out[0] = out[1] = out[2] = out[3] = 0;
+		return;
+	}
+	for (int c = 0; c < 3; c++) out[c] = toByte(powf(color[c], 1.0f / p.gamma));
+	out[3] = toByte(color[3]);
+}
+
+static void sampleOffsets(const FractalParams & p, vector<float> & offsets) { // x, y pairs within a pixel, main() in the shader
+	offsets.clear();
+	if (p.antialiasingOn && p.antialiasing > 0.0f) {
+		for (float sx = 0.0f; sx < 1.0f; sx += p.antialiasing) {
+			for (float sy = 0.0f; sy < 1.0f; sy += p.antialiasing) {
+				offsets.push_back(sx);
+				offsets.push_back(sy);
+			}
+		}
+	}
+	else {
+		offsets.push_back(0.5f); // gl_FragCoord is the pixel centre
+		offsets.push_back(0.5f);
+	}
+}
+
+static long tileCones(const FractalParams & p, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, vector<ConeStart> & cones) { // one per block, row major, returns their steps
+	long steps = 0;
+	cones.clear();
+	for (unsigned int y = y0; y < y1; y += CONE_BLOCK) {
+		for (unsigned int x = x0; x < x1; x += CONE_BLOCK) {
+			cones.push_back(coneMarch(p, (float)x, (float)y));
+			steps += cones.back().steps;
+		}
+	}
+	return steps;
+}
+
+// The whole tile's rays go through marchBatch(), then the normal and AO probes of everything that hit
+// go through dEBatch() the same way, so all of the distance estimates run a packet at a time
+static long renderTilePackets(const FractalParams & p, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, unsigned int width, uint8_t * rgba, bool cones) {
+	vector<float> offsets;
+	sampleOffsets(p, offsets);
+	int samples = (int)offsets.size() / 2;
+	int n = (int)((x1 - x0) * (y1 - y0)) * samples;
+	unsigned int blocksX = (x1 - x0 + CONE_BLOCK - 1) / CONE_BLOCK;
+	vector<vec3f> directions(n);
+	vector<Hit> hits(n);
+	vector<ConeStart> blocks, starts;
+	long steps = 0;
+
+	if (cones) {
+		steps = tileCones(p, x0, y0, x1, y1, blocks);
+		starts.resize(n);
+	}
+	int i = 0;
+	for (unsigned int y = y0; y < y1; y++) {
+		for (unsigned int x = x0; x < x1; x++) {
+			for (int s = 0; s < samples; s++, i++) {
+				directions[i] = rayDirection(p, x + offsets[s * 2], y + offsets[s * 2 + 1]);
+				if (cones) starts[i] = blocks[((y - y0) / CONE_BLOCK) * blocksX + (x - x0) / CONE_BLOCK];
+			}
+		}
+	}
+	marchBatch(p, directions.data(), n, hits.data(), cones ? starts.data() : 0);
+
+	// generateNormal(): six probes per lit hit, in the same order (unless dual numbers do it in one)
+	vector<int> lit;
+	vector<vec3f> points, d;
+	for (i = 0; i < n; i++) {
+		const Hit & h = hits[i];
+		if (!h.hit || flatShaded(h)) continue;
+		float e = max(h.eps * 0.5f, CPU_MIN_NORM);
+		lit.push_back(i);
+		if (p.dualNormals) continue;
+		points.push_back(h.position + vec3f(e, 0, 0));
+		points.push_back(h.position - vec3f(e, 0, 0));
+		points.push_back(h.position + vec3f(0, e, 0));
+		points.push_back(h.position - vec3f(0, e, 0));
+		points.push_back(h.position + vec3f(0, 0, e));
+		points.push_back(h.position - vec3f(0, 0, e));
+	}
+	d.resize(points.size());
+	dEBatch(p, points.data(), (int)points.size(), d.data());
+
+	vector<vec3f> normals(n, vec3f(0.0f));
+	vector<float> aof(n, 1.0f);
+	for (i = 0; i < n; i++) {
+		if (hits[i].hit && flatShaded(hits[i])) normals[i] = normalize(hits[i].position);
+	}
+	for (size_t l = 0; l < lit.size(); l++) {
+		if (p.dualNormals) {
+			normals[lit[l]] = dualNormal(p, hits[lit[l]].position);
+			continue;
+		}
+		const vec3f * q = &d[l * 6];
+		normals[lit[l]] = normalize(vec3f(q[0].x - q[1].x, q[2].x - q[3].x, q[4].x - q[5].x));
+	}
+
+	// ambientOcclusion(): aoIterations probes per lit hit
+	points.clear();
+	for (size_t l = 0; l < lit.size(); l++) {
+		const Hit & h = hits[lit[l]];
+		float eps = h.eps * p.aoSpread, dist = 2.0f * eps;
+		for (int k = 0; k < p.aoIterations; k++) {
+			points.push_back(h.position + normals[lit[l]] * dist);
+			dist += eps;
+		}
+	}
+	d.resize(points.size());
+	dEBatch(p, points.data(), (int)points.size(), d.data());
+	for (size_t l = 0; l < lit.size(); l++) {
+		const Hit & h = hits[lit[l]];
+		float o = 1.0f, eps = h.eps * p.aoSpread;
+		float k = p.aoIntensity / eps, dist = 2.0f * eps;
+		for (int j = 0; j < p.aoIterations; j++) {
+			o -= (dist - d[l * p.aoIterations + j].x) * k;
+			dist += eps;
+			k *= 0.5f;
+		}
+		aof[lit[l]] = clampf(o, 0.0f, 1.0f);
+	}
+
+	i = 0;
+	for (unsigned int y = y0; y < y1; y++) {
+		for (unsigned int x = x0; x < x1; x++) {
+			float color[4] = { 0, 0, 0, 0 }, sample[4];
+			for (int s = 0; s < samples; s++, i++) {
+				shade(p, hits[i], normals[i], aof[i], sample);
+				for (int c = 0; c < 4; c++) color[c] += sample[c];
+				steps += hits[i].steps > 0 ? hits[i].steps : 0;
+			}
+			if (samples > 1) {
+				for (int c = 0; c < 4; c++) color[c] /= samples;
+			}
+			writePixel(p, color, rgba + ((size_t)y * width + x) * 4);
+		}
+	}
+	return steps;
+}
+
+void CpuRaymarcher::render(const FractalParams & p, unsigned int width, unsigned int height, uint8_t * rgba) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	bool batched = packets && packetSupported(p.type);
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	pixels = width * height;
+	tiles.assign(tilesX * tilesY, TileStats());
+
+	pool.run(width, height, TILE_SIZE, [&](unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, unsigned int t) {
+		chrono::steady_clock::time_point tileStart = chrono::steady_clock::now();
+		long steps = 0;
+		if (batched) {
+			steps = renderTilePackets(p, x0, y0, x1, y1, width, rgba, cones);
+		}
+		else {
+			vector<float> offsets;
+			vector<ConeStart> blocks;
+			sampleOffsets(p, offsets);
+			int samples = (int)offsets.size() / 2;
+			unsigned int blocksX = (x1 - x0 + CONE_BLOCK - 1) / CONE_BLOCK;
+			if (cones) steps = tileCones(p, x0, y0, x1, y1, blocks);
+			for (unsigned int y = y0; y < y1; y++) {
+				for (unsigned int x = x0; x < x1; x++) {
+					float color[4] = { 0, 0, 0, 0 }, sample[4];
+					const ConeStart * cone = cones ? &blocks[((y - y0) / CONE_BLOCK) * blocksX + (x - x0) / CONE_BLOCK] : 0;
+					for (int s = 0; s < samples; s++) {
+						steps += renderPixel(p, x + offsets[s * 2], y + offsets[s * 2 + 1], sample, cone);
+						for (int c = 0; c < 4; c++) color[c] += sample[c];
+					}
+					if (samples > 1) {
+						for (int c = 0; c < 4; c++) color[c] /= samples;
+					}
+					writePixel(p, color, rgba + ((size_t)y * width + x) * 4); // y counts up from the bottom, like GL
+				}
+			}
+		}
+		tiles[t].ms = chrono::duration<float, milli>(chrono::steady_clock::now() - tileStart).count();
+		tiles[t].steps = steps;
+	});
+
+	totalMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+	lastBatched = batched;
+}
+
+void CpuRaymarcher::report() {
+	float slowest = 0.0f, sum = 0.0f;
+	long steps = 0;
+	size_t worst = 0;
+	for (size_t i = 0; i < tiles.size(); i++) {
+		sum += tiles[i].ms;
+		steps += tiles[i].steps;
+		if (tiles[i].ms > slowest) {
+			slowest = tiles[i].ms;
+			worst = i;
+		}
+	}
+	cout << "CPU render: " << totalMs << " ms on " << pool.threads() << " threads, " << tiles.size() << " tiles of " << TILE_SIZE << "x" << TILE_SIZE;
+	if (lastBatched) cout << ", " << packetWidth() << " ray packets";
+	cout << endl;
+	if (tiles.empty()) return;
+	cout << "  tile average " << sum / tiles.size() << " ms, slowest " << slowest << " ms (tile " << worst % tilesX << "," << worst / tilesX << ")" << endl;
+	cout << "  " << (float)steps / pixels << " march steps per pixel, " << sum / totalMs << " tiles in flight on average" << endl;
+}
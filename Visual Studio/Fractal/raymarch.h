@@ -0,0 +1,219 @@
+#ifndef __RAYMARCH_H__
+#define __RAYMARCH_H__
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// CPU port of 3d_fractals.frag, for machines without a usable GPU and for batch renders.
+// The functions mirror the shader's one for one (same names, same constants) so a change
+// to one is easy to carry over to the other.
+
+#define TILE_SIZE 32 // pixels per side of a tile, small enough to balance, big enough to keep a core busy
+#define CONE_BLOCK 8 // pixels per side of a cone pre-pass block, CONE_BLOCK in the shader too (TILE_SIZE is a multiple)
+#define CPU_MIN_EPSILON 6e-7f // MIN_EPSILON in the shader
+#define CPU_MIN_NORM 1.5e-7f // MIN_NORM
+#define CPU_MIN_RANGE 6e-5f // minRange
+#define CPU_BAILOUT 4.0f // bailout (Mandelbulb)
+#define GRID_CELLS 32 // coarse cells per side of the baked distance grid, GRID_CELLS in the shader too
+#define BRICK_SIZE 8 // samples per side of a brick, corner to corner of one coarse cell (BRICK_SIZE in the shader)
+
+class Shader;
+
+struct vec3f {
+	float x, y, z;
+	vec3f() {}
+	vec3f(float x, float y, float z) : x(x), y(y), z(z) {}
+	explicit vec3f(float s) : x(s), y(s), z(s) {}
+	vec3f operator+(const vec3f & b) const { return vec3f(x + b.x, y + b.y, z + b.z); }
+	vec3f operator-(const vec3f & b) const { return vec3f(x - b.x, y - b.y, z - b.z); }
+	vec3f operator*(const vec3f & b) const { return vec3f(x * b.x, y * b.y, z * b.z); }
+	vec3f operator*(float s) const { return vec3f(x * s, y * s, z * s); }
+	vec3f operator/(float s) const { return vec3f(x / s, y / s, z / s); }
+	vec3f & operator+=(const vec3f & b) { x += b.x; y += b.y; z += b.z; return *this; }
+	vec3f & operator-=(const vec3f & b) { x -= b.x; y -= b.y; z -= b.z; return *this; }
+	vec3f & operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+};
+inline float dot(const vec3f & a, const vec3f & b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const vec3f & a) { return sqrtf(dot(a, a)); }
+inline vec3f normalize(const vec3f & a) { return a / length(a); }
+inline vec3f abs(const vec3f & a) { return vec3f(fabsf(a.x), fabsf(a.y), fabsf(a.z)); }
+inline float clampf(float a, float lo, float hi) { return a < lo ? lo : (a > hi ? hi : a); }
+inline float mixf(float a, float b, float t) { return a + (b - a) * t; }
+inline vec3f mix(const vec3f & a, const vec3f & b, float t) { return a + (b - a) * t; }
+inline vec3f clamp(const vec3f & a, float lo, float hi) { return vec3f(clampf(a.x, lo, hi), clampf(a.y, lo, hi), clampf(a.z, lo, hi)); }
+inline float modf_glsl(float a, float b) { return a - b * floorf(a / b); } // GLSL mod(), always takes the sign of b
+
+struct mat3f { // column major, the same layout as GLSL (and set_uniformMatrix3f)
+	float m[9];
+	vec3f operator*(const vec3f & v) const { // M * v
+		return vec3f(m[0] * v.x + m[3] * v.y + m[6] * v.z, m[1] * v.x + m[4] * v.y + m[7] * v.z, m[2] * v.x + m[5] * v.y + m[8] * v.z);
+	}
+	mat3f operator*(const mat3f & b) const;
+};
+inline vec3f operator*(const vec3f & v, const mat3f & a) { // v * M, what the shader's "w *= objectRotation" means
+	return vec3f(v.x * a.m[0] + v.y * a.m[1] + v.z * a.m[2], v.x * a.m[3] + v.y * a.m[4] + v.z * a.m[5], v.x * a.m[6] + v.y * a.m[7] + v.z * a.m[8]);
+}
+
+struct FractalParams { // the shader's uniforms and its global pre-calculations, read once per frame
+	void load(Shader * shader, float width, float height); // from the CPU side uniform copies, size and outputSize set to width x height
+	int type, maxIterations, stepLimit, aoIterations, colorIterations;
+	int aoResolution; // the GPU's AO pass only, the CPU always works it out per pixel
+	bool antialiasingOn, transparent;
+	float antialiasing, gamma;
+	float sizeX, sizeY, aspectRatio;
+	float scale, power, surfaceDetail, surfaceSmoothness, boundingRadius;
+	vec3f offset, shift;
+	float cameraRoll, cameraPitch, cameraYaw, cameraFocalLength;
+	vec3f cameraPosition;
+	vec3f color1, color2, color3;
+	float color1Intensity, color2Intensity, color3Intensity;
+	vec3f light, background1Color, background2Color, innerGlowColor, outerGlowColor;
+	float ambientIntensity, ambientMix; // ambientColor.x and .y
+	float innerGlowIntensity, outerGlowIntensity, fog, fogFalloff, specularity, specularExponent;
+	float aoIntensity, aoSpread;
+	mat3f objectRotation, fractalRotation1, fractalRotation2;
+	float sphereHoles, sphereScale, phi, boxScale, boxFold, fudgeFactor, juliaFactor, radiolariaFactor, radiolaria;
+	// Pre-calculations, named as in the shader
+	float fovfactor, pixelScale, epsfactor;
+	mat3f cameraRotation;
+	vec3f halfSpongeScale, scale_offset, phi3, c3;
+	float mR2, fR2, scaleFactorX, scaleFactorY;
+	bool dualNormals; // normals from dEGradient() rather than six dE() calls (CPU only, load() picks per type)
+};
+bool sameSurface(const FractalParams & a, const FractalParams & b); // every setting that moves the surface is equal (camera, colours and lighting may differ)
+bool sameView(const FractalParams & a, const FractalParams & b); // and every ray finds the same hit: only colours and lighting may differ
+bool sameLook(const FractalParams & a, const FractalParams & b); // and every pixel comes out the same colour
+
+// Distance estimates: x = distance, y and z = orbit values for colouring
+vec3f MengerSponge(const FractalParams & p, vec3f w);
+vec3f SphereSponge(const FractalParams & p, vec3f w);
+vec3f Mandelbulb(const FractalParams & p, vec3f w);
+vec3f Mandelbox(const FractalParams & p, vec3f w);
+vec3f OctahedralIFS(const FractalParams & p, vec3f w);
+vec3f DodecahedronIFS(const FractalParams & p, vec3f w);
+vec3f dE(const FractalParams & p, const vec3f & w); // the one for p.type
+
+struct Hit { // result of marching one ray, everything the shading needs
+	vec3f direction, position; // ray direction, and where it stopped
+	vec3f dist; // last dE(), y and z colour the surface
+	float length; // distance along the ray
+	float eps; // surface threshold at that distance
+	float tmin, tmax; // bounding sphere span
+	int steps; // taken by this ray
+	int coneSteps; // taken by the cone pre-pass on its behalf, glows like its own
+	bool hit;
+};
+
+struct ConeStart { // from the cone pre-pass, shared by every ray of a block
+	float t; // distance the rays can skip
+	int steps; // steps the cone took, added to the rays' own for the glow
+};
+
+vec3f rayDirection(const FractalParams & p, float px, float py);
+bool intersectBoundingSphere(const FractalParams & p, const vec3f & origin, const vec3f & direction, float & tmin, float & tmax);
+ConeStart coneMarch(const FractalParams & p, float x0, float y0); // coneMarch() in the shader, for the block with its bottom left corner at x0, y0
+Hit march(const FractalParams & p, const vec3f & direction, const ConeStart * cone = 0); // the marching loop from render()
+vec3f generateNormal(const FractalParams & p, const vec3f & z, float d); // central differences, always (dualNormals is up to the caller)
+float ambientOcclusion(const FractalParams & p, const vec3f & pos, const vec3f & n, float eps);
+vec3f blinnPhong(const FractalParams & p, const vec3f & color, const vec3f & pos, const vec3f & n);
+void shade(const FractalParams & p, const Hit & h, float rgba[4]); // colour, glow and fog, as the end of render()
+void shade(const FractalParams & p, const Hit & h, const vec3f & normal, float aof, float rgba[4]); // same, normal and AO already worked out
+bool flatShaded(const Hit & h); // a hit that gets normalize(position) and no AO (stopped on the bounding sphere)
+int renderPixel(const FractalParams & p, float px, float py, float rgba[4], const ConeStart * cone = 0); // render() for one sample, returns the steps it took
+
+// Gradients (raydual.cpp): the distance part of each DE through forward mode dual numbers,
+// so a normal costs one pass instead of generateNormal()'s six dE() calls
+float dEGradient(const FractalParams & p, const vec3f & w, vec3f & gradient); // dE(p, w).x, and its gradient
+vec3f dualNormal(const FractalParams & p, const vec3f & z);
+void compareNormals(const FractalParams & p, unsigned int width, unsigned int height); // both kinds at every hit: timing and the angle between them
+
+// Ray packets (raypacket.cpp): the same results as dE() / march(), SIMD lanes at a time.
+// Without SSE2 or AVX2, or for the other types, these just loop over the scalar versions.
+bool packetSupported(int type); // Mandelbulb and Mandelbox, when built with SIMD
+int packetWidth(); // rays per packet: 8 when the CPU has AVX2, otherwise 4 with SSE2
+void dEBatch(const FractalParams & p, const vec3f * points, int n, vec3f * out);
+void marchBatch(const FractalParams & p, const vec3f * directions, int n, Hit * hits, const ConeStart * cones = 0); // march() for each direction (cones: one per ray, or 0), finished lanes refilled from the rest
+
+// Baked distance grid (raygrid.cpp): dE() sampled once over the bounding cube, coarse everywhere and
+// finer in a brick per cell near the surface. The shader steps by it far from the surface and only
+// calls dE() close in, so orbiting a fixed fractal skips most of the iterations.
+struct DistanceGrid {
+	float radius; // half the cube's side, the cube is centred on the origin
+	std::vector<float> coarse; // dE() at the (GRID_CELLS + 1)^3 cell corners, x fastest
+	std::vector<float> index; // per cell: x, y, z of its brick in the atlas, -1 for none (GRID_CELLS^3 * 3)
+	std::vector<float> bricks; // the atlas, atlasX x atlasY x atlasZ bricks of BRICK_SIZE^3 samples, laid out as one 3D texture
+	int atlasX, atlasY, atlasZ, brickCount;
+	float cellSize() const { return 2.0f * radius / GRID_CELLS; }
+	float exact() const { return 2.0f * cellSize() / (BRICK_SIZE - 1); } // below this bound the grid hands over to dE()
+	float distance(const vec3f & q) const; // lower bound on dE() at q, gridDistance() in the shader (0 outside the cube)
+};
+bool bakeGrid(const FractalParams & p, DistanceGrid & grid, const std::function<bool()> & cancelled); // false if cancelled part way
+
+class GridBaker { // bakes a DistanceGrid on its own thread, the render thread picks it up when it's done
+public:
+	GridBaker();
+	~GridBaker();
+	void bake(const FractalParams & p); // start over for these parameters, any bake in progress is dropped
+	bool finished(DistanceGrid & grid); // true once per completed bake, the grid is moved out
+	float lastMs; // how long the last completed bake took
+private:
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	FractalParams job;
+	bool queued, ready, stopping;
+	std::atomic<unsigned long> generation; // bumped by bake(), a running bake gives up when it changes
+	DistanceGrid result;
+	void work();
+};
+
+struct TileStats { // per tile timing, to see where the time goes
+	float ms; // wall clock for the tile
+	long steps; // march steps taken in it
+};
+
+class TilePool { // a fixed set of worker threads handing out tiles from a shared counter
+public:
+	TilePool(int threads = 0); // 0 == one per core
+	~TilePool();
+	// Calls work(x0, y0, x1, y1, tileIndex) for every tile of a width x height image, returns when all are done
+	void run(unsigned int width, unsigned int height, unsigned int tileSize, const std::function<void(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)> & work);
+	int threads() const { return (int)workers.size(); }
+private:
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	const std::function<void(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int)> * job;
+	unsigned int width, height, tileSize, tilesX, tiles, next, finished;
+	unsigned long generation; // bumped for every run(), so a worker never runs the same one twice
+	bool stopping;
+	void work();
+};
+
+// Mesh export (raymesh.cpp): marching cubes where dE() is half a cell, on resolution^3 cells over the
+// bounding cube (rounded up to a power of two), only in the blocks an octree finds near the surface.
+// Triangles go to the file as they're made, .ply with shared vertices or .stl, by the path's extension.
+bool writeMesh(const FractalParams & p, const char * path, unsigned int resolution, int threads = 0); // 0 threads == one per core
+
+class CpuRaymarcher { // renders the 3D fractals on all cores, a tile at a time
+public:
+	CpuRaymarcher(int threads = 0) : packets(true), cones(true), pool(threads), lastBatched(false) {}
+	// 8 bit RGBA, bottom row first like glReadPixels, so the same save_ppm() call works for both
+	void render(const FractalParams & p, unsigned int width, unsigned int height, uint8_t * rgba);
+	std::vector<TileStats> tiles; // from the last render, row major
+	float totalMs;
+	void report(); // slowest tile, average, steps per pixel
+	int threads() const { return pool.threads(); }
+	bool packets; // march Mandelbulb and Mandelbox in ray packets, false for the plain per pixel path
+	bool cones; // cone pre-pass per CONE_BLOCK block, false to march every ray from the bounding sphere
+private:
+	TilePool pool;
+	unsigned int tilesX, tilesY, pixels;
+	bool lastBatched;
+};
+#endif
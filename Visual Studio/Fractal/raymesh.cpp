@@ -0,0 +1,429 @@
+/** raymesh.cpp
+ * Mesh export: the 3D fractal's surface as triangles, for 3D printing or other tools.
+ * Marching cubes over a lattice on the bounding cube, where the surface is dE() == half a
+ * cell (the Mandelbox's estimate never goes below 0, and it keeps every part printable).
+ * The lattice's outer faces count as outside, so anything the cube cuts off is capped flat
+ * and the mesh is always closed.
+ * An octree finds the blocks the surface can pass through: a DE changes by at most the
+ * distance moved, so a node whose centre is further from the surface than its half diagonal
+ * holds none of it and is never sampled. The blocks left (leaves, LEAF_CELLS on a side) are
+ * marched on every core and their triangles go straight out to the file.
+ * STL repeats every vertex per triangle, so it is simply appended. PLY shares them: a vertex
+ * inside a leaf belongs to that leaf alone, one on a leaf's face goes through a sharded map
+ * (the first leaf to get there owns it), so threads only meet when they hash to the same shard.
+ * Vertices land in a side file at the index their leaf was given, faces in another (naming
+ * not yet owned vertices by edge), and the two are joined into the .ply at the end.
+ */
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+
+#include "raymarch.h"
+
+using namespace std;
+
+#define LEAF_CELLS 16 // cells per side of an octree leaf, one job for the pool
+#define MESH_SLACK 1.5f // the estimates aren't all exactly 1-Lipschitz (the bulb's overshoots a little), prune with room to spare
+#define EDGE_SHARDS 64 // locks in the vertex map, enough that threads rarely wait on each other
+#define EDGE_TAG (1ull << 63) // a face corner given as an edge key, resolved when the file is put together
+#define MESH_PENDING 0xffffffffu // owned, index not handed out yet
+#define MESH_MAX_CELLS (1 << 20) // edge keys have 20 bits per axis
+
+// Marching cubes cases, worked out once at startup rather than typed in as the usual table.
+// Corner i is at (i & 1, i >> 1 & 1, i >> 2 & 1), edges are x, then y, then z, low corner first.
+static const int edgeCorners[12][2] = { { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+
+struct CubeCase {
+	int triangles;
+	signed char edges[36]; // three per triangle (12 is the most the tracing below can make)
+};
+static CubeCase cubeCases[256];
+
+static int edgeBetween(int a, int b) {
+	for (int e = 0; e < 12; e++) {
+		if ((edgeCorners[e][0] == a && edgeCorners[e][1] == b) || (edgeCorners[e][0] == b && edgeCorners[e][1] == a)) return e;
+	}
+	return -1;
+}
+
+static bool sameFace(int e, int f) { // both edges on one face of the cube
+	for (int a = 0; a < 3; a++) {
+		int bits = edgeCorners[e][0] >> a & 1;
+		if ((edgeCorners[e][1] >> a & 1) == bits && (edgeCorners[f][0] >> a & 1) == bits && (edgeCorners[f][1] >> a & 1) == bits) return true;
+	}
+	return false;
+}
+
+static vec3f corner(int i) {
+	return vec3f((float)(i & 1), (float)(i >> 1 & 1), (float)(i >> 2 & 1));
+}
+
+static vec3f cross(const vec3f & a, const vec3f & b) {
+	return vec3f(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// Each face is walked anticlockwise seen from outside. A run of inside corners enters the surface on
+// one edge and leaves on another, and the surface crosses the face from where it leaves back to where
+// it entered. Two opposite inside corners are two runs: always separated, and since the neighbouring
+// cube sees the same four values it cuts the face the same way, so there are never cracks. Every edge
+// the surface crosses is left by on one of its faces and entered by on the other, so following
+// exits to entries closes into loops, one polygon each.
+static void buildCubeCases() {
+	int faces[6][4];
+	for (int a = 0; a < 3; a++) {
+		int u = (a + 1) % 3, v = (a + 2) % 3;
+		for (int s = 0; s < 2; s++) {
+			int cyc[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } }; // anticlockwise about u x v == +a
+			for (int k = 0; k < 4; k++) {
+				int c = s << a | cyc[k][0] << u | cyc[k][1] << v;
+				faces[a * 2 + s][s ? k : 3 - k] = c; // the low face looks down -a, reverse it
+			}
+		}
+	}
+	for (int config = 0; config < 256; config++) {
+		int next[12];
+		bool seen[12] = { false };
+		CubeCase & cc = cubeCases[config];
+		cc.triangles = 0;
+		for (int e = 0; e < 12; e++) next[e] = -1;
+		for (int f = 0; f < 6; f++) {
+			const int * c = faces[f];
+			for (int k = 0; k < 4; k++) {
+				bool in = (config >> c[k] & 1) != 0, before = (config >> c[(k + 3) % 4] & 1) != 0;
+				if (!in || before) continue; // runs start at an inside corner after an outside one
+				int j = k;
+				while (config >> c[j] & 1) j = (j + 1) % 4; // first outside corner after the run
+				next[edgeBetween(c[(j + 3) % 4], c[j])] = edgeBetween(c[(k + 3) % 4], c[k]);
+			}
+		}
+		for (int e = 0; e < 12; e++) {
+			if (next[e] < 0 || seen[e]) continue;
+			int loop[12], n = 0;
+			for (int i = e; !seen[i]; i = next[i]) {
+				seen[i] = true;
+				loop[n++] = i;
+			}
+			int from = 0; // fan from a corner none of whose diagonals lie in a face, where the next cube's triangles would be
+			for (int k = 0; k < n; k++) {
+				bool flat = false;
+				for (int i = 2; i + 1 < n; i++) flat = flat || sameFace(loop[k], loop[(k + i) % n]);
+				if (!flat) {
+					from = k;
+					break;
+				}
+			}
+			for (int i = 1; i + 1 < n; i++) {
+				cc.edges[cc.triangles * 3] = (signed char)loop[from];
+				cc.edges[cc.triangles * 3 + 1] = (signed char)loop[(from + i) % n];
+				cc.edges[cc.triangles * 3 + 2] = (signed char)loop[(from + i + 1) % n];
+				cc.triangles++;
+			}
+		}
+	}
+	// Wind them so the normal points out of the surface (towards corners above the iso level):
+	// check the lone inside corner 0 and flip every case if it came out the other way
+	const CubeCase & one = cubeCases[1];
+	vec3f p[3];
+	for (int i = 0; i < 3; i++) p[i] = (corner(edgeCorners[one.edges[i]][0]) + corner(edgeCorners[one.edges[i]][1])) * 0.5f;
+	if (dot(cross(p[1] - p[0], p[2] - p[0]), vec3f(1.0f)) < 0.0f) {
+		for (int config = 0; config < 256; config++) {
+			for (int t = 0; t < cubeCases[config].triangles; t++) swap(cubeCases[config].edges[t * 3 + 1], cubeCases[config].edges[t * 3 + 2]);
+		}
+	}
+}
+
+class EdgeMap { // edge key -> vertex index, for the vertices on leaf faces; one lock per shard
+public:
+	bool claim(uint64_t key) { // true if nobody had it, the caller owns it and set()s its index
+		Shard & s = shard(key);
+		lock_guard<mutex> guard(s.lock);
+		return s.map.insert(make_pair(key, MESH_PENDING)).second;
+	}
+	void set(uint64_t key, uint32_t index) {
+		Shard & s = shard(key);
+		lock_guard<mutex> guard(s.lock);
+		s.map[key] = index;
+	}
+	uint32_t find(uint64_t key) { // once every leaf is done
+		Shard & s = shard(key);
+		unordered_map<uint64_t, uint32_t>::iterator it = s.map.find(key);
+		return it == s.map.end() ? MESH_PENDING : it->second;
+	}
+	size_t size() {
+		size_t n = 0;
+		for (int i = 0; i < EDGE_SHARDS; i++) n += shards[i].map.size();
+		return n;
+	}
+private:
+	struct Shard {
+		mutex lock;
+		unordered_map<uint64_t, uint32_t> map;
+	};
+	Shard shards[EDGE_SHARDS];
+	Shard & shard(uint64_t key) {
+		return shards[(key * 0x9E3779B97F4A7C15ull) >> 58]; // top 6 bits of a Fibonacci hash
+	}
+};
+
+struct Leaf {
+	int x, y, z; // low corner, in cells
+};
+
+static void findLeaves(const FractalParams & p, float iso, float radius, float cell, int x, int y, int z, int size, vector<Leaf> & leaves) {
+	float half = size * cell * 0.5f;
+	vec3f centre = vec3f(x * cell + half - radius, y * cell + half - radius, z * cell + half - radius);
+	if (fabsf(dE(p, centre).x - iso) > half * sqrtf(3.0f) * MESH_SLACK) return; // all outside or all inside
+	if (size == LEAF_CELLS) {
+		Leaf leaf = { x, y, z };
+		leaves.push_back(leaf);
+		return;
+	}
+	size /= 2;
+	for (int i = 0; i < 8; i++) findLeaves(p, iso, radius, cell, x + (i & 1) * size, y + (i >> 1 & 1) * size, z + (i >> 2 & 1) * size, size, leaves);
+}
+
+static bool seek(FILE * f, uint64_t offset) {
+#if defined(__unix__) || defined(unix)
+	return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#else // assume windows
+	return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#endif
+}
+
+struct MeshWriter { // the output files, and what the leaves share
+	bool ply;
+	FILE * out; // STL: the file itself; PLY: the faces side file
+	FILE * vertices; // PLY only, vertex i at i * 12
+	mutex outLock, vertexLock;
+	EdgeMap edges;
+	atomic<uint64_t> vertexCount, triangleCount;
+	bool failed;
+};
+
+static void marchLeaf(const FractalParams & p, const Leaf & leaf, int cells, float iso, float radius, float cell, MeshWriter & w) {
+	const int s = LEAF_CELLS + 1;
+	vector<vec3f> points(s * s * s), samples(s * s * s);
+	vector<float> v(s * s * s);
+	unordered_map<uint64_t, uint32_t> local; // edge key -> index into verts
+	vector<vec3f> verts;
+	vector<uint64_t> keys;
+	vector<bool> boundary;
+	vector<uint32_t> triangles;
+
+	for (int z = 0, i = 0; z < s; z++)
+		for (int y = 0; y < s; y++)
+			for (int x = 0; x < s; x++) points[i++] = vec3f((leaf.x + x) * cell - radius, (leaf.y + y) * cell - radius, (leaf.z + z) * cell - radius);
+	dEBatch(p, &points[0], s * s * s, &samples[0]);
+	for (int z = 0, i = 0; z < s; z++) {
+		for (int y = 0; y < s; y++) {
+			for (int x = 0; x < s; x++, i++) {
+				float d = samples[i].x == samples[i].x ? samples[i].x : 0.0f; // 0/0 at the bulb's centre, which is in the set
+				int gx = leaf.x + x, gy = leaf.y + y, gz = leaf.z + z;
+				bool edge = gx == 0 || gy == 0 || gz == 0 || gx == cells || gy == cells || gz == cells;
+				v[i] = edge ? max(d - iso, 0.0f) : d - iso; // outside on the cube's faces, so whatever it cuts off is capped there and the mesh stays closed
+			}
+		}
+	}
+
+	for (int z = 0; z < LEAF_CELLS; z++) {
+		for (int y = 0; y < LEAF_CELLS; y++) {
+			for (int x = 0; x < LEAF_CELLS; x++) {
+				int at[8], config = 0;
+				for (int c = 0; c < 8; c++) {
+					at[c] = (x + (c & 1)) + s * ((y + (c >> 1 & 1)) + s * (z + (c >> 2 & 1)));
+					if (v[at[c]] < 0.0f) config |= 1 << c;
+				}
+				const CubeCase & cc = cubeCases[config];
+				for (int t = 0; t < cc.triangles * 3; t++) {
+					int e = cc.edges[t], a = edgeCorners[e][0], axis = e / 4;
+					int lx = x + (a & 1), ly = y + (a >> 1 & 1), lz = z + (a >> 2 & 1); // low end, in the leaf
+					uint64_t key = (uint64_t)(leaf.x + lx) | (uint64_t)(leaf.y + ly) << 20 | (uint64_t)(leaf.z + lz) << 40 | (uint64_t)axis << 60;
+					pair<unordered_map<uint64_t, uint32_t>::iterator, bool> found = local.insert(make_pair(key, (uint32_t)verts.size()));
+					if (found.second) { // first use in this leaf
+						float va = v[at[a]], vb = v[at[edgeCorners[e][1]]];
+						float f = va / (va - vb); // where it crosses zero
+						vec3f pos = points[at[a]];
+						if (axis == 0) pos.x += f * cell;
+						else if (axis == 1) pos.y += f * cell;
+						else pos.z += f * cell;
+						verts.push_back(pos);
+						keys.push_back(key);
+						boundary.push_back((axis != 0 && (lx == 0 || lx == LEAF_CELLS)) || (axis != 1 && (ly == 0 || ly == LEAF_CELLS)) || (axis != 2 && (lz == 0 || lz == LEAF_CELLS)));
+					}
+					triangles.push_back(found.first->second);
+				}
+			}
+		}
+	}
+	if (triangles.empty()) return;
+	w.triangleCount += triangles.size() / 3;
+
+	if (!w.ply) { // 50 bytes a triangle: normal, three corners, no attributes
+		vector<uint8_t> block(triangles.size() / 3 * 50);
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			const vec3f & a = verts[triangles[t]], & b = verts[triangles[t + 1]], & c = verts[triangles[t + 2]];
+			vec3f n = cross(b - a, c - a);
+			float l = length(n);
+			float facet[12] = { 0.0f, 0.0f, 0.0f, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
+			if (l > 0.0f) {
+				facet[0] = n.x / l;
+				facet[1] = n.y / l;
+				facet[2] = n.z / l;
+			}
+			memcpy(&block[t / 3 * 50], facet, 48);
+		}
+		lock_guard<mutex> guard(w.outLock);
+		if (fwrite(&block[0], 1, block.size(), w.out) != block.size()) w.failed = true;
+		return;
+	}
+
+	// Ours: everything inside the leaf, plus whichever face vertices we got to first
+	vector<uint32_t> index(verts.size());
+	vector<float> mine;
+	for (size_t i = 0; i < verts.size(); i++) {
+		index[i] = MESH_PENDING;
+		if (boundary[i] && !w.edges.claim(keys[i])) continue;
+		index[i] = (uint32_t)(mine.size() / 3); // relative for now
+		mine.push_back(verts[i].x);
+		mine.push_back(verts[i].y);
+		mine.push_back(verts[i].z);
+	}
+	uint64_t base = w.vertexCount.fetch_add(mine.size() / 3);
+	for (size_t i = 0; i < verts.size(); i++) {
+		if (index[i] == MESH_PENDING) continue;
+		index[i] += (uint32_t)base;
+		if (boundary[i]) w.edges.set(keys[i], index[i]);
+	}
+	if (!mine.empty()) {
+		lock_guard<mutex> guard(w.vertexLock);
+		if (!seek(w.vertices, base * 12) || fwrite(&mine[0], sizeof(float), mine.size(), w.vertices) != mine.size()) w.failed = true;
+	}
+	vector<uint64_t> faces(triangles.size());
+	for (size_t t = 0; t < triangles.size(); t++) {
+		uint32_t i = triangles[t];
+		faces[t] = index[i] != MESH_PENDING ? index[i] : keys[i] | EDGE_TAG;
+	}
+	lock_guard<mutex> guard(w.outLock);
+	if (fwrite(&faces[0], sizeof(uint64_t), faces.size(), w.out) != faces.size()) w.failed = true;
+}
+
+static bool finishPly(const char * path, MeshWriter & w, const string & vertexPath, const string & facePath) {
+	FILE * out = fopen(path, "wb");
+	if (!out) {
+		cout << "Can't write " << path << endl;
+		return false;
+	}
+	uint16_t one = 1; // the floats and ints go out as they are in memory
+	fprintf(out, "ply\nformat %s 1.0\n", *(uint8_t *)&one ? "binary_little_endian" : "binary_big_endian");
+	fprintf(out, "element vertex %llu\nproperty float x\nproperty float y\nproperty float z\n", (unsigned long long)w.vertexCount);
+	fprintf(out, "element face %llu\nproperty list uchar int vertex_indices\nend_header\n", (unsigned long long)w.triangleCount);
+
+	vector<uint8_t> buffer(1 << 20);
+	size_t got;
+	FILE * in = fopen(vertexPath.c_str(), "rb");
+	bool ok = in != 0;
+	while (ok && (got = fread(&buffer[0], 1, buffer.size(), in)) > 0) ok = fwrite(&buffer[0], 1, got, out) == got;
+	if (in) fclose(in);
+
+	vector<uint64_t> faces(3 * 4096);
+	in = fopen(facePath.c_str(), "rb");
+	ok = ok && in != 0;
+	while (ok && (got = fread(&faces[0], sizeof(uint64_t) * 3, faces.size() / 3, in)) > 0) {
+		size_t n = 0;
+		for (size_t t = 0; t < got; t++) {
+			buffer[n++] = 3;
+			for (int k = 0; k < 3; k++) {
+				uint64_t f = faces[t * 3 + k];
+				int32_t i = (int32_t)(f & EDGE_TAG ? w.edges.find(f & ~EDGE_TAG) : f); // the owner has long since written it
+				memcpy(&buffer[n], &i, 4);
+				n += 4;
+			}
+		}
+		ok = fwrite(&buffer[0], 1, n, out) == n;
+	}
+	if (in) fclose(in);
+	ok = fclose(out) == 0 && ok;
+	if (!ok) cout << "Failed writing " << path << endl;
+	return ok;
+}
+
+bool writeMesh(const FractalParams & p, const char * path, unsigned int resolution, int threads) {
+	static bool built = false;
+	if (!built) {
+		buildCubeCases();
+		built = true;
+	}
+	string ext = path;
+	ext = ext.size() > 4 ? ext.substr(ext.size() - 4) : "";
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext != ".ply" && ext != ".stl") {
+		cout << "Mesh files are .ply or .stl, not " << path << endl;
+		return false;
+	}
+
+	unsigned int cells = LEAF_CELLS;
+	while (cells < resolution && cells < MESH_MAX_CELLS) cells *= 2; // the octree halves down to leaves
+	float radius = sqrtf(p.boundingRadius); // the sphere the rays see, as in bakeGrid()
+	float cell = 2.0f * radius / cells;
+	float iso = 0.5f * cell;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	vector<Leaf> leaves;
+	findLeaves(p, iso, radius, cell, 0, 0, 0, cells, leaves);
+	float findMs = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+
+	MeshWriter w;
+	string vertexPath = string(path) + ".vertices", facePath = string(path) + ".faces";
+	w.ply = ext == ".ply";
+	w.vertexCount = 0;
+	w.triangleCount = 0;
+	w.failed = false;
+	w.vertices = 0;
+	w.out = fopen(w.ply ? facePath.c_str() : path, "wb");
+	if (w.ply && w.out) w.vertices = fopen(vertexPath.c_str(), "wb");
+	if (!w.out || (w.ply && !w.vertices)) {
+		cout << "Can't write " << path << endl;
+		if (w.out) fclose(w.out);
+		return false;
+	}
+	if (!w.ply) { // header now, the count once it is known
+		char header[80] = "Fractal mesh";
+		uint32_t count = 0;
+		fwrite(header, 1, 80, w.out);
+		fwrite(&count, 4, 1, w.out);
+	}
+
+	TilePool pool(threads);
+	cout << "Meshing " << cells << "^3 cells, " << leaves.size() << " of " << (cells / LEAF_CELLS) * (cells / LEAF_CELLS) * (cells / LEAF_CELLS) << " blocks near the surface, on " << pool.threads() << " threads" << endl;
+	pool.run((unsigned int)leaves.size(), 1, 1, [&](unsigned int x0, unsigned int, unsigned int, unsigned int, unsigned int) {
+		marchLeaf(p, leaves[x0], (int)cells, iso, radius, cell, w);
+	});
+
+	bool ok = !w.failed;
+	if (!w.ply) {
+		uint32_t count = (uint32_t)w.triangleCount;
+		ok = ok && seek(w.out, 80) && fwrite(&count, 4, 1, w.out) == 1;
+		ok = fclose(w.out) == 0 && ok;
+	}
+	else {
+		fclose(w.out);
+		fclose(w.vertices);
+		if (w.vertexCount > 0x7fffffffu) {
+			cout << "Too many vertices for a .ply (int indices), use a lower resolution" << endl;
+			ok = false;
+		}
+		ok = ok && finishPly(path, w, vertexPath, facePath);
+		remove(vertexPath.c_str());
+		remove(facePath.c_str());
+	}
+	float ms = chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Wrote " << path << ": " << w.triangleCount << " triangles";
+	if (w.ply) cout << ", " << w.vertexCount << " vertices (" << w.edges.size() << " shared between blocks)";
+	cout << " in " << ms << " ms (octree " << findMs << " ms)" << endl;
+	return ok;
+}
@@ -0,0 +1,529 @@
+/** raypacket.cpp
+ * Ray packets for the CPU marcher: Mandelbulb and Mandelbox evaluated for 8 rays
+ * at once (AVX2) or 4 (SSE2), structure of arrays, one lane per ray. Each lane
+ * marches on its own and stops on its own; when one finishes the next ray from
+ * the queue takes its place, so the lanes stay full until the queue runs dry.
+ * Mandelbulb's powN needs atan2, asin, pow, sin and cos per lane, those are the
+ * usual cephes single precision polynomials (as in sse_mathfun), good to a few ulp.
+ *
+ * The packets are built twice: here with SSE2 (namespace sse2), and again by
+ * raypacket_avx2.cpp (namespace avx2), the one file compiled for AVX2. The public
+ * functions at the end pick between them once, from what the CPU reports.
+ */
+#include <cmath>
+#include <cstring>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "raymarch.h"
+
+#if defined(RAYPACKET_AVX2)
+#define RAYPACKET_LANES avx2
+#else
+#define RAYPACKET_LANES sse2
+#endif
+
+#if defined(RAYPACKET_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+#define PACKET 8
+typedef __m256 vf;
+typedef __m256i vi;
+#define v_set1 _mm256_set1_ps
+#define v_load _mm256_loadu_ps
+#define v_store _mm256_storeu_ps
+#define v_add _mm256_add_ps
+#define v_sub _mm256_sub_ps
+#define v_mul _mm256_mul_ps
+#define v_div _mm256_div_ps
+#define v_min _mm256_min_ps
+#define v_max _mm256_max_ps
+#define v_sqrt _mm256_sqrt_ps
+#define v_and _mm256_and_ps
+#define v_or _mm256_or_ps
+#define v_andnot _mm256_andnot_ps // ~a & b
+#define v_xor _mm256_xor_ps
+#define v_lt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define v_gt(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define v_eq(a, b) _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#define v_select(m, a, b) _mm256_blendv_ps(b, a, m) // m ? a : b
+#define v_mask _mm256_movemask_ps
+#define v_toint _mm256_cvttps_epi32
+#define v_tofloat _mm256_cvtepi32_ps
+#define v_asint _mm256_castps_si256
+#define v_asfloat _mm256_castsi256_ps
+#define i_set1 _mm256_set1_epi32
+#define i_add _mm256_add_epi32
+#define i_sub _mm256_sub_epi32
+#define i_and _mm256_and_si256
+#define i_andnot _mm256_andnot_si256
+#define i_eq _mm256_cmpeq_epi32
+#define i_sll _mm256_slli_epi32
+#define i_srl _mm256_srli_epi32
+#define RAYPACKET_SIMD
+#elif !defined(RAYPACKET_AVX2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define PACKET 4
+typedef __m128 vf;
+typedef __m128i vi;
+#define v_set1 _mm_set1_ps
+#define v_load _mm_loadu_ps
+#define v_store _mm_storeu_ps
+#define v_add _mm_add_ps
+#define v_sub _mm_sub_ps
+#define v_mul _mm_mul_ps
+#define v_div _mm_div_ps
+#define v_min _mm_min_ps
+#define v_max _mm_max_ps
+#define v_sqrt _mm_sqrt_ps
+#define v_and _mm_and_ps
+#define v_or _mm_or_ps
+#define v_andnot _mm_andnot_ps
+#define v_xor _mm_xor_ps
+#define v_lt _mm_cmplt_ps
+#define v_gt _mm_cmpgt_ps
+#define v_eq _mm_cmpeq_ps
+#define v_select(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)) // no blendv before SSE4.1
+#define v_mask _mm_movemask_ps
+#define v_toint _mm_cvttps_epi32
+#define v_tofloat _mm_cvtepi32_ps
+#define v_asint _mm_castps_si128
+#define v_asfloat _mm_castsi128_ps
+#define i_set1 _mm_set1_epi32
+#define i_add _mm_add_epi32
+#define i_sub _mm_sub_epi32
+#define i_and _mm_and_si128
+#define i_andnot _mm_andnot_si128
+#define i_eq _mm_cmpeq_epi32
+#define i_sll _mm_slli_epi32
+#define i_srl _mm_srli_epi32
+#define RAYPACKET_SIMD
+#else
+#define PACKET 1 // no SIMD: packetSupported() says no and the scalar marcher does everything
+#endif
+
+using namespace std;
+
+namespace RAYPACKET_LANES {
+
+#ifdef RAYPACKET_SIMD
+
+static inline vf v_floor(vf x) { // truncate, then step down where that rounded up (negatives)
+	vf t = v_tofloat(v_toint(x));
+	return v_sub(t, v_and(v_gt(t, x), v_set1(1.0f)));
+}
+
+static inline vf v_clamp(vf x, vf lo, vf hi) {
+	return v_min(v_max(x, lo), hi);
+}
+
+static inline vf v_log(vf x) { // natural log, x > 0
+	vi i = v_asint(x);
+	vf e = v_tofloat(i_sub(i_srl(i, 23), i_set1(126))); // exponent, for a mantissa in [0.5, 1)
+	vf m = v_asfloat(i_add(i_and(i, i_set1(0x007fffff)), i_set1(0x3f000000)));
+	vf small = v_lt(m, v_set1(0.707106781186547524f)); // keep the mantissa near 1
+	e = v_sub(e, v_and(small, v_set1(1.0f)));
+	m = v_sub(v_add(m, v_and(small, m)), v_set1(1.0f));
+
+	vf z = v_mul(m, m);
+	vf y = v_set1(7.0376836292E-2f);
+	y = v_add(v_mul(y, m), v_set1(-1.1514610310E-1f));
+	y = v_add(v_mul(y, m), v_set1(1.1676998740E-1f));
+	y = v_add(v_mul(y, m), v_set1(-1.2420140846E-1f));
+	y = v_add(v_mul(y, m), v_set1(1.4249322787E-1f));
+	y = v_add(v_mul(y, m), v_set1(-1.6668057665E-1f));
+	y = v_add(v_mul(y, m), v_set1(2.0000714765E-1f));
+	y = v_add(v_mul(y, m), v_set1(-2.4999993993E-1f));
+	y = v_add(v_mul(y, m), v_set1(3.3333331174E-1f));
+	y = v_mul(v_mul(y, m), z);
+	y = v_add(y, v_mul(e, v_set1(-2.12194440e-4f)));
+	y = v_sub(y, v_mul(z, v_set1(0.5f)));
+	return v_add(v_add(m, y), v_mul(e, v_set1(0.693359375f)));
+}
+
+static inline vf v_exp(vf x) {
+	x = v_clamp(x, v_set1(-88.3762626647949f), v_set1(88.3762626647949f));
+	vf fx = v_floor(v_add(v_mul(x, v_set1(1.44269504088896341f)), v_set1(0.5f)));
+	x = v_sub(x, v_mul(fx, v_set1(0.693359375f)));
+	x = v_sub(x, v_mul(fx, v_set1(-2.12194440e-4f)));
+
+	vf z = v_mul(x, x);
+	vf y = v_set1(1.9875691500E-4f);
+	y = v_add(v_mul(y, x), v_set1(1.3981999507E-3f));
+	y = v_add(v_mul(y, x), v_set1(8.3334519073E-3f));
+	y = v_add(v_mul(y, x), v_set1(4.1665795894E-2f));
+	y = v_add(v_mul(y, x), v_set1(1.6666665459E-1f));
+	y = v_add(v_mul(y, x), v_set1(5.0000001201E-1f));
+	y = v_add(v_add(v_mul(y, z), x), v_set1(1.0f));
+	return v_mul(y, v_asfloat(i_sll(i_add(v_toint(fx), i_set1(127)), 23))); // * 2^fx
+}
+
+static inline void v_sincos(vf x, vf * s, vf * c) {
+	const vf signBit = v_asfloat(i_set1((int)0x80000000));
+	vf sinSign = v_and(x, signBit);
+	x = v_andnot(signBit, x); // |x|
+
+	vi j = v_toint(v_mul(x, v_set1(1.27323954473516f))); // octant, 4 / pi
+	j = i_and(i_add(j, i_set1(1)), i_set1(~1));
+	vf y = v_tofloat(j);
+	vf swapSin = v_asfloat(i_sll(i_and(j, i_set1(4)), 29));
+	vf polyMask = v_asfloat(i_eq(i_and(j, i_set1(2)), i_set1(0)));
+	vf cosSign = v_asfloat(i_sll(i_andnot(i_sub(j, i_set1(2)), i_set1(4)), 29));
+
+	x = v_add(x, v_mul(y, v_set1(-0.78515625f))); // extended precision x - y * pi / 4
+	x = v_add(x, v_mul(y, v_set1(-2.4187564849853515625e-4f)));
+	x = v_add(x, v_mul(y, v_set1(-3.77489497744594108e-8f)));
+
+	vf z = v_mul(x, x);
+	vf yc = v_set1(2.443315711809948E-005f);
+	yc = v_add(v_mul(yc, z), v_set1(-1.388731625493765E-003f));
+	yc = v_add(v_mul(yc, z), v_set1(4.166664568298827E-002f));
+	yc = v_mul(v_mul(yc, z), z);
+	yc = v_add(v_sub(yc, v_mul(z, v_set1(0.5f))), v_set1(1.0f));
+
+	vf ys = v_set1(-1.9515295891E-4f);
+	ys = v_add(v_mul(ys, z), v_set1(8.3321608736E-3f));
+	ys = v_add(v_mul(ys, z), v_set1(-1.6666654611E-1f));
+	ys = v_add(v_mul(v_mul(ys, z), x), x);
+
+	*s = v_xor(v_select(polyMask, ys, yc), v_xor(sinSign, swapSin));
+	*c = v_xor(v_select(polyMask, yc, ys), cosSign);
+}
+
+static inline vf v_atan(vf x) {
+	const vf signBit = v_asfloat(i_set1((int)0x80000000));
+	vf sign = v_and(x, signBit);
+	x = v_andnot(signBit, x);
+
+	vf big = v_gt(x, v_set1(2.414213562373095f)); // tan(3pi/8)
+	vf mid = v_andnot(big, v_gt(x, v_set1(0.4142135623730950f))); // tan(pi/8)
+	vf y0 = v_or(v_and(big, v_set1(1.570796326794897f)), v_and(mid, v_set1(0.7853981633974483f)));
+	x = v_select(big, v_div(v_set1(-1.0f), x), v_select(mid, v_div(v_sub(x, v_set1(1.0f)), v_add(x, v_set1(1.0f))), x));
+
+	vf z = v_mul(x, x);
+	vf y = v_set1(8.05374449538e-2f);
+	y = v_add(v_mul(y, z), v_set1(-1.38776856032E-1f));
+	y = v_add(v_mul(y, z), v_set1(1.99777106478E-1f));
+	y = v_add(v_mul(y, z), v_set1(-3.33329491539E-1f));
+	y = v_add(v_add(v_mul(v_mul(y, z), x), x), y0);
+	return v_xor(y, sign);
+}
+
+static inline vf v_atan2(vf y, vf x) { // atan2f() per lane, 0 for (0, 0) like the C library
+	const vf zero = v_set1(0.0f);
+	vf a = v_atan(v_div(y, x));
+	vf negX = v_lt(x, zero);
+	vf pi = v_select(v_lt(y, zero), v_set1(-3.14159265358979f), v_set1(3.14159265358979f));
+	a = v_add(a, v_and(negX, pi));
+	vf origin = v_and(v_eq(x, zero), v_eq(y, zero));
+	return v_andnot(origin, a);
+}
+
+struct vec3v { // PACKET vec3s, one per lane
+	vf x, y, z;
+};
+
+static inline vf dot(const vec3v & a, const vec3v & b) {
+	return v_add(v_add(v_mul(a.x, b.x), v_mul(a.y, b.y)), v_mul(a.z, b.z));
+}
+
+static inline vec3v mulRow(const vec3v & v, const mat3f & a) { // v * M
+	vec3v r;
+	r.x = v_add(v_add(v_mul(v.x, v_set1(a.m[0])), v_mul(v.y, v_set1(a.m[1]))), v_mul(v.z, v_set1(a.m[2])));
+	r.y = v_add(v_add(v_mul(v.x, v_set1(a.m[3])), v_mul(v.y, v_set1(a.m[4]))), v_mul(v.z, v_set1(a.m[5])));
+	r.z = v_add(v_add(v_mul(v.x, v_set1(a.m[6])), v_mul(v.y, v_set1(a.m[7]))), v_mul(v.z, v_set1(a.m[8])));
+	return r;
+}
+
+static void MandelboxPacket(const FractalParams & p, vec3v w, vec3v & out) {
+	w = mulRow(w, p.objectRotation);
+	const vf fold = v_set1(p.boxFold), nfold = v_set1(-p.boxFold), fold2 = v_set1(2.0f * p.boxFold);
+	const vf fR2 = v_set1(p.fR2), mR2 = v_set1(p.mR2), zero = v_set1(0.0f), one = v_set1(1.0f);
+	const vf sx = v_set1(p.scaleFactorX), sy = v_set1(p.scaleFactorY);
+	const vf ox = v_set1(p.offset.x), oy = v_set1(p.offset.y), oz = v_set1(p.offset.z);
+	vf md = v_set1(1000.0f);
+	vec3v c = w, z = w;
+	vf dr = one;
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		// box fold
+		z.x = v_sub(v_mul(v_clamp(z.x, nfold, fold), fold2), z.x);
+		z.y = v_sub(v_mul(v_clamp(z.y, nfold, fold), fold2), z.y);
+		z.z = v_sub(v_mul(v_clamp(z.z, nfold, fold), fold2), z.z);
+		z = mulRow(z, p.fractalRotation1);
+
+		// sphere fold
+		vf d = dot(z, z);
+		vf k = v_clamp(v_max(v_div(fR2, d), mR2), zero, one);
+		z.x = v_mul(z.x, k);
+		z.y = v_mul(z.y, k);
+		z.z = v_mul(z.z, k);
+		dr = v_mul(dr, k);
+
+		// scale and translate
+		z.x = v_add(v_add(v_mul(z.x, sx), w.x), ox);
+		z.y = v_add(v_add(v_mul(z.y, sx), w.y), oy);
+		z.z = v_add(v_add(v_mul(z.z, sx), w.z), oz);
+		dr = v_add(v_mul(dr, sy), one);
+		z = mulRow(z, p.fractalRotation2);
+
+		if (i < p.colorIterations) {
+			md = v_min(md, d);
+			c = z;
+		}
+	}
+
+	out.x = v_div(v_sub(v_sqrt(dot(z, z)), v_set1(p.fudgeFactor)), dr);
+	out.y = md;
+	out.z = v_add(v_mul(v_set1(0.33f), v_log(dot(c, c))), one);
+}
+
+static void MandelbulbPacket(const FractalParams & p, vec3v w, vec3v & out) {
+	w = mulRow(w, p.objectRotation);
+	const vf power = v_set1(p.power), powerLess1 = v_set1(p.power - 1.0f), one = v_set1(1.0f), zero = v_set1(0.0f);
+	const vf bailout = v_set1(CPU_BAILOUT), radFactor = v_set1(p.radiolariaFactor), rad = v_set1(p.radiolaria);
+	const vf julia = v_set1(p.juliaFactor);
+	vec3v z = w, d = w, c;
+	c.x = v_add(w.x, v_mul(v_sub(v_set1(p.offset.x), w.x), julia));
+	c.y = v_add(w.y, v_mul(v_sub(v_set1(p.offset.y), w.y), julia));
+	c.z = v_add(w.z, v_mul(v_sub(v_set1(p.offset.z), w.z), julia));
+	vf dr = one;
+	vf r = v_sqrt(dot(z, z));
+	vf md = v_set1(10000.0f);
+	vf running = v_asfloat(i_set1(-1)); // lanes that haven't bailed out yet
+
+	for (int i = 0; i < p.maxIterations; i++) {
+		// powN: the same spherical form as the shader, asin(z.z / r) written as an atan2 so one routine does both
+		vf zo = v_mul(v_atan2(z.z, v_sqrt(v_add(v_mul(z.x, z.x), v_mul(z.y, z.y)))), power);
+		vf zi = v_mul(v_atan2(z.y, z.x), power);
+		vf zr = v_and(v_gt(r, zero), v_exp(v_mul(v_log(r), powerLess1))); // pow(r, power - 1), 0 at the origin
+		vf sinZo, cosZo, sinZi, cosZi;
+		v_sincos(zo, &sinZo, &cosZo);
+		v_sincos(zi, &sinZi, &cosZi);
+		vf newDr = v_add(v_mul(v_mul(zr, dr), power), one);
+		zr = v_mul(zr, r);
+
+		vec3v nz;
+		nz.x = v_add(v_mul(v_mul(cosZo, cosZi), zr), c.x);
+		nz.y = v_add(v_mul(v_mul(cosZo, sinZi), zr), c.y);
+		nz.z = v_add(v_mul(sinZo, zr), c.z);
+		nz.y = v_select(v_gt(nz.y, radFactor), v_add(nz.y, v_mul(v_sub(radFactor, nz.y), rad)), nz.y);
+		vf nr = v_sqrt(dot(nz, nz));
+
+		// lanes that bailed out keep what they had
+		z.x = v_select(running, nz.x, z.x);
+		z.y = v_select(running, nz.y, z.y);
+		z.z = v_select(running, nz.z, z.z);
+		dr = v_select(running, newDr, dr);
+		r = v_select(running, nr, r);
+
+		if (i < p.colorIterations) {
+			md = v_select(running, v_min(md, r), md);
+			d.x = v_select(running, z.x, d.x);
+			d.y = v_select(running, z.y, d.y);
+			d.z = v_select(running, z.z, d.z);
+		}
+
+		running = v_andnot(v_gt(r, bailout), running);
+		if (v_mask(running) == 0) break;
+	}
+
+	out.x = v_div(v_mul(v_mul(v_set1(0.5f), v_log(r)), r), dr);
+	out.y = md;
+	out.z = v_add(v_mul(v_set1(0.33f), v_log(dot(d, d))), one);
+}
+
+static inline void dEPacket(const FractalParams & p, const float * x, const float * y, const float * z, float * dx, float * dy, float * dz) {
+	vec3v w, out;
+	w.x = v_load(x);
+	w.y = v_load(y);
+	w.z = v_load(z);
+	if (p.type == 2) MandelbulbPacket(p, w, out);
+	else MandelboxPacket(p, w, out);
+	v_store(dx, out.x);
+	v_store(dy, out.y);
+	v_store(dz, out.z);
+}
+
+void dEBatch(const FractalParams & p, const vec3f * points, int n, vec3f * out) {
+	float x[PACKET], y[PACKET], z[PACKET], dx[PACKET], dy[PACKET], dz[PACKET];
+	if (!packetSupported(p.type)) {
+		for (int i = 0; i < n; i++) out[i] = dE(p, points[i]);
+		return;
+	}
+	for (int i = 0; i < n; i += PACKET) {
+		int lanes = n - i < PACKET ? n - i : PACKET;
+		for (int l = 0; l < PACKET; l++) {
+			const vec3f & pt = points[i + (l < lanes ? l : 0)]; // pad with a repeat of the first
+			x[l] = pt.x;
+			y[l] = pt.y;
+			z[l] = pt.z;
+		}
+		dEPacket(p, x, y, z, dx, dy, dz);
+		for (int l = 0; l < lanes; l++) out[i + l] = vec3f(dx[l], dy[l], dz[l]);
+	}
+}
+
+struct Lane { // march() state for the ray in one lane
+	int ray; // index into directions / hits, -1 == empty
+	int i; // loop counter
+	float length, eps, tmin, tmax;
+	bool hit;
+};
+
+void marchBatch(const FractalParams & p, const vec3f * directions, int n, Hit * hits, const ConeStart * cones) {
+	Lane lanes[PACKET];
+	float x[PACKET], y[PACKET], z[PACKET], dx[PACKET], dy[PACKET], dz[PACKET];
+	int next = 0, busy = 0;
+	if (!packetSupported(p.type)) {
+		for (int i = 0; i < n; i++) hits[i] = march(p, directions[i], cones ? &cones[i] : 0);
+		return;
+	}
+
+	for (int l = 0; l < PACKET; l++) lanes[l].ray = -1;
+	for (;;) {
+		for (int l = 0; l < PACKET; l++) { // refill the empty lanes from the queue
+			while (lanes[l].ray < 0 && next < n) {
+				Lane & s = lanes[l];
+				Hit & h = hits[next];
+				h.direction = directions[next];
+				h.dist = vec3f(0.0f);
+				h.steps = 0;
+				h.coneSteps = cones ? cones[next].steps : 0;
+				h.hit = false;
+				h.eps = CPU_MIN_EPSILON;
+				h.length = CPU_MIN_RANGE;
+				h.position = p.cameraPosition + h.direction * CPU_MIN_RANGE;
+				if (!intersectBoundingSphere(p, h.position, h.direction, h.tmin, h.tmax)) { // misses the bounding sphere: done without a single step
+					next++;
+					continue;
+				}
+				s.i = 0;
+				s.length = cones ? max(h.tmin, cones[next].t) : h.tmin;
+				if (p.stepLimit <= 0) { // no steps at all
+					h.length = s.length;
+					h.position = p.cameraPosition + h.direction * s.length;
+					next++;
+					continue;
+				}
+				s.ray = next++;
+				s.eps = CPU_MIN_EPSILON;
+				s.tmin = h.tmin;
+				s.tmax = h.tmax;
+				s.hit = false;
+				busy++;
+			}
+		}
+		if (busy == 0) break;
+
+		for (int l = 0; l < PACKET; l++) {
+			const Lane & s = lanes[l];
+			vec3f pos = s.ray >= 0 ? p.cameraPosition + directions[s.ray] * s.length : p.cameraPosition; // idle lanes just go along
+			x[l] = pos.x;
+			y[l] = pos.y;
+			z[l] = pos.z;
+		}
+		dEPacket(p, x, y, z, dx, dy, dz);
+
+		for (int l = 0; l < PACKET; l++) { // the loop body of march(), per lane
+			Lane & s = lanes[l];
+			if (s.ray < 0) continue;
+			Hit & h = hits[s.ray];
+			vec3f dist(dx[l] * p.surfaceSmoothness, dy[l], dz[l]);
+			bool done = false;
+
+			h.dist = dist;
+			h.steps = s.i;
+			if ((s.hit && dist.x < s.eps) || s.length > s.tmax || s.length < s.tmin) {
+				h.steps--;
+				done = true;
+			}
+			else {
+				s.hit = false;
+				s.length += dist.x;
+				s.eps = s.length * p.epsfactor;
+				if (dist.x < s.eps || s.length < s.tmin) s.hit = true;
+				if (++s.i >= p.stepLimit) done = true; // out of steps
+			}
+			if (done) {
+				h.length = s.length;
+				h.position = p.cameraPosition + h.direction * s.length;
+				h.eps = s.eps;
+				h.hit = s.hit;
+				s.ray = -1; // refilled on the next pass
+				busy--;
+			}
+		}
+	}
+}
+
+int packetWidth() {
+	return PACKET;
+}
+
+#else	// RAYPACKET_SIMD
+
+void dEBatch(const FractalParams & p, const vec3f * points, int n, vec3f * out) {
+	for (int i = 0; i < n; i++) out[i] = dE(p, points[i]);
+}
+
+void marchBatch(const FractalParams & p, const vec3f * directions, int n, Hit * hits, const ConeStart * cones) {
+	for (int i = 0; i < n; i++) hits[i] = march(p, directions[i], cones ? &cones[i] : 0);
+}
+
+int packetWidth() {
+	return 1;
+}
+
+#endif	// RAYPACKET_SIMD
+
+}	// namespace RAYPACKET_LANES
+
+#ifndef RAYPACKET_AVX2
+
+namespace avx2 { // raypacket_avx2.cpp: 8 wide if the compiler could target AVX2, otherwise width 1 and unused
+	int packetWidth();
+	void dEBatch(const FractalParams & p, const vec3f * points, int n, vec3f * out);
+	void marchBatch(const FractalParams & p, const vec3f * directions, int n, Hit * hits, const ConeStart * cones);
+}
+
+static bool cpuHasAvx2() { // the instructions, and an OS that saves the ymm registers
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) return false; // OSXSAVE, AVX, xmm and ymm state
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
+static const bool avx2Packets = avx2::packetWidth() == 8 && cpuHasAvx2(); // decided once, before main()
+
+bool packetSupported(int type) {
+	return packetWidth() > 1 && (type == 2 || type == 3); // Mandelbulb and Mandelbox
+}
+
+int packetWidth() {
+	return avx2Packets ? avx2::packetWidth() : sse2::packetWidth();
+}
+
+void dEBatch(const FractalParams & p, const vec3f * points, int n, vec3f * out) {
+	if (avx2Packets) avx2::dEBatch(p, points, n, out);
+	else sse2::dEBatch(p, points, n, out);
+}
+
+void marchBatch(const FractalParams & p, const vec3f * directions, int n, Hit * hits, const ConeStart * cones) {
+	if (avx2Packets) avx2::marchBatch(p, directions, n, hits, cones);
+	else sse2::marchBatch(p, directions, n, hits, cones);
+}
+
+#endif	// RAYPACKET_AVX2
@@ -0,0 +1,7 @@
+/** raypacket_avx2.cpp
+ * raypacket.cpp's packets again, 8 lanes wide, in namespace avx2. This is the only
+ * file built for AVX2 (/arch:AVX2, -mavx2), so the rest of the program still runs
+ * on CPUs without it; raypacket.cpp only calls in here when cpuid says it can.
+ */
+#define RAYPACKET_AVX2
+#include "raypacket.cpp"
@@ -0,0 +1,137 @@
+/** readback.cpp
+ * Getting pixels back from the GPU without stalling it. Each capture starts a
+ * glReadPixels into a pixel buffer object and fences it; the data is only
+ * mapped a frame or two later, once the fence says the copy has finished, so
+ * frame N is copied out while frame N+1 is being rendered.
+ */
+#include <cstring>
+#include <iostream>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "readback.h"
+
+using namespace std;
+
+FramePool::~FramePool() {
+	for (size_t i = 0; i < spare.size(); i++) {
+		delete[] spare[i]->pixels;
+		delete spare[i];
+	}
+}
+
+Frame * FramePool::acquire(unsigned int width, unsigned int height) {
+	size_t bytes = (size_t)width * height * 4;
+	Frame * frame = 0;
+	{
+		lock_guard<mutex> guard(lock);
+		if (!spare.empty()) {
+			frame = spare.back();
+			spare.pop_back();
+		}
+	}
+	if (!frame) {
+		frame = new Frame;
+		frame->pixels = 0;
+		frame->capacity = 0;
+	}
+	if (frame->capacity < bytes) { // only grows, a recording is normally one size throughout
+		delete[] frame->pixels;
+		frame->pixels = new uint8_t[bytes];
+		frame->capacity = bytes;
+	}
+	frame->width = width;
+	frame->height = height;
+	return frame;
+}
+
+void FramePool::release(Frame * frame) {
+	if (!frame) return;
+	lock_guard<mutex> guard(lock);
+	spare.push_back(frame);
+}
+
+PixelReadback::PixelReadback() : stalls(0), head(0), count(0) {
+	for (int i = 0; i < READBACK_RING; i++) {
+		ring[i].pbo = 0;
+		ring[i].size = 0;
+		ring[i].fence = 0;
+	}
+}
+
+PixelReadback::~PixelReadback() {
+	for (int i = 0; i < READBACK_RING; i++) {
+		if (ring[i].fence) glDeleteSync(ring[i].fence);
+		if (ring[i].pbo) glDeleteBuffers(1, &ring[i].pbo);
+	}
+	for (size_t i = 0; i < ready.size(); i++) pool.release(ready[i]);
+}
+
+void PixelReadback::capture(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	if (count == READBACK_RING) { // nobody collected in time: wait for the oldest rather than lose a frame
+		ready.push_back(retire(true));
+		stalls++;
+	}
+	Slot & s = ring[(head + count) % READBACK_RING];
+	size_t bytes = (size_t)width * height * 4;
+
+	if (!s.pbo) glGenBuffers(1, &s.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+	if (bytes > s.size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, 0, GL_STREAM_READ);
+		s.size = bytes;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0); // 0 == offset into the PBO, returns straight away
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	s.width = width;
+	s.height = height;
+	count++;
+}
+
+Frame * PixelReadback::retire(bool wait) {
+	Slot & s = ring[head];
+	size_t bytes = (size_t)s.width * s.height * 4;
+	Frame * frame;
+	const void * src;
+
+	if (wait) {
+		while (glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED); // 1s at a time
+	}
+	else if (glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+		return 0; // still copying, try again next frame
+	}
+	glDeleteSync(s.fence);
+	s.fence = 0;
+	head = (head + 1) % READBACK_RING;
+	count--;
+
+	frame = pool.acquire(s.width, s.height);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+	src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (src) {
+		memcpy(frame->pixels, src, bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		cout << "PixelReadback: failed to map pixel buffer" << endl;
+		memset(frame->pixels, 0, bytes); // keep the frame count right, a black frame beats a missing one
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return frame;
+}
+
+Frame * PixelReadback::collect(bool wait) {
+	if (!ready.empty()) {
+		Frame * frame = ready.front();
+		ready.pop_front();
+		return frame;
+	}
+	if (count == 0) return 0;
+	return retire(wait);
+}
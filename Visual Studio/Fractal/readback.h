@@ -0,0 +1,50 @@
+#ifndef __READBACK_H__
+#define __READBACK_H__
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+#define READBACK_RING 3 // frames in flight, the GPU copies into one while we map another
+
+struct Frame { // a captured frame in CPU memory, owned by a FramePool
+	unsigned int width, height;
+	uint8_t * pixels; // RGBA, bottom row first (GL order)
+	size_t capacity; // bytes allocated, buffers are reused for any frame that fits
+};
+
+class FramePool { // reusable frame buffers instead of a new[] per capture, release() is safe from any thread
+public:
+	~FramePool();
+	Frame * acquire(unsigned int width, unsigned int height);
+	void release(Frame * frame);
+private:
+	std::mutex lock;
+	std::vector<Frame *> spare;
+};
+
+class PixelReadback { // asynchronous glReadPixels through a ring of pixel buffer objects (render thread only)
+public:
+	PixelReadback();
+	~PixelReadback();
+	void capture(unsigned int x, unsigned int y, unsigned int width, unsigned int height); // after drawing, before the swap; returns straight away
+	Frame * collect(bool wait = false); // oldest finished capture or 0 if none is ready yet, hand it back with release()
+	void release(Frame * frame) { pool.release(frame); }
+	int pending() const { return count + (int)ready.size(); } // captures not yet collected
+	int stalls; // times capture() found the ring full and had to wait for the GPU
+private:
+	struct Slot {
+		GLuint pbo;
+		size_t size;
+		GLsync fence; // signalled once the copy into pbo is done
+		unsigned int width, height;
+	};
+	Slot ring[READBACK_RING];
+	int head, count; // oldest capture in flight, and how many
+	std::deque<Frame *> ready; // retired early because the ring was full
+	FramePool pool;
+
+	Frame * retire(bool wait); // map the oldest slot into a pooled frame, 0 if the GPU isn't done and !wait
+};
+#endif
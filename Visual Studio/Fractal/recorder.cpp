@@ -0,0 +1,221 @@
+/** recorder.cpp
+ * Screen recording: frames read back by PixelReadback are handed to a writer
+ * thread through a lock free queue, converted to YUV 4:2:0 there and written
+ * out as YUV4MPEG2, which ffmpeg (or any player) reads straight from a file
+ * or a pipe. The render thread only ever pushes a pointer, if the writer falls
+ * behind frames are dropped and counted rather than slowing the window down.
+ */
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#if defined(__unix__) || defined(unix)
+#else	// assume windows
+#include <io.h>
+#include <fcntl.h>
+#endif	// __unix__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RECORDER_SSE2
+#endif
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+#include "util.h"
+#include "recorder.h"
+
+using namespace std;
+
+bool FrameQueue::push(Frame * frame) {
+	size_t t = tail.load(memory_order_relaxed);
+	size_t next = (t + 1) % (RECORD_QUEUE + 1);
+	if (next == head.load(memory_order_acquire)) return false; // full
+	slots[t] = frame;
+	tail.store(next, memory_order_release); // publishes slots[t] to the consumer
+	return true;
+}
+
+Frame * FrameQueue::pop() {
+	size_t h = head.load(memory_order_relaxed);
+	if (h == tail.load(memory_order_acquire)) return 0; // empty
+	Frame * frame = slots[h];
+	head.store((h + 1) % (RECORD_QUEUE + 1), memory_order_release); // hands the slot back to the producer
+	return frame;
+}
+
+// BT.601 studio range, the same integer formulas in both paths so they give identical bytes:
+//  Y = ((66 R + 129 G + 25 B + 128) >> 8) + 16
+//  U = ((-38 R - 74 G + 112 B + 512) >> 10) + 128, with R, G, B summed over a 2x2 block, likewise V
+static inline uint8_t lumaOf(const uint8_t * p) {
+	return (uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+}
+
+void rgba_to_i420(const uint8_t * rgba, unsigned int width, unsigned int height, uint8_t * y, uint8_t * u, uint8_t * v) {
+	size_t stride = (size_t)width * 4;
+	unsigned int cw = width / 2;
+
+	for (unsigned int row = 0; row < height; row += 2) {
+		const uint8_t * src0 = rgba + (height - 1 - row) * stride; // flip: GL's first row is the bottom one
+		const uint8_t * src1 = src0 - stride;
+		uint8_t * y0 = y + (size_t)row * width;
+		uint8_t * y1 = y0 + width;
+		uint8_t * uRow = u + (size_t)(row / 2) * cw;
+		uint8_t * vRow = v + (size_t)(row / 2) * cw;
+		unsigned int x = 0;
+#ifdef RECORDER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i yCoeff = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+		const __m128i uCoeff = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+		const __m128i vCoeff = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+		const __m128i yRound = _mm_set1_epi32(128);
+		const __m128i yOffset = _mm_set1_epi16(16);
+		const __m128i cRound = _mm_set1_epi32(512);
+		const __m128i cOffset = _mm_set1_epi16(128);
+		for (; x + 4 <= width; x += 4) { // 4 pixels from each row, 2 chroma samples
+			__m128i p0 = _mm_loadu_si128((const __m128i *)(src0 + x * 4));
+			__m128i p1 = _mm_loadu_si128((const __m128i *)(src1 + x * 4));
+			__m128i p0lo = _mm_unpacklo_epi8(p0, zero), p0hi = _mm_unpackhi_epi8(p0, zero); // 16 bit R,G,B,A x2
+			__m128i p1lo = _mm_unpacklo_epi8(p1, zero), p1hi = _mm_unpackhi_epi8(p1, zero);
+
+			// luma: madd gives [66R+129G, 25B] per pixel, a shuffle lines the halves up to be added
+			__m128i luma[2];
+			for (int r = 0; r < 2; r++) {
+				__m128i lo = _mm_madd_epi16(r ? p1lo : p0lo, yCoeff);
+				__m128i hi = _mm_madd_epi16(r ? p1hi : p0hi, yCoeff);
+				lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+				hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+				__m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				luma[r] = _mm_srai_epi32(_mm_add_epi32(sum, yRound), 8);
+			}
+			__m128i l = _mm_add_epi16(_mm_packs_epi32(luma[0], luma[1]), yOffset);
+			l = _mm_packus_epi16(l, l); // row 0 in bytes 0-3, row 1 in 4-7
+			int l0 = _mm_cvtsi128_si32(l), l1 = _mm_cvtsi128_si32(_mm_srli_si128(l, 4));
+			memcpy(y0 + x, &l0, 4);
+			memcpy(y1 + x, &l1, 4);
+
+			// chroma: sum each 2x2 block (at most 1020 per channel), then the same madd trick
+			__m128i lo = _mm_add_epi16(p0lo, p1lo), hi = _mm_add_epi16(p0hi, p1hi);
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+			__m128i blocks = _mm_unpacklo_epi64(lo, hi); // R,G,B,A sums of block 0, then block 1
+			__m128i mu = _mm_shuffle_epi32(_mm_madd_epi16(blocks, uCoeff), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i mv = _mm_shuffle_epi32(_mm_madd_epi16(blocks, vCoeff), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i c = _mm_add_epi32(_mm_unpacklo_epi64(mu, mv), _mm_unpackhi_epi64(mu, mv)); // u0,u1,v0,v1
+			c = _mm_srai_epi32(_mm_add_epi32(c, cRound), 10);
+			c = _mm_add_epi16(_mm_packs_epi32(c, c), cOffset);
+			int uv = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+			uRow[x / 2] = (uint8_t)uv;
+			uRow[x / 2 + 1] = (uint8_t)(uv >> 8);
+			vRow[x / 2] = (uint8_t)(uv >> 16);
+			vRow[x / 2 + 1] = (uint8_t)(uv >> 24);
+		}
+#endif	// RECORDER_SSE2
+		for (; x < width; x += 2) {
+			const uint8_t * a = src0 + x * 4, * b = src1 + x * 4;
+			int r = a[0] + a[4] + b[0] + b[4];
+			int g = a[1] + a[5] + b[1] + b[5];
+			int bl = a[2] + a[6] + b[2] + b[6];
+			y0[x] = lumaOf(a);
+			y0[x + 1] = lumaOf(a + 4);
+			y1[x] = lumaOf(b);
+			y1[x + 1] = lumaOf(b + 4);
+			uRow[x / 2] = (uint8_t)(((-38 * r - 74 * g + 112 * bl + 512) >> 10) + 128);
+			vRow[x / 2] = (uint8_t)(((112 * r - 94 * g - 18 * bl + 512) >> 10) + 128);
+		}
+	}
+}
+
+bool VideoRecorder::start(const char * path, unsigned int w, unsigned int h, int fps) {
+	stop();
+	width = w & ~1u; // 4:2:0 needs even sizes, lose the odd row or column
+	height = h & ~1u;
+	if (width == 0 || height == 0) return false;
+	if (strcmp(path, "-") == 0) {
+#if defined(__unix__) || defined(unix)
+#else	// assume windows
+		_setmode(_fileno(stdout), _O_BINARY); // or every \n in the video becomes \r\n
+#endif	// __unix__
+		out = stdout;
+	}
+	else {
+		out = fopen(path, "wb");
+		if (!out) {
+			cout << "Can't record to " << path << endl;
+			return false;
+		}
+	}
+	name = path;
+	setvbuf(out, 0, _IOFBF, 1 << 20);
+	fprintf(out, "YUV4MPEG2 W%u H%u F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+	yuv = new uint8_t[(size_t)width * height * 3 / 2];
+	written = convertMs = writeMs = 0;
+	overflows = 0;
+	stopping = false;
+	failed = false;
+	writer = thread(&VideoRecorder::write, this);
+	cerr << "Recording " << width << "x" << height << " to " << (out == stdout ? "stdout" : path) << endl; // stdout may be the video
+	return true;
+}
+
+void VideoRecorder::push(Frame * frame) {
+	if (!out || failed || frame->width != width || frame->height != height || !queue.push(frame)) {
+		if (out) overflows++; // the writer can't keep up (or failed, or the window changed size), don't make the window wait
+		source->release(frame);
+	}
+}
+
+void VideoRecorder::write() {
+	uint8_t * y = yuv, * u = y + (size_t)width * height, * v = u + (size_t)width * height / 4;
+	size_t bytes = (size_t)width * height * 3 / 2;
+
+	for (;;) {
+		Frame * frame = queue.pop();
+		if (!frame) {
+			if (!stopping) {
+				this_thread::sleep_for(chrono::milliseconds(1));
+				continue;
+			}
+			frame = queue.pop(); // the flag first, then the queue again: whatever was pushed before stop() is in it by now
+			if (!frame) break;
+		}
+		unsigned long start = get_msec();
+		rgba_to_i420(frame->pixels, width, height, y, u, v);
+		source->release(frame); // back to the pool before the slow part
+		unsigned long converted = get_msec();
+		fputs("FRAME\n", out);
+		if (fwrite(yuv, 1, bytes, out) != bytes) {
+			cerr << "Recording to " << name << " failed, stopping" << endl; // disk full or the pipe closed
+			failed = true; // before the drain, so nothing new is left behind for long (stop() empties the rest)
+			while ((frame = queue.pop())) {
+				source->release(frame);
+				overflows++;
+			}
+			break;
+		}
+		convertMs += converted - start;
+		writeMs += get_msec() - converted;
+		written++;
+	}
+}
+
+void VideoRecorder::stop() {
+	if (!out) return;
+	stopping = true;
+	writer.join();
+	Frame * frame;
+	while ((frame = queue.pop())) { // only if the writer gave up early
+		source->release(frame);
+		overflows++;
+	}
+	if (out == stdout) fflush(out);
+	else fclose(out);
+	out = 0;
+	delete[] yuv;
+	yuv = 0;
+	cerr << "Recorded " << written << " frames to " << name;
+	if (written) cerr << " (" << (float)convertMs / written << " ms converting, " << (float)writeMs / written << " ms writing per frame)";
+	cerr << ", " << overflows << " dropped" << endl;
+}
@@ -0,0 +1,50 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <string>
+#include "readback.h"
+
+#define RECORD_QUEUE 16 // frames waiting for the writer, beyond this they are dropped (and counted)
+
+class FrameQueue { // lock free, one producer (render thread) and one consumer (writer thread)
+public:
+	FrameQueue() : head(0), tail(0) {}
+	bool push(Frame * frame); // false if full
+	Frame * pop(); // 0 if empty
+private:
+	Frame * slots[RECORD_QUEUE + 1]; // one always empty, so full and empty look different
+	std::atomic<size_t> head; // next to pop, only the consumer writes it
+	std::atomic<size_t> tail; // next free slot, only the producer writes it
+};
+
+class VideoRecorder { // streams frames to a .y4m file (or stdout) from its own thread
+public:
+	VideoRecorder(PixelReadback * source) : width(0), height(0), source(source), out(0), stopping(false), failed(false), written(0), convertMs(0), writeMs(0), overflows(0), yuv(0) {}
+	~VideoRecorder() { stop(); }
+	bool start(const char * path, unsigned int width, unsigned int height, int fps); // "-" writes to stdout, for piping into an encoder
+	void push(Frame * frame); // render thread, never blocks: a full queue drops the frame
+	void stop(); // writes out whatever is queued, then reports
+	bool recording() const { return out != 0; }
+	unsigned int width, height; // every frame has to be this size (even numbers, for 4:2:0)
+private:
+	PixelReadback * source; // frames go back to its pool once written
+	FILE * out;
+	std::string name;
+	std::thread writer;
+	std::atomic<bool> stopping;
+	std::atomic<bool> failed; // the writer couldn't write and gave up, push() drops everything
+	FrameQueue queue;
+	unsigned long written, convertMs, writeMs; // writer thread until stop() joins it
+	std::atomic<unsigned long> overflows; // dropped frames, counted on both threads
+	uint8_t * yuv; // one converted frame, Y then U then V
+
+	void write(); // writer thread loop
+};
+
+// RGBA (bottom row first, as read back from GL) to planar BT.601 4:2:0, top row first; width and height even
+void rgba_to_i420(const uint8_t * rgba, unsigned int width, unsigned int height, uint8_t * y, uint8_t * u, uint8_t * v);
+#endif
@@ -0,0 +1,12 @@
+#version 130
+/**
+ * reproject.frag
+ * Writes what reproject.vs worked out, the blending keeps the smallest per pixel.
+ */
+
+in vec2 guess;
+
+void main()
+{
+    gl_FragColor = vec4(guess, 0.0, 1.0);
+}
@@ -0,0 +1,49 @@
+#version 130
+/**
+ * reproject.vs
+ * One point per pixel of the last 3D frame (glDrawArrays(GL_POINTS, 0, width * height), no attributes):
+ * rebuilds where that pixel's ray hit from the old camera and moves the point to the same spot in the new view.
+ * Drawn with GL_MIN blending into an RG32F target cleared to REPROJECT_UNKNOWN, so where points
+ * overlap the nearest surface wins. rayDirection() in 3d_fractals.frag, run backwards.
+ */
+
+uniform sampler2D distances;        // the last frame's hit distances (0 where its ray missed) and glow steps
+uniform vec2  lastSize;             // the size uniform that frame was drawn with
+uniform vec3  lastPosition;
+uniform mat3  lastRotation;
+uniform float lastFocalLength;
+uniform float lastAspectRatio;
+uniform vec2  size;                 // the frame about to be drawn
+uniform vec2  viewport;             // its size in pixels
+uniform vec3  cameraPosition;
+uniform mat3  cameraRotation;
+uniform float cameraFocalLength;
+uniform float aspectRatio;
+
+out vec2 guess; // distance from the new camera, steps for the glow
+
+void main()
+{
+    int   width = textureSize(distances, 0).x;
+    ivec2 texel = ivec2(gl_VertexID % width, gl_VertexID / width);
+    vec2  last = texelFetch(distances, texel, 0).xy;
+    float t = last.x;
+
+    guess = vec2(0.0);
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // outside the clip volume, dropped
+    if (t <= 0.0) return; // a miss says nothing about the new view
+
+    vec2 p = (0.5 * lastSize - (vec2(texel) + 0.5)) / vec2(lastSize.x, -lastSize.y);
+    p.x *= lastAspectRatio;
+    vec3 hit = lastPosition + t * normalize(lastRotation * vec3(p, -lastFocalLength));
+
+    vec3 view = (hit - cameraPosition) * cameraRotation; // v * M == transpose(M) * v, into the new camera's space
+    if (view.z >= 0.0) return; // behind the camera now
+
+    vec2 q = view.xy * (cameraFocalLength / -view.z);
+    q.x /= aspectRatio;
+    vec2 pixel = vec2(size.x * (0.5 - q.x), size.y * (0.5 + q.y));
+
+    gl_Position = vec4(pixel / viewport * 2.0 - 1.0, 0.0, 1.0);
+    guess = vec2(length(hit - cameraPosition), last.y);
+}
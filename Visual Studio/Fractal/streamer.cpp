@@ -0,0 +1,157 @@
+/** streamer.cpp
+ * Texture streaming: images are decoded on a pool of worker threads, copied
+ * into a ring of pixel buffer objects on the render thread, and only swapped
+ * into their Texture once a fence says the GPU has finished with them.
+ * The render thread never waits on a decode or on the driver.
+ */
+#include <cstring>
+#include <iostream>
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "util.h"
+#include "streamer.h"
+
+using namespace std;
+
+TextureStreamer::TextureStreamer(int threads) : stopping(false), nextPbo(0) {
+	for (int i = 0; i < PBO_RING; i++) {
+		pbo[i] = 0;
+		pboSize[i] = 0;
+		pboFence[i] = 0;
+	}
+	if (threads <= 0) {
+		threads = (int)thread::hardware_concurrency() - 1; // the render thread has its own core
+		if (threads < 1) threads = 1;
+	}
+	for (int i = 0; i < threads; i++) {
+		workers.push_back(thread(&TextureStreamer::work, this));
+	}
+}
+
+TextureStreamer::~TextureStreamer() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true; // queued jobs are dropped
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for (size_t i = 0; i < decoded.size(); i++) {
+		free_image(decoded[i].image);
+	}
+	for (size_t i = 0; i < uploads.size(); i++) { // never made it to their Texture
+		glDeleteSync(uploads[i].fence);
+		glDeleteTextures(1, &uploads[i].texture);
+	}
+	for (int i = 0; i < PBO_RING; i++) {
+		if (pboFence[i]) glDeleteSync(pboFence[i]);
+		if (pbo[i]) glDeleteBuffers(1, &pbo[i]);
+	}
+}
+
+void TextureStreamer::request(Texture * target, const char * path) {
+	Job job = { path, target };
+	{
+		lock_guard<mutex> guard(lock);
+		jobs.push_back(job);
+	}
+	wake.notify_one();
+}
+
+void TextureStreamer::work() {
+	for (;;) {
+		Job job;
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+			if (stopping) return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		DecodedImage image;
+		decode_image(job.path.c_str(), image); // the slow part, with the lock released
+
+		if (image.pixels) {
+			lock_guard<mutex> guard(lock);
+			Decoded d = { job.target, image };
+			decoded.push_back(d);
+		}
+	}
+}
+
+bool TextureStreamer::upload(Decoded & d) {
+	int i = nextPbo;
+	size_t bytes = (size_t)d.image.width * d.image.height * 4;
+	GLuint texture;
+	void * dst;
+
+	if (pboFence[i]) {
+		if (!signalled(pboFence[i])) return false; // the GPU is still copying out of it, try next frame
+		glDeleteSync(pboFence[i]);
+		pboFence[i] = 0;
+	}
+	if (!pbo[i]) glGenBuffers(1, &pbo[i]);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+	if (bytes > pboSize[i]) { // buffers only grow, most images are the same size anyway
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW);
+		pboSize[i] = bytes;
+	}
+	dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!dst) {
+		cout << "TextureStreamer: failed to map pixel buffer" << endl;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+	memcpy(dst, d.image.pixels, bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glGenTextures(1, &texture); // a new texture, the old one stays bound until the swap
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // same settings as Texture::load
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, d.image.width, d.image.height, 0, d.image.bgra ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, 0); // 0 == offset into the PBO, returns straight away
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	pboFence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	Upload u = { d.target, texture, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+	uploads.push_back(u);
+	nextPbo = (i + 1) % PBO_RING;
+	free_image(d.image);
+	return true;
+}
+
+void TextureStreamer::update() {
+	for (size_t i = 0; i < uploads.size();) { // swap in whatever the GPU has finished
+		if (signalled(uploads[i].fence)) {
+			glDeleteSync(uploads[i].fence);
+			uploads[i].target->swap(uploads[i].texture); // the very next draw samples the new image
+			uploads.erase(uploads.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+
+	for (int n = 0; n < PBO_RING; n++) { // at most one upload per pixel buffer per frame
+		Decoded d;
+		{
+			lock_guard<mutex> guard(lock);
+			if (decoded.empty()) break;
+			d = decoded.front();
+		}
+		if (!upload(d)) break; // stays queued for the next frame
+		lock_guard<mutex> guard(lock);
+		decoded.pop_front(); // only this thread pops, so it is still the same one
+	}
+}
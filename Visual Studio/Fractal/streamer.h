@@ -0,0 +1,54 @@
+#ifndef __STREAMER_H__
+#define __STREAMER_H__
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "image.h"
+
+#define PBO_RING 3 // pixel buffers in flight, one can be filled while the GPU copies out of the others
+
+class Texture;
+
+class TextureStreamer { // decodes images on worker threads and uploads them through pixel buffer objects
+public:
+	TextureStreamer(int threads = 0); // 0 == one per core, leaving one for the render thread
+	~TextureStreamer();
+	void request(Texture * target, const char * path); // target keeps its current texture until the new one is ready
+	void update(); // render thread, once a frame: upload what is decoded, swap in what the GPU has finished
+private:
+	struct Job {
+		std::string path;
+		Texture * target;
+	};
+	struct Decoded {
+		Texture * target;
+		DecodedImage image;
+	};
+	struct Upload {
+		Texture * target;
+		GLuint texture;
+		GLsync fence; // signalled once the copy and mipmaps are done
+	};
+	std::vector<std::thread> workers;
+	std::mutex lock; // guards everything below up to the GL state
+	std::condition_variable wake; // new job or stopping
+	std::deque<Job> jobs;
+	std::deque<Decoded> decoded; // waiting for the render thread
+	bool stopping;
+
+	GLuint pbo[PBO_RING]; // render thread only from here on
+	size_t pboSize[PBO_RING];
+	GLsync pboFence[PBO_RING]; // the GPU is still reading this buffer until it signals
+	int nextPbo;
+	std::vector<Upload> uploads;
+
+	void work(); // worker thread loop
+	bool upload(Decoded & d); // false if every pixel buffer is still in use
+	static bool signalled(GLsync fence) { // never blocks
+		return glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED;
+	}
+};
+#endif
@@ -1,11 +1,14 @@
 #if defined(__unix__) || defined(unix)
 #include <time.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #else	// assume windows
 #include <windows.h>
+#include <direct.h>
 #endif	// __unix__
 
 #include <cstdio>
+#include <cstring>
 #include <cstdlib>
 #include <cctype>
 #include <cstdint>
@@ -20,12 +23,16 @@
 #endif
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include <GL/freeglut.h>
 #include <SOIL.h>
 
 #include "util.h"
 
-static int check_ppm(std::ifstream & fp); // essentially a private method to check integrity of P6 ppm image
-static void * load_ppm(std::ifstream & fp, unsigned long *xsz, unsigned long *ysz); // loads ppm image
+#ifndef GL_COMPLETION_STATUS_KHR // KHR_parallel_shader_compile, newer than our GLEW
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#define SHADER_CACHE_DIR "shader_cache" // linked program binaries live here, safe to delete
 
 static std::string leftText = "This is left text"; // left side control text 
 static std::string rightText = "This is right text"; // right side control text
@@ -34,7 +41,15 @@ static char controlsText[1024] = "ALL CONTROLS WILL ONLY WORK IF THE FRACTAL WIN
 	"ESC key, Q key: Quit\r\n"
 	"Scroll Wheel: Zoom in and out\r\n"
 	"+ key: Increase maximum iterations\r\n"
-	"- key: Decrease maximum iterations\r\n";
+	"- key: Decrease maximum iterations\r\n"
+	"R key: Start/stop recording to capture.y4m\r\n"
+	"K key: Toggle the cone pre-pass (3D)\r\n"
+	"P key: Toggle reprojecting the last frame while moving (3D)\r\n"
+	"V key: Toggle the baked distance grid (3D)\r\n"
+	"L key: Swing the light round, relit without marching (3D)\r\n"
+	"O key: Show the picture, depth, normals, glow steps or occlusion (3D)\r\n"
+	"N key: Ambient occlusion at full, 1/2 or 1/4 resolution (3D)\r\n"
+	"U key: Toggle adding up still frames until they converge (3D)\r\n";
 
 unsigned long get_msec(void) { // gets msec of system run time (This is just here for fun)
 #if defined(__unix__) || defined(unix)
@@ -52,40 +67,307 @@ unsigned long get_msec(void) { // gets msec of system run time (This is just her
 #endif	// __unix__
 }
 
+using namespace std;
+
+static uint64_t fnv1a(uint64_t hash, const char * data, size_t len) { // 64 bit FNV-1a, good enough for cache keys
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 void Shader::load(const char * vname, const char * fname) { // This is actually part of the shader class, but it is not defined withing the class
-	using namespace std;
-	int vs, fs, linked; // vector shader, fragment shader, error status holder
-	vs = loadShader("vertex", vname); // This can use private functions, but it is not within the actual file where the class is!
-	fs = loadShader("fragment", fname);
-
-	program = glCreateProgram(); // Create GPU executable program for fractals. (Assigns it to a private var of Shader)
-	glAttachShader(program, vs); // The vector shader for fractals should be included in the program
-	glAttachShader(program, fs); // So should the fragment shader
-	glLinkProgram(program); // Link the program
-	glGetProgramiv(program, GL_LINK_STATUS, &linked); // Did it work?
-	if (!linked) {
+	vector<string> files;
+
+	if (!vertexSource.load(vname) || !fragmentSource.load(fname)) { // reads the files (and their #includes) into buffers it owns
+		exit(-1); // Can't do anything without shaders
+	}
+	vertexName = vname;
+	fragmentName = fname;
+
+	files = vertexSource.files();
+	files.insert(files.end(), fragmentSource.files().begin(), fragmentSource.files().end());
+	watcher.watch(files);
+
+	for (map<string, unsigned int>::iterator it = programs.begin(); it != programs.end(); it++) {
+		glDeleteProgram(it->second); // old sources, old programs
+	}
+	programs.clear();
+	program = 0;
+	variantChanged = true; // Nothing is compiled until the first use(), after the defaults are set
+}
+
+void Shader::checkReload() {
+	vector<string> files;
+	if (!watcher.changed()) return; // the usual case, costs next to nothing
+
+	cout << fragmentName << ": changed on disk, reloading" << endl;
+	if (compiling()) finishBuild(true); // that one was built from the old sources
+
+	if (!vertexSource.load(vertexName.c_str()) || !fragmentSource.load(fragmentName.c_str())) {
+		return; // probably caught in the middle of a save, the next change will bring us back
+	}
+	files = vertexSource.files(); // #includes may have changed too
+	files.insert(files.end(), fragmentSource.files().begin(), fragmentSource.files().end());
+	watcher.watch(files);
+
+	for (map<string, unsigned int>::iterator it = programs.begin(); it != programs.end(); it++) {
+		if (it->second != program) glDeleteProgram(it->second); // other variants are rebuilt when they are picked
+	}
+	programs.clear();
+	if (retired && retired != program) glDeleteProgram(retired);
+	retired = program; // keeps drawing (as the preview) until its replacement is ready
+	variantChanged = true;
+}
+
+void Shader::addVariant(const char * name, const char * define) {
+	variants.push_back(make_pair(string(name), string(define)));
+	variantChanged = true;
+}
+
+string Shader::variantDefines() {
+	string defines;
+	for (size_t i = 0; i < variants.size(); i++) {
+		defines += "#define " + variants[i].second + " " + to_string(get_uniform1i(variants[i].first.c_str())) + "\n";
+	}
+	return defines;
+}
+
+static bool hasExtension(const char * name) { // GLEW is older than the extensions we look for
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char * ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (ext && strcmp(ext, name) == 0) return true;
+	}
+	return false;
+}
+
+static bool parallelCompile() { // can we ask whether a compile is done without waiting for it?
+	static int supported = -1; // checked once, the context never changes
+	if (supported == -1) {
+		supported = hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile");
+		if (supported) {
+			typedef void (GLAPIENTRY * MaxThreadsProc)(GLuint count);
+			MaxThreadsProc maxThreads = (MaxThreadsProc)glutGetProcAddress("glMaxShaderCompilerThreadsKHR");
+			if (!maxThreads) maxThreads = (MaxThreadsProc)glutGetProcAddress("glMaxShaderCompilerThreadsARB");
+			if (maxThreads) maxThreads(0xFFFFFFFF); // let the driver use as many threads as it likes
+		}
+		cout << "Background shader compilation " << (supported ? "enabled" : "not supported, compiling in place") << endl;
+	}
+	return supported == 1;
+}
+
+void Shader::selectVariant() {
+	string defines = variantDefines();
+	map<string, unsigned int>::iterator it = programs.find(defines);
+
+	variantChanged = false;
+	if (it != programs.end()) { // seen this combination before, just switch
+		program = it->second;
+		resolveUniforms(); // locations differ between programs, and the new one needs every value
+		return;
+	}
+
+	bool nothingToShow = program == 0; // very first program, there is no preview to draw
+	startBuild(defines);
+	if (compiling() && (nothingToShow || !parallelCompile())) { // or the driver can't do it in the background
+		finishBuild();
+	}
+}
+
+bool Shader::compiling() {
+	return pending.program != 0;
+}
+
+void Shader::startBuild(const string & defines) {
+	unsigned int cached;
+
+	pending.start = get_msec();
+	pending.defines = defines;
+	pending.cache = cachePath(defines);
+	pending.label = fragmentName; // name + variant for the log
+	for (size_t i = 0; i < variants.size(); i++) {
+		pending.label += " " + variants[i].second + "=" + to_string(get_uniform1i(variants[i].first.c_str()));
+	}
+
+	if ((cached = loadBinary(pending.cache))) { // Same sources on the same driver, skip the compiler entirely
+		cout << pending.label << ": loaded from program cache in " << get_msec() - pending.start << " ms" << endl;
+		programs[defines] = program = cached;
+		if (retired && retired != program) {
+			glDeleteProgram(retired);
+		}
+		retired = 0;
+		resolveUniforms();
+		return;
+	}
+
+	pending.start = get_msec(); // the compile alone from here, not the cache lookup that missed
+	pending.vs = loadShader("vertex", vertexSource, ""); // This can use private functions, but it is not within the actual file where the class is!
+	pending.fs = loadShader("fragment", fragmentSource, defines);
+
+	pending.program = glCreateProgram(); // Create GPU executable program for fractals.
+	glAttachShader(pending.program, pending.vs); // The vector shader for fractals should be included in the program
+	glAttachShader(pending.program, pending.fs); // So should the fragment shader
+	if (GLEW_ARB_get_program_binary) {
+		glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); // We want to save it afterwards
+	}
+	glLinkProgram(pending.program); // Link the program (returns straight away with parallel compilation)
+	pending.submit = get_msec() - pending.start;
+}
+
+bool Shader::pendingDone() {
+	GLint done = GL_TRUE;
+	if (parallelCompile()) {
+		glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done); // the only query that doesn't wait
+	}
+	return done == GL_TRUE;
+}
+
+void Shader::finishBuild(bool background) {
+	int linked; // error status holder
+	unsigned int built = pending.program;
+	bool compiled = checkShader("vertex", pending.vs); // These wait for the driver if it isn't done yet
+	compiled = checkShader("fragment", pending.fs) && compiled;
+
+	glGetProgramiv(built, GL_LINK_STATUS, &linked); // Did it work?
+	if (compiled && !linked) {
 		int info_len; // No.
 		char *info_log;
 
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_len); // Get the info log
+		glGetProgramiv(built, GL_INFO_LOG_LENGTH, &info_len); // Get the info log
 		if (info_len > 0) {
 			if (!(info_log = new char[info_len + 1])) { // User needs to buy more ram! (only should have used about 1~2 MiB by now)
 				cout << "Unable to allocate info_log (util.cpp: line 140)" << endl;
 				exit(-2);
 			}
-			glGetProgramInfoLog(program, info_len, 0, info_log); // get the log
+			glGetProgramInfoLog(built, info_len, 0, info_log); // get the log
 			cout << "Program linking failed: " << info_log << endl; // print the log
 			delete[] info_log;
 		}
 		else { // OGL doesn't want to give me a log of the errors
 			cout << "Program linking failed" << endl;
 		}
+	}
+	glDeleteShader(pending.vs); // The program keeps its own copy
+	glDeleteShader(pending.fs);
+	pending.program = 0;
+
+	if (!compiled || !linked) {
+		glDeleteProgram(built);
+		if (program) { // a broken edit while hot reloading, keep showing what we had
+			cout << pending.label << ": keeping the previous program until the shader is fixed" << endl;
+			return;
+		}
 		exit(-1); // Kill the program, it can't work without the shader sub-program
 	}
+	if (background) { // the frames drawn meanwhile are in the wait, so it is how long it took to show up, not what it cost
+		cout << pending.label << ": compiled from source in the background, ready after " << get_msec() - pending.start << " ms (" << pending.submit << " ms of it on this thread)" << endl;
+	}
+	else { // waited for right here, start to finish is the compile and link
+		cout << pending.label << ": compiled from source in " << get_msec() - pending.start << " ms" << endl;
+	}
+
+	programs[pending.defines] = program = built; // saveBinary() reads from program
+	if (retired && retired != program) { // the pre-reload program isn't needed as a preview any more
+		glDeleteProgram(retired);
+	}
+	retired = 0;
+	saveBinary(pending.cache);
+	if (pending.defines != variantDefines()) { // the user moved on while we were compiling
+		variantChanged = true;
+	}
+	resolveUniforms(); // locations differ between programs, and the new one needs every value
+}
+
+string Shader::cachePath(const string & defines) {
+	// Anything that changes the binary goes in the key: both sources, the defines and the exact driver
+	const char * driver[3] = {
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION)
+	};
+	uint64_t hash = 14695981039346656037ULL;
+	char name[64];
+	vector<const char *> strings;
+	vector<int> lengths;
+
+	vertexSource.pieces("", strings, lengths);
+	for (size_t i = 0; i < strings.size(); i++) {
+		hash = fnv1a(hash, strings[i], lengths[i]);
+	}
+	hash = fnv1a(hash, "", 1); // separator so moving text between the shaders changes the key
+	fragmentSource.pieces(defines, strings, lengths);
+	for (size_t i = 0; i < strings.size(); i++) {
+		hash = fnv1a(hash, strings[i], lengths[i]);
+	}
+	for (int i = 0; i < 3; i++) {
+		if (driver[i]) hash = fnv1a(hash, driver[i], strlen(driver[i]) + 1);
+	}
+
+	sprintf(name, "%016llx.bin", (unsigned long long)hash);
+	return string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+unsigned int Shader::loadBinary(const string & path) {
+	GLenum format;
+	GLint linked = 0;
+	unsigned int cached;
+	if (!GLEW_ARB_get_program_binary) return 0; // No driver support, always compile
+
+	ifstream in(path.c_str(), ios::binary);
+	if (!in.is_open()) return 0; // cold start
+
+	in.read((char *)&format, sizeof(format));
+	string binary((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	in.close();
+	if (binary.empty()) return 0;
+
+	cached = glCreateProgram();
+	glProgramBinary(cached, format, binary.data(), (GLsizei)binary.length());
+	glGetProgramiv(cached, GL_LINK_STATUS, &linked); // the driver can reject an old binary
+	if (!linked) {
+		cout << path << ": stale program binary, recompiling" << endl;
+		glDeleteProgram(cached);
+		return 0;
+	}
+	return cached;
+}
+
+void Shader::saveBinary(const string & path) {
+	GLint length = 0;
+	GLenum format;
+	if (!GLEW_ARB_get_program_binary) return;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return; // driver won't give us one
+
+	char * binary = new char[length];
+	glGetProgramBinary(program, length, 0, &format, binary);
+
+#if defined(__unix__) || defined(unix)
+	mkdir(SHADER_CACHE_DIR, 0755); // fine if it already exists
+#else
+	_mkdir(SHADER_CACHE_DIR);
+#endif
+	ofstream out(path.c_str(), ios::binary);
+	if (out.is_open()) {
+		out.write((const char *)&format, sizeof(format));
+		out.write(binary, length);
+		out.close();
+	}
+	else {
+		cout << "Unable to write program cache: " << path << endl;
+	}
+	delete[] binary;
 }
 
 void Shader::use() {
+	if (compiling() && pendingDone()) finishBuild(true); // background compile finished, switch over (only those are left pending)
+	if (variantChanged && !compiling()) selectVariant(); // mode switch, swap in the specialised program
 	glUseProgram(program); // Tell the GPU to use this program
+	flush(); // Only the uniforms that changed since the last frame are sent
 }
 
 /*
@@ -94,141 +376,261 @@ void Shader::use() {
  * didn't really want to rewrite all of my
  * code. This is also the standard OpenGL
  * naming scheme (OpenGL was written for C)
- * All of the code is self explanatory
+ * The setters only touch the CPU side table,
+ * nothing goes to the driver until flush().
  */
 void Shader::set_uniform1f(const char *name, float val) {
-	int loc = glGetUniformLocation(program, name);
-	if (loc != -1) {
-		glUniform1f(loc, val);
+	Uniform & u = uniform(name, GL_FLOAT);
+	if (u.value.f[0] != val) {
+		u.value.f[0] = val;
+		markDirty(u);
 	}
 }
 
 void Shader::set_uniform2f(const char *name, float v1, float v2) {
-	int loc = glGetUniformLocation(program, name);
-	if (loc != -1) {
-		glUniform2f(loc, v1, v2);
+	Uniform & u = uniform(name, GL_FLOAT_VEC2);
+	if (u.value.f[0] != v1 || u.value.f[1] != v2) {
+		u.value.f[0] = v1;
+		u.value.f[1] = v2;
+		markDirty(u);
 	}
 }
 
 void Shader::set_uniform3f(const char * name, float v1, float v2, float v3) {
-	int loc = glGetUniformLocation(program, name);
-	if (loc != -1) {
-		glUniform3f(loc, v1, v2, v3);
+	Uniform & u = uniform(name, GL_FLOAT_VEC3);
+	if (u.value.f[0] != v1 || u.value.f[1] != v2 || u.value.f[2] != v3) {
+		u.value.f[0] = v1;
+		u.value.f[1] = v2;
+		u.value.f[2] = v3;
+		markDirty(u);
 	}
 }
 
 void Shader::set_uniform1i(const char *name, int val) {
-	int loc = glGetUniformLocation(program, name);
-	if (loc != -1) {
-		glUniform1i(loc, val);
+	Uniform & u = uniform(name, GL_INT);
+	if (u.value.i[0] != val) {
+		u.value.i[0] = val;
+		markDirty(u);
+		for (size_t i = 0; i < variants.size(); i++) {
+			if (variants[i].first == name) variantChanged = true; // this value is compiled in
+		}
+	}
+}
+
+void Shader::set_uniformMatrix3f(const char * name, const float * m) {
+	Uniform & u = uniform(name, GL_FLOAT_MAT3);
+	if (memcmp(u.value.f, m, 9 * sizeof(float)) != 0) {
+		memcpy(u.value.f, m, 9 * sizeof(float));
+		markDirty(u);
+	}
+}
+
+Uniform & Shader::uniform(const char * name, GLenum type) {
+	map<string, Uniform>::iterator it = uniforms.find(name);
+	if (it == uniforms.end()) { // resolveUniforms() didn't see it, so the program doesn't use it (yet)
+		Uniform blank = { -1, 0, { { 0.0f, 0.0f, 0.0f } }, false };
+		it = uniforms.insert(make_pair(string(name), blank)).first;
+	}
+
+	Uniform & u = it->second;
+	if (u.type != type) { // first time this uniform is set
+		u.type = type;
+		memset(&u.value, 0, sizeof(u.value));
+		markDirty(u); // always send the first value, even if it is zero
+	}
+	return u;
+}
+
+void Shader::markDirty(Uniform & u) {
+	if (!u.dirty) {
+		u.dirty = true;
+		dirtyUniforms.push_back(&u);
+	}
+}
+
+void Shader::resolveUniforms() { // ask the driver for every location once instead of on every set
+	int count = 0, length = 0;
+	char name[256];
+	GLint size;
+	GLenum type;
+
+	for (map<string, Uniform>::iterator it = uniforms.begin(); it != uniforms.end(); it++) {
+		it->second.location = -1; // anything not in the new program is ignored
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	for (int i = 0; i < count; i++) {
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		map<string, Uniform>::iterator it = uniforms.find(name);
+		if (it == uniforms.end()) { // not set yet, remember the location for later
+			Uniform blank = { -1, 0, { { 0.0f, 0.0f, 0.0f } }, false };
+			it = uniforms.insert(make_pair(string(name), blank)).first;
+		}
+		it->second.location = glGetUniformLocation(program, name);
+	}
+
+	for (map<string, Uniform>::iterator it = uniforms.begin(); it != uniforms.end(); it++) {
+		if (it->second.type != 0) markDirty(it->second); // a new program starts with nothing set
+	}
+}
+
+void Shader::flush() { // send the dirty uniforms, normally only a handful per frame
+	for (size_t i = 0; i < dirtyUniforms.size(); i++) {
+		Uniform & u = *dirtyUniforms[i];
+		u.dirty = false;
+		if (u.location == -1) continue; // optimised out by the compiler
+
+		switch (u.type) {
+		case GL_FLOAT:
+			glUniform1f(u.location, u.value.f[0]);
+			break;
+		case GL_FLOAT_VEC2:
+			glUniform2f(u.location, u.value.f[0], u.value.f[1]);
+			break;
+		case GL_FLOAT_VEC3:
+			glUniform3f(u.location, u.value.f[0], u.value.f[1], u.value.f[2]);
+			break;
+		case GL_FLOAT_MAT3:
+			glUniformMatrix3fv(u.location, 1, GL_FALSE, u.value.f);
+			break;
+		case GL_INT:
+			glUniform1i(u.location, u.value.i[0]);
+			break;
+		}
 	}
+	dirtyUniforms.clear();
 }
 
-void Shader::updateValueStrings() { // Update all of the uniform values
+float Shader::get_uniform1f(const char * name) {
+	const Uniform * u = find(name);
+	return u ? u->value.f[0] : 0.0f;
+}
+
+void Shader::get_uniform2f(const char * name, float * v1, float * v2) {
+	const Uniform * u = find(name);
+	*v1 = u ? u->value.f[0] : 0.0f;
+	*v2 = u ? u->value.f[1] : 0.0f;
+}
+
+void Shader::get_uniform3f(const char * name, float * v1, float * v2, float * v3) {
+	const Uniform * u = find(name);
+	*v1 = u ? u->value.f[0] : 0.0f;
+	*v2 = u ? u->value.f[1] : 0.0f;
+	*v3 = u ? u->value.f[2] : 0.0f;
+}
+
+int Shader::get_uniform1i(const char * name) {
+	const Uniform * u = find(name);
+	return u ? u->value.i[0] : 0;
+}
+
+void Shader::get_uniformMatrix3f(const char * name, float * m) {
+	const Uniform * u = find(name);
+	for (int i = 0; i < 9; i++) m[i] = u ? u->value.f[i] : (i % 4 == 0 ? 1.0f : 0.0f);
+}
+
+const Uniform * Shader::find(const char * name) {
+	map<string, Uniform>::const_iterator it = uniforms.find(name);
+	if (it == uniforms.end() || it->second.type == 0) { // never set by us
+		return NULL;
+	}
+	return &it->second;
+}
+
+void Shader::updateValueStrings() { // Update all of the uniform values (from the CPU copies, no GPU round trips)
 	using namespace std;
 	leftText = "";
 	rightText = "";
-	float fv;
-	int iv = 0;
+	int iv;
+	float fx, fy;
 
 	leftText += "Type: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "fractal"), &iv);
-	leftText += iv == 0 ? "Mandelbrot" : iv == 1 ? "Orbit Trap" : "Ducks";
+	if (find("type")) { // 3D shader
+		static const char * types3d[6] = { "Menger Sponge", "Sphere Sponge", "Mandelbulb", "Mandelbox", "Octahedral IFS", "Dodecahedron IFS" };
+		iv = get_uniform1i("type");
+		leftText += iv >= 0 && iv < 6 ? types3d[iv] : "Unknown";
+	}
+	else {
+		iv = get_uniform1i("fractal");
+		leftText += iv == 0 ? "Mandelbrot" : iv == 1 ? "Orbit Trap" : "Ducks";
+	}
 	leftText += "\r\n";
 
 	leftText += "Max Iterations: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "maxIterations"), &iv);
-	leftText += to_string(iv);
+	leftText += to_string(get_uniform1i("maxIterations"));
 	leftText += "\r\n";
 
 	leftText += "Antialiasing? ";
-	glGetUniformiv(program, glGetUniformLocation(program, "antialiasingOn"), &iv);
-	leftText += iv == 0 ? "off" : "on";
+	leftText += get_uniform1i("antialiasingOn") == 0 ? "off" : "on";
 	leftText += "\r\n";
 
 	leftText += "Scale: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "scale"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("scale"));
 	leftText += "\r\n";
 
 	leftText += "Power: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "power"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("power"));
 	leftText += "\r\n";
 
 	leftText += "Bailout value: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "bailout"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("bailout"));
 	leftText += "\r\n";
 
 	leftText += "Min iterations: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "minIterations"), &iv);
-	leftText += to_string(iv);
+	leftText += to_string(get_uniform1i("minIterations"));
 	leftText += "\r\n";
 
 	leftText += "Julia mode? ";
-	glGetUniformiv(program, glGetUniformLocation(program, "juliaMode"), &iv);
-	leftText += iv == 0 ? "off" : "on";
+	leftText += get_uniform1i("juliaMode") == 0 ? "off" : "on";
 	leftText += "\r\n";
 
 	leftText += "Offset: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "power"), &fv);
-	leftText += to_string(fv);
+	get_uniform2f("offset", &fx, &fy);
+	leftText += to_string(fx) + ", " + to_string(fy);
 	leftText += "\r\n";
 
 	leftText += "Color Mode: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "colorMode"), &iv);
-	leftText += to_string(iv);
+	leftText += to_string(get_uniform1i("colorMode"));
 	leftText += "\r\n";
 
 	leftText += "Bailout style: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "bailoutStyle"), &iv);
-	leftText += to_string(iv);
+	leftText += to_string(get_uniform1i("bailoutStyle"));
 	leftText += "\r\n";
 
 	leftText += "Color scale: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "colorScale"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("colorScale"));
 	leftText += "\r\n";
 
 	leftText += "Color cycle: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "colorCycle"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("colorCycle"));
 	leftText += "\r\n";
 
 	leftText += "Color cycle offset: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "colorCycleOffset"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("colorCycleOffset"));
 	leftText += "\r\n";
 
 	leftText += "Mirror colors? ";
-	glGetUniformiv(program, glGetUniformLocation(program, "colorCycleMirror"), &iv);
-	leftText += iv == 0 ? "off" : "on";
+	leftText += get_uniform1i("colorCycleMirror") == 0 ? "off" : "on";
 	leftText += "\r\n";
 
 	leftText += "Rainbow mode? ";
-	glGetUniformiv(program, glGetUniformLocation(program, "hsv"), &iv);
-	leftText += iv == 0 ? "off" : "on";
+	leftText += get_uniform1i("hsv") == 0 ? "off" : "on";
 	leftText += "\r\n";
 
 	leftText += "Iteration color blend: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "iterationColorBlend"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("iterationColorBlend"));
 	leftText += "\r\n";
 
 	leftText += "Color iterations: ";
-	glGetUniformiv(program, glGetUniformLocation(program, "colorIterations"), &iv);
-	leftText += to_string(iv);
+	leftText += to_string(get_uniform1i("colorIterations"));
 	leftText += "\r\n";
 
 	leftText += "Gamma correction: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "gamma"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("gamma"));
 	leftText += "\r\n";
 
 	leftText += "Rotation: ";
-	glGetUniformfv(program, glGetUniformLocation(program, "rotation"), &fv);
-	leftText += to_string(fv);
+	leftText += to_string(get_uniform1f("rotation"));
 	leftText += "\r\n";
 }
 
@@ -236,16 +638,26 @@ GLint Shader::getAttribLocation(const char * name) {
 	return glGetAttribLocation(program, name);
 }
 
-void Shader::toggle(const char * name) {
-	int val;
-	glGetUniformiv(program, glGetUniformLocation(program, name), &val);
-	set_uniform1i(name, val == 1 ? 0 : 1);
+void Shader::toggle(const char * name) { // flips the CPU copy, the new value goes out on the next flush
+	set_uniform1i(name, get_uniform1i(name) == 1 ? 0 : 1);
+}
+
+void Shader::copy_uniforms(Shader * from) { // like a set_uniform* per entry, so only what changed since the last copy goes out
+	for (map<string, Uniform>::iterator it = from->uniforms.begin(); it != from->uniforms.end(); it++) {
+		if (it->second.type == 0) continue; // only a location, never set
+		Uniform & u = uniform(it->first.c_str(), it->second.type);
+		if (memcmp(&u.value, &it->second.value, sizeof(u.value)) != 0) {
+			u.value = it->second.value;
+			markDirty(u);
+		}
+	}
 }
 
 void setDefaultUniforms2d(Shader * shaders) { // Sets all of the defaults for 2D fractals
 	shaders->set_uniform1i("fractal", MANDELBROT); // Fractal type
 
 	shaders->set_uniform1i("maxIterations", 50);
+	shaders->set_uniform1f("antialiasing", 0.5f); // sample spacing, 2x2 per pixel
 	shaders->set_uniform1i("antialiasingOn", 0);
 
 	shaders->set_uniform1f("scale", 2.0f);
@@ -278,7 +690,7 @@ void setDefaultUniforms2d(Shader * shaders) { // Sets all of the defaults for 2D
 	shaders->set_uniform1f("orbitTrapEdgeDetail", 0.5f);
 	shaders->set_uniform1f("orbitTrapRotation", 0.0f);
 	shaders->set_uniform1f("orbitTrapSpin", 0.0f);
-	//shaders->set_uniform1i("texture", 0);
+	shaders->set_uniform1i("texture", 0); // texture unit, Texture::enable() binds the image there
 
 	shaders->set_uniform1f("rotation", 0.0f);
 	shaders->set_uniform3f("cameraPosition", -0.5f, 0.0f, 2.5f);
@@ -286,18 +698,201 @@ void setDefaultUniforms2d(Shader * shaders) { // Sets all of the defaults for 2D
 	shaders->set_uniform2f("outputSize", 800.0f, 600.0f);
 }
 
+void setDefaultUniforms3d(Shader * shaders) { // Sets all of the defaults for 3D fractals
+	const float identity[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+	shaders->set_uniform1i("type", 2); // Mandelbulb
+
+	shaders->set_uniform1i("maxIterations", 8);
+	shaders->set_uniform1i("stepLimit", 60);
+	shaders->set_uniform1i("aoIterations", 4);
+	shaders->set_uniform1f("antialiasing", 0.5f);
+	shaders->set_uniform1i("antialiasingOn", 0);
+
+	shaders->set_uniform1f("scale", 2.0f);
+	shaders->set_uniform1f("power", 8.0f);
+	shaders->set_uniform1f("surfaceDetail", 0.6f);
+	shaders->set_uniform1f("surfaceSmoothness", 0.8f);
+	shaders->set_uniform1f("boundingRadius", 5.0f);
+	shaders->set_uniform3f("offset", 0.0f, 0.0f, 0.0f);
+	shaders->set_uniform3f("shift", 0.0f, 0.0f, 0.0f);
+
+	shaders->set_uniform1f("cameraRoll", 0.0f);
+	shaders->set_uniform1f("cameraPitch", 0.0f);
+	shaders->set_uniform1f("cameraYaw", 0.0f);
+	shaders->set_uniform1f("cameraFocalLength", 0.9f);
+	shaders->set_uniform3f("cameraPosition", 0.0f, 0.0f, -2.5f);
+
+	shaders->set_uniform1i("colorIterations", 4);
+	shaders->set_uniform3f("color1", 1.0f, 1.0f, 1.0f);
+	shaders->set_uniform1f("color1Intensity", 0.45f);
+	shaders->set_uniform3f("color2", 0.0f, 0.53f, 0.8f);
+	shaders->set_uniform1f("color2Intensity", 0.3f);
+	shaders->set_uniform3f("color3", 1.0f, 0.53f, 0.0f);
+	shaders->set_uniform1f("color3Intensity", 0.0f);
+	shaders->set_uniform1i("transparent", 0);
+	shaders->set_uniform1f("gamma", 1.0f);
+
+	shaders->set_uniform3f("light", -16.0f, 100.0f, -60.0f);
+	shaders->set_uniform2f("ambientColor", 0.5f, 0.3f);
+	shaders->set_uniform3f("background1Color", 0.0f, 0.46f, 0.8f);
+	shaders->set_uniform3f("background2Color", 0.0f, 0.0f, 0.0f);
+	shaders->set_uniform3f("innerGlowColor", 0.0f, 0.6f, 0.8f);
+	shaders->set_uniform1f("innerGlowIntensity", 0.1f);
+	shaders->set_uniform3f("outerGlowColor", 1.0f, 1.0f, 1.0f);
+	shaders->set_uniform1f("outerGlowIntensity", 0.0f);
+	shaders->set_uniform1f("fog", 0.0f);
+	shaders->set_uniform1f("fogFalloff", 0.0f);
+	shaders->set_uniform1f("specularity", 0.8f);
+	shaders->set_uniform1f("specularExponent", 4.0f);
+
+	shaders->set_uniform2f("size", 400.0f, 300.0f);
+	shaders->set_uniform2f("outputSize", 800.0f, 600.0f);
+	shaders->set_uniform1f("aoIntensity", 0.15f);
+	shaders->set_uniform1f("aoSpread", 9.0f);
+	shaders->set_uniform1i("aoResolution", 1);
+	shaders->set_uniform1f("aoDepthTolerance", 0.02f);
+
+	shaders->set_uniformMatrix3f("objectRotation", identity);
+	shaders->set_uniformMatrix3f("fractalRotation1", identity);
+	shaders->set_uniformMatrix3f("fractalRotation2", identity);
+	shaders->set_uniform1i("conePass", 0);
+	shaders->set_uniform1i("coneMapOn", 0);
+	shaders->set_uniform1i("coneMap", 1); // texture unit
+	shaders->set_uniform1i("reprojectOn", 0);
+	shaders->set_uniform1i("reprojectMap", 3); // texture unit (2 holds the last frame's distances while they are splatted)
+	shaders->set_uniform2f("reprojectSize", 1.0f, 1.0f);
+	shaders->set_uniform1i("aoPass", 0);
+	shaders->set_uniform1i("accumulate", 0);
+	shaders->set_uniform2f("jitter", 0.0f, 0.0f);
+	shaders->set_uniform1f("sampleSeed", 0.0f);
+	shaders->set_uniform3f("lightJitter", 0.0f, 0.0f, 0.0f);
+	shaders->set_uniform1i("aoSkip", 0);
+	shaders->set_uniform1i("aoMapOn", 0);
+	shaders->set_uniform1i("hits", 7); // texture units, the G-buffer for the AO pass and the relighter
+	shaders->set_uniform1i("surfaces", 8);
+	shaders->set_uniform1i("aoMap", 9);
+	shaders->set_uniform1i("gridOn", 0);
+	shaders->set_uniform1i("gridCoarse", 4); // texture units
+	shaders->set_uniform1i("gridIndex", 5);
+	shaders->set_uniform1i("gridBricks", 6);
+	shaders->set_uniform3f("gridAtlas", 1.0f, 1.0f, 1.0f);
+	shaders->set_uniform1f("gridRadius", 1.0f);
+	shaders->set_uniform1f("gridExact", 0.0f);
+
+	// Per fractal parameters
+	shaders->set_uniform1f("sphereHoles", 4.0f);
+	shaders->set_uniform1f("sphereScale", 2.05f);
+	shaders->set_uniform1f("phi", 1.618f);
+	shaders->set_uniform1f("boxScale", 0.5f);
+	shaders->set_uniform1f("boxFold", 1.0f);
+	shaders->set_uniform1f("fudgeFactor", 0.0f);
+	shaders->set_uniform1f("juliaFactor", 0.0f);
+	shaders->set_uniform1f("radiolariaFactor", 0.0f);
+	shaders->set_uniform1f("radiolaria", 0.0f);
+}
+
 void resize(unsigned int width, unsigned int height) {
 	glViewport(0, 0, width, height);
 }
 
-uint8_t * getPixels(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
-	uint8_t * pixels = new uint8_t[width * height * 4];
+void RenderTarget::allocate(GLuint tex, GLenum internalFormat) {
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	GLint filter = internalFormat == GL_RGBA8 ? GL_LINEAR : GL_NEAREST; // data, not colours, don't blend neighbours
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RenderTarget::resize(unsigned int w, unsigned int h) {
+	if (w < 1) w = 1; // a zero sized framebuffer is incomplete
+	if (h < 1) h = 1;
+	if (fbo && w == width && h == height) return; // nothing to do (the common case)
+	width = w;
+	height = h;
+
+	if (!fbo) {
+		glGenFramebuffers(1, &fbo);
+		glGenTextures(1, &texture);
+		if (distances) {
+			glGenTextures(1, &distanceTexture);
+			glGenTextures(1, &surfaceTexture);
+		}
+	}
+	allocate(texture, format);
+	if (distances) {
+		allocate(distanceTexture, GL_RGBA32F);
+		allocate(surfaceTexture, GL_RGBA16F);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	if (distances) {
+		GLenum buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, distanceTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, surfaceTexture, 0);
+		glDrawBuffers(3, buffers); // part of the framebuffer's state, set once
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderTarget::bind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+	if (distances) {
+		GLfloat none[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 1, none); // discarded pixels (transparent misses) would keep an old frame's value
+	}
+}
+
+void RenderTarget::blit(unsigned int w, unsigned int h) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR); // bilinear upscale
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, w, h);
+}
+
+void RenderTarget::read(uint8_t * pixels) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void RenderTarget::read(float * values) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, values);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+GLuint uploadVolume(GLuint texture, GLenum internalFormat, GLenum channels, unsigned int w, unsigned int h, unsigned int d, const float * data, bool linear) {
+	if (!texture) glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, w, h, d, 0, channels, GL_FLOAT, data);
+	GLint filter = linear ? GL_LINEAR : GL_NEAREST;
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	return texture;
+}
+
+void getPixels(unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint8_t * pixels) {
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-	return pixels;
 }
 
 void Texture::load(const char * path) {
 	// Load and create a texture 
+	swap(0);
 	glGenTextures(1, &texture);
 	glBindTexture(GL_TEXTURE_2D, texture); // All upcoming GL_TEXTURE_2D operations now have effect on our texture object
 	// Set texture parameters
@@ -306,26 +901,39 @@ void Texture::load(const char * path) {
 	// Set texture filtering
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// Load, create texture and generate mipmaps
-	int width, height;
-	unsigned char * image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGB);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	SOIL_free_image_data(image);
+	// Load, create texture and generate mipmaps (TextureStreamer does this off the render thread)
+	DecodedImage image;
+	if (decode_image(path, image)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, image.bgra ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		free_image(image);
+	}
 
 	// Bind Textures using texture units
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texture);
 }
 
-PCTSTR getLeftStrings() { // return the left side text
+void Texture::swap(GLuint replacement) {
+	if (texture && texture != replacement) {
+		glDeleteTextures(1, &texture); // GL holds on to it until draws already queued are done with it
+	}
+	texture = replacement;
+}
+
+void Texture::enable() {
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+const char * getLeftStrings() { // return the left side text
 	return leftText.c_str();
 }
 
-PCTSTR getRightStrings() { // return the right side text
+const char * getRightStrings() { // return the right side text
 	return rightText.c_str();
 }
 
-PCTSTR getControls() { // return the controls list
+const char * getControls() { // return the controls list
 	return controlsText;
 }
\ No newline at end of file
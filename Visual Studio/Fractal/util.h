@@ -5,6 +5,11 @@
 #include <fstream>
 #include <cstdint>
 #include <cmath>
+#include <string>
+#include <map>
+#include <vector>
+#include "asset.h"
+#include "image.h"
 unsigned long get_msec(void);
 
 // Constants for 2D fractal types
@@ -12,42 +17,81 @@ unsigned long get_msec(void);
 #define ORBITTRAP 1
 #define DUCKS 2
 
+struct Uniform { // CPU side copy of a uniform, uploaded only when it changes
+	GLint location; // -1 if the program doesn't use it (or it isn't linked yet)
+	GLenum type; // GL_FLOAT, GL_FLOAT_VEC2, GL_FLOAT_VEC3, GL_FLOAT_MAT3 or GL_INT (0 until it is set)
+	union {
+		float f[9];
+		int i[3];
+	} value;
+	bool dirty; // needs to be sent on the next flush
+};
+
+struct PendingProgram { // a variant the driver is still compiling in the background
+	unsigned int program, vs, fs; // program == 0 when nothing is pending
+	unsigned long start; // get_msec() when it was submitted
+	unsigned long submit; // ms spent handing the sources to the driver, this thread's share of a background build
+	std::string defines, cache, label;
+};
+
 class Shader {
 public:
+	Shader() : program(0), retired(0), variantChanged(false) { pending.program = 0; }
 	// Set uniforms (naming scheme due to openGL standards)
 	void set_uniform1f(const char * name, float val);
 	void set_uniform2f(const char * name, float v1, float v2);
 	void set_uniform3f(const char * name, float v1, float v2, float v3);
 	void set_uniform1i(const char * name, int val);
+	void set_uniformMatrix3f(const char * name, const float * m); // column major, like glUniformMatrix3fv
+	// Read back the CPU side copies, the GPU is never asked
+	float get_uniform1f(const char * name);
+	void get_uniform2f(const char * name, float * v1, float * v2);
+	void get_uniform3f(const char * name, float * v1, float * v2, float * v3);
+	int get_uniform1i(const char * name);
+	void get_uniformMatrix3f(const char * name, float * m); // identity if it was never set
+	bool has_uniform(const char * name) { return find(name) != NULL; } // set at least once
 	void updateValueStrings(); // Update the uniform printout strings
-	void load(const char * vname, const char * fname); // load shaders
-	void use();
+	void load(const char * vname, const char * fname); // load shaders (compiled on the first use)
+	void addVariant(const char * name, const char * define); // compile a separate program per value of this int/bool uniform
+	void checkReload(); // recompile if any of our shader files (or their #includes) changed on disk
+	void use(); // bind the program and flush changed uniforms
+	void flush(); // send every dirty uniform to the GPU
 	GLint getAttribLocation(const char * name);
-	void Shader::toggle(const char * name);
+	void toggle(const char * name); // flip a bool uniform
+	void copy_uniforms(Shader * from); // take every value from's table holds, for a second program drawn with the same settings
+	unsigned int id() const { return program; } // the program drawn with now, changes with variants and reloads
+	bool compiling(); // a new variant is on its way, the current program is still being drawn
 private:
-	unsigned int program; // Shader program
-	unsigned int loadShader(const char * type, const char * path) { // load a specific shader
+	unsigned int program; // Shader program (for the current variant)
+	ShaderSource vertexSource, fragmentSource; // read into buffers of their own, #includes already expanded
+	std::string vertexName, fragmentName;
+	FileWatcher watcher; // for hot reloading
+	unsigned int retired; // pre-reload program, kept on screen until the new one is ready
+	std::vector<std::pair<std::string, std::string> > variants; // uniform name, #define it becomes
+	std::map<std::string, unsigned int> programs; // variant #defines -> linked program
+	bool variantChanged; // a variant uniform changed, pick the program again on the next use()
+	std::string variantDefines(); // #define block for the current variant uniform values
+	void selectVariant(); // switch to (and compile if needed) the program for the current values
+	PendingProgram pending; // variant being compiled, if any
+	void startBuild(const std::string & defines); // submit a variant to the driver (or load it from the cache)
+	bool pendingDone(); // has the driver finished? (never blocks when it can compile in parallel)
+	void finishBuild(bool background = false); // check the pending variant and switch to it (background: the driver already finished it)
+	std::map<std::string, Uniform> uniforms; // every uniform we know about, by name
+	std::vector<Uniform *> dirtyUniforms; // uniforms changed since the last flush (map pointers are stable)
+	Uniform & uniform(const char * name, GLenum type); // find or create a table entry
+	const Uniform * find(const char * name); // NULL if it was never set
+	void markDirty(Uniform & u);
+	void resolveUniforms(); // look up every location once after linking
+	std::string cachePath(const std::string & defines); // program binary file for the current sources + defines
+	unsigned int loadBinary(const std::string & path); // try the on-disk program cache, 0 on a miss
+	void saveBinary(const std::string & path); // store the linked program for the next launch
+	unsigned int loadShader(const char * type, const ShaderSource & src, const std::string & defines) { // start compiling a specific shader
 		using namespace std;
 		unsigned int sdr; // Shader id
-		char * src_buf; // Shader source code
-		int success;
-		string str; // Temporary holder for shader source
-		ifstream t; // File handler
-
-		t.open(path); // Open the shader
-		t.seekg(0, std::ios::end); // Go to the end
-		str.reserve(t.tellg()); // read location (this is the size) and set string to that size
-		t.seekg(0, std::ios::beg); // Go back to the begining
+		vector<const char *> strings; // Shader source code, pieces of the files as read
+		vector<int> lengths;
 
-		// Set the string to the file data (DO NOT BREAK THIS)
-		// Automatically iterates through the entire stream of characters before
-		// compiling them into a character array to form a string.
-		str.assign((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
-
-		src_buf = new char[str.length() + 1]; // allocate space for c-style string
-		src_buf = (char *)str.c_str(); // create c style string
-		src_buf[str.length()] = 0; // Code doesn't work with out this, not sure why not though
-		t.close(); // close file buffer
+		src.pieces(defines, strings, lengths);
 
 		if (std::string("vertex").compare(type) == 0) { // This is a vertex shader
 			sdr = glCreateShader(GL_VERTEX_SHADER);
@@ -60,17 +104,15 @@ private:
 			exit(-1);
 		}
 
-		/* At this point src_buf really should be deleted.
-		 * it is just taking up extra space.
-		 * Unfortunately, doing that destroys str.
-		 * This causes a quiet error in the code and led to about
-		 * 6 hours of wasted time trying to track this bug.
-		 * Leaving the memory allocated will take up about a
-		 * megabyte more ram, but allows the program to run.
-		 */
+		glShaderSource(sdr, (GLsizei)strings.size(), strings.empty() ? 0 : &strings[0], strings.empty() ? 0 : &lengths[0]); // Tell OGL where the source is (it copies it)
+		glCompileShader(sdr); // compile the shader source (asking for the status here would wait for it)
+		return sdr; // Return the shader ID
+	}
+
+	bool checkShader(const char * type, unsigned int sdr) { // did a shader compile? (prints the log if not)
+		using namespace std;
+		int success;
 
-		glShaderSource(sdr, 1, (const char **)&src_buf, 0); // Tell OGL where the source is
-		glCompileShader(sdr); // compile the shader source
 		glGetShaderiv(sdr, GL_COMPILE_STATUS, &success); // Did it work?
 		if (!success) {
 			int info_len; // No, it did not work
@@ -89,16 +131,41 @@ private:
 			else {
 				cout << type << " shader compilation failed" << endl; // There is no info log!
 			}
-			exit(-1); // User should never see a broken program.
+			return false; // The caller decides if this is fatal
 		}
-		return sdr; // Return the shader ID
+		return true;
 	}
 };
 
+class RenderTarget { // offscreen colour buffer, for drawing below window resolution
+public:
+	// distances: two more attachments, the 3D shader's G-buffer. RGBA32F hit distance, glow steps and orbit values
+	// (gl_FragData[1]), RGBA16F normal and occlusion (gl_FragData[2])
+	RenderTarget(GLenum format = GL_RGBA8, bool distances = false) : width(0), height(0), fbo(0), texture(0), distanceTexture(0), surfaceTexture(0), format(format), distances(distances) {}
+	void resize(unsigned int w, unsigned int h); // (re)allocate, only if the size changed
+	void bind(); // draw into it (sets the viewport too, and clears the distances to 0 == nothing hit)
+	void blit(unsigned int w, unsigned int h); // stretch it over a w x h window
+	void read(uint8_t * pixels); // copy it back to the CPU, RGBA, bottom row first (width * height * 4 bytes)
+	void read(float * values); // likewise as floats, for the float formats (width * height * 4 of them)
+	GLuint id() const { return texture; } // to sample it in a later pass
+	GLuint distanceId() const { return distanceTexture; } // 0 without distances
+	GLuint surfaceId() const { return surfaceTexture; } // likewise
+	unsigned int width, height;
+private:
+	GLuint fbo, texture, distanceTexture, surfaceTexture;
+	GLenum format; // internal format, float ones are sampled without filtering
+	bool distances;
+	void allocate(GLuint tex, GLenum internalFormat); // size the texture, clamped, filtered by format
+};
+
+// (Re)fill a 3D float texture from data, making it first if texture is 0; returns it. Clamped at the edges,
+// linear filtering if asked for. channels: GL_RED or GL_RGB, matching internalFormat
+GLuint uploadVolume(GLuint texture, GLenum internalFormat, GLenum channels, unsigned int w, unsigned int h, unsigned int d, const float * data, bool linear);
+
 void setDefaultUniforms2d(Shader * shaders); // Set up the 2d shaders
 void setDefaultUniforms3d(Shader * shaders); // Set up the 3d shaders (EXPERIMENTAL)
 void resize(unsigned int width, unsigned int height); // Resize window
-uint8_t * getPixels(unsigned int x, unsigned int y, unsigned int width, unsigned int height); // Get all the pixels
+void getPixels(unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint8_t * pixels); // Get all the pixels now (stalls, use PixelReadback every frame)
 
 #if !defined(LITTLE_ENDIAN) && !defined(BIG_ENDIAN)
 #if  defined(__i386__) || defined(__ia64__) || defined(WIN32) || \
@@ -124,128 +191,13 @@ uint8_t * getPixels(unsigned int x, unsigned int y, unsigned int width, unsigned
 
 class Texture {
 public:
-	void load(const char * path); // load specific texture
-	void enable();
+	Texture() : texture(0) {}
+	void load(const char * path); // load specific texture right now (.ppm/.pgm through load_pnm, anything else through SOIL)
+	void swap(GLuint replacement); // start using a texture that is already uploaded, the old one is deleted
+	void enable(); // bind to texture unit 0
+	GLuint id() const { return texture; }
 private:
 	GLuint texture;
-	void * load_image(const char *fname, unsigned long *xsz, unsigned long *ysz) {
-		using namespace std;
-		ifstream fp(fname); // Open fname for reading
-		if (!(fp.is_open())) { // Can't open fname
-			cout << "failed to open: " << fname << endl;
-			return 0;
-		}
-
-		if (check_ppm(fp)) { // Is it actually a P6 ppm image file?
-			return load_ppm(fp, xsz, ysz); // load the image
-		}
-
-		fp.close(); // Close buffer
-		cout << "unsupported image format" << endl; // It didn't work
-		return 0; // classic C-style boolean
-	}
-
-	int check_ppm(std::ifstream & fp) {
-		using namespace std;
-		fp.seekg(0, ios::beg); // Go to the begining of the file again
-		if (fp.get() == 'P' && fp.get() == '6') { // is it P6?
-			return 1; // It worked (1 == true)
-		}
-		return 0; // Not a P6 ppm (0 == false)
-	}
-
-	int read_to_wspace(std::ifstream & fp, char * buf, int bsize) { // read until whitespace
-		int count = 0;
-		char c;
-
-		while (fp.get(c) && !isspace(c) && count < bsize - 1) { // While not whitespace nor max size
-			if (c == '#') { // if '#'
-				while (fp.get(c) && c != '\n' && c != '\r'); // While not a newline or EOF, keep reading
-				c = fp.get(); // What is the character now?
-				if (c == '\n' || c == '\r') continue; // not the end of the file, keep going
-			}
-			*buf++ = c; // next element in buf is now c
-			count++;
-		}
-		*buf = 0;
-
-		while (fp.get(c) && isspace(c)); // while spaces, read
-		fp.putback(c); // return one space to the stream
-		return count;
-	}
-
-	void * load_ppm(std::ifstream & fp, unsigned long *xsz, unsigned long *ysz) { // load a ppm P6 image file
-		using namespace std;
-		char buf[64];
-		int bytes, raw;
-		unsigned int w, h, i, sz;
-		uint32_t *pixels;
-
-		fp.seekg(0, ios::beg); // Go to the begining of the file
-
-		bytes = read_to_wspace(fp, buf, 64);
-		raw = buf[1] == '6';
-
-		if ((bytes = read_to_wspace(fp, buf, 64)) == 0) {
-			fp.close();
-			return 0;
-		}
-		if (!isdigit(*buf)) {
-			cout << "load_ppm: invalid width: " << buf;
-			fp.close();
-			return 0;
-		}
-		w = atoi(buf);
-
-		if ((bytes = read_to_wspace(fp, buf, 64)) == 0) {
-			fp.close();
-			return 0;
-		}
-		if (!isdigit(*buf)) {
-			cout << "load_ppm: invalid height: " << buf;
-			fp.close();
-			return 0;
-		}
-		h = atoi(buf);
-
-		if ((bytes = read_to_wspace(fp, buf, 64)) == 0) {
-			fp.close();
-			return 0;
-		}
-		if (!isdigit(*buf) || atoi(buf) != 255) {
-			cout << "load_ppm: invalid or unsupported max value: " << buf;
-			fp.close();
-			return 0;
-		}
-
-		if (!(pixels = new uint32_t[w * h])) {
-			cout << "malloc failed";
-			fp.close();
-			return 0;
-		}
-
-		sz = h * w;
-		for (i = 0; i<sz; i++) {
-			int r = fp.get();
-			int g = fp.get();
-			int b = fp.get();
-
-			if (r == -1 || g == -1 || b == -1) {
-				delete[] pixels;
-				fp.close();
-				cout << "load_ppm: EOF while reading pixel data";
-				return 0;
-			}
-			pixels[i] = PACK_COLOR24(r, g, b);
-		}
-
-		fp.close();
-
-		if (xsz) *xsz = w;
-		if (ysz) *ysz = h;
-		return pixels;
-	}
-
 };
 
 class Camera {
@@ -308,7 +260,7 @@ private:
 	const float deg2rad = 3.141593f / 180.0f;
 	Shader * shader;
 };
-PCTSTR getLeftStrings(); // get left side uniform strings
-PCTSTR getRightStrings(); // get right side uniform strings
-PCTSTR getControls(); // get the list of controls
+const char * getLeftStrings(); // get left side uniform strings
+const char * getRightStrings(); // get right side uniform strings
+const char * getControls(); // get the list of controls
 #endif	/* _UTIL_H_ */
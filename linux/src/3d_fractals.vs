@@ -1,6 +0,0 @@
-attribute vec3 vertexPosition;
-
-void main() 
-{
-    gl_Position = vec4(vertexPosition, 1.0);
-}
\ No newline at end of file
@@ -0,0 +1 @@
+#include "../../Visual Studio/Dependencies/OpenGL/include/SOIL.c"
@@ -0,0 +1 @@
+#include "../../Visual Studio/Fractal/batch.cpp"
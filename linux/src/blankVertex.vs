@@ -1,2 +0,0 @@
-void main() {
-}
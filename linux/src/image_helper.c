@@ -0,0 +1 @@
+#include "../../Visual Studio/Dependencies/OpenGL/include/image_helper.c"
@@ -0,0 +1 @@
+#include "../../Visual Studio/Fractal/raypacket_avx2.cpp"
@@ -0,0 +1 @@
+#include "../../Visual Studio/Dependencies/OpenGL/include/stb_image_aug.c"